@@ -3,15 +3,25 @@
 #include "Command.hpp"
 #include "Exception.hpp"
 #include "Logger.hpp"
+#include "Rustify/Aliases.hpp"
 
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
 #include <memory>
 #include <optional>
 #include <ranges>
 #include <string>
 #include <string_view>
+#include <sys/file.h>
+#include <system_error>
 #include <thread>
+#include <unistd.h>
 #include <utility>
 #include <vector>
 
@@ -56,10 +66,62 @@ replaceAll(
   return str;
 }
 
+void
+writeFileAtomically(const fs::path& path, const std::string_view content) {
+  fs::path tmpPath = path;
+  tmpPath += ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream ofs(tmpPath);
+    ofs << content;
+  }
+  fs::rename(tmpPath, path);
+}
+
+std::string
+getFileStamp(const fs::path& path) {
+  std::error_code ec;
+  const fs::file_time_type mtime = fs::last_write_time(path, ec);
+  return path.string() + ':'
+         + std::to_string(ec ? 0 : mtime.time_since_epoch().count());
+}
+
+FileLock::FileLock(const fs::path& path)
+    : fd(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+  if (fd == -1) {
+    throw PoacError(
+        "failed to open `", path.string(), "`: ", std::strerror(errno)
+    );
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+    return;
+  }
+  if (errno == EWOULDBLOCK) {
+    logger::info("Blocking", "waiting for file lock on {}", path.string());
+  }
+  while (flock(fd, LOCK_EX) == -1) {
+    if (errno != EINTR) {
+      const int err = errno;
+      close(fd);
+      throw PoacError(
+          "failed to lock `", path.string(), "`: ", std::strerror(err)
+      );
+    }
+  }
+}
+
+FileLock::~FileLock() {
+  close(fd);
+}
+
 int
 execCmd(const Command& cmd) noexcept {
   logger::debug("Running `{}`", cmd.toString());
-  return cmd.spawn().wait();
+  try {
+    return cmd.spawn().wait();
+  } catch (const PoacError& e) {
+    logger::error("{}", e.what());
+    return EXIT_COMMAND_NOT_FOUND;
+  }
 }
 
 std::string
@@ -83,18 +145,54 @@ getCmdOutput(const Command& cmd, const size_t retry) {
   throw PoacError("Command `", cmd, "` failed with exit code ", exitCode);
 }
 
+static bool
+isExecutable(const fs::path& path) noexcept {
+  std::error_code ec;
+  return fs::is_regular_file(path, ec) && access(path.c_str(), X_OK) == 0;
+}
+
+std::optional<fs::path>
+findExecutable(const std::string_view cmd) noexcept {
+  if (cmd.empty()) {
+    return std::nullopt;
+  }
+  if (cmd.find('/') != std::string_view::npos) {
+    if (isExecutable(cmd)) {
+      return fs::path(cmd);
+    }
+    return std::nullopt;
+  }
+
+  const char* pathEnv = std::getenv("PATH");
+  if (pathEnv == nullptr) {
+    return std::nullopt;
+  }
+  std::string_view paths = pathEnv;
+  while (true) {
+    const size_t sep = paths.find(':');
+    std::string_view dir = paths.substr(0, sep);
+    if (dir.empty()) {
+      dir = ".";  // An empty entry means the current directory.
+    }
+
+    fs::path candidate = fs::path(dir) / cmd;
+    if (isExecutable(candidate)) {
+      return candidate;
+    }
+    if (sep == std::string_view::npos) {
+      return std::nullopt;
+    }
+    paths.remove_prefix(sep + 1);
+  }
+}
+
 bool
 commandExists(const std::string_view cmd) noexcept {
-  const int exitCode = Command("which")
-                           .addArg(cmd)
-                           .setStdoutConfig(Command::IOConfig::Null)
-                           .spawn()
-                           .wait();
-  return exitCode == EXIT_SUCCESS;
+  return findExecutable(cmd).has_value();
 }
 
 // ref: https://wandbox.org/permlink/zRjT41alOHdwcf00
-static size_t
+size_t
 levDistance(const std::string_view lhs, const std::string_view rhs) {
   const size_t lhsSize = lhs.size();
   const size_t rhsSize = rhs.size();
@@ -184,6 +282,7 @@ findSimilarStr(
 
 #  include <array>
 #  include <limits>
+#  include <sys/wait.h>
 
 namespace tests {
 
@@ -265,6 +364,52 @@ testFindSimilarStr2() {
   pass();
 }
 
+static void
+testFindExecutable() {
+  assertTrue(findExecutable("sh").has_value());
+  assertTrue(findExecutable("/bin/sh").has_value());
+  assertFalse(findExecutable("poac-no-such-command").has_value());
+  assertFalse(findExecutable("").has_value());
+  // Directories are not executables.
+  assertFalse(findExecutable("/").has_value());
+
+  pass();
+}
+
+static void
+testExecCmd() {
+  assertEq(execCmd(Command("true")), EXIT_SUCCESS);
+  assertEq(execCmd(Command("false")), EXIT_FAILURE);
+  assertEq(execCmd(Command("poac-no-such-command")), EXIT_COMMAND_NOT_FOUND);
+
+  pass();
+}
+
+static void
+testFileLock() {
+  const TempDir tmpDir("poac-file-lock");
+  const fs::path path = tmpDir.path() / "lock";
+  // Returns whether another process fails to take the lock.
+  const auto isLockedElsewhere = [&path]() {
+    const pid_t pid = fork();
+    if (pid == 0) {
+      const int fd = open(path.c_str(), O_RDWR);
+      _exit(flock(fd, LOCK_EX | LOCK_NB) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WEXITSTATUS(status) != EXIT_SUCCESS;
+  };
+
+  {
+    const FileLock lock(path);
+    assertTrue(isLockedElsewhere());
+  }
+  assertFalse(isLockedElsewhere());
+
+  pass();
+}
+
 }  // namespace tests
 
 int
@@ -273,6 +418,9 @@ main() {
   tests::testLevDistance2();
   tests::testFindSimilarStr();
   tests::testFindSimilarStr2();
+  tests::testFindExecutable();
+  tests::testExecCmd();
+  tests::testFileLock();
 }
 
 #endif
@@ -2,6 +2,8 @@
 
 #include "Command.hpp"
 
+#include <cstddef>
+#include <filesystem>
 #include <optional>
 #include <span>
 #include <string>
@@ -12,10 +14,48 @@ std::string toMacroName(std::string_view name) noexcept;
 std::string
 replaceAll(std::string str, std::string_view from, std::string_view to);
 
+// Writes `content` to a temporary file and renames it to `path`, so that
+// concurrent readers never see a partial file.
+void writeFileAtomically(
+    const std::filesystem::path& path, std::string_view content
+);
+
+// Identifies a file, e.g., a tool binary, by its path and mtime, so that
+// upgrades invalidate caches keyed by it.
+std::string getFileStamp(const std::filesystem::path& path);
+
+// An exclusive lock on a file, created if needed, held until destroyed.
+// The lock is advisory and released by the OS if the process dies.  Locks
+// taken through different FileLock objects exclude each other even within
+// one process, so this also serializes threads.
+class FileLock {
+  int fd;
+
+public:
+  explicit FileLock(const std::filesystem::path& path);
+  FileLock(const FileLock&) = delete;
+  FileLock(FileLock&&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+  FileLock& operator=(FileLock&&) = delete;
+  ~FileLock();
+};
+
+// What shells exit with when a command cannot be run.
+constexpr int EXIT_COMMAND_NOT_FOUND = 127;
+
+// Runs `cmd` and returns its exit code.  If it cannot be spawned, this logs
+// the error and returns EXIT_COMMAND_NOT_FOUND.
 int execCmd(const Command& cmd) noexcept;
 std::string getCmdOutput(const Command& cmd, size_t retry = 3);
+// Searches PATH for an executable named `cmd` like the shell does, without
+// spawning a process.  A `cmd` containing a slash is checked as is.
+std::optional<std::filesystem::path> findExecutable(std::string_view cmd
+) noexcept;
 bool commandExists(std::string_view cmd) noexcept;
 
+// The number of single-character edits to turn `lhs` into `rhs`.
+size_t levDistance(std::string_view lhs, std::string_view rhs);
+
 // ref: https://reviews.llvm.org/differential/changeset/?ref=3315514
 /// Find a similar string in `candidates`.
 ///
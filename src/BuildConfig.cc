@@ -1,17 +1,23 @@
 #include "BuildConfig.hpp"
 
 #include "Algos.hpp"
+#include "BuildEvents.hpp"
 #include "Command.hpp"
+#include "CommandPool.hpp"
 #include "Exception.hpp"
+#include "FileWalker.hpp"
 #include "Git2.hpp"
+#include "Hash.hpp"
 #include "Logger.hpp"
 #include "Manifest.hpp"
 #include "Parallelism.hpp"
 #include "TermColor.hpp"
+#include "Toolchain.hpp"
 
 #include <algorithm>
 #include <array>
 #include <cctype>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
@@ -20,6 +26,7 @@
 #include <fmt/core.h>
 #include <fmt/ranges.h>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -31,10 +38,8 @@
 #include <sstream>
 #include <string>
 #include <string_view>
-#include <tbb/blocked_range.h>
-#include <tbb/parallel_for.h>
-#include <tbb/spin_mutex.h>
 #include <thread>
+#include <unistd.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -77,36 +82,109 @@ BuildConfig::BuildConfig(const std::string& packageName, const bool isDebug)
   }
   buildOutPath = outBasePath / (packageName + ".d");
   unittestOutPath = outBasePath / "unittests";
+  benchOutPath = outBasePath / "benchmarks";
 
-  if (const char* cxx = std::getenv("CXX")) {
-    this->cxx = cxx;
-  } else {
-    const std::string output = Command("make")
-                                   .addArg("--print-data-base")
-                                   .addArg("--question")
-                                   .addArg("-f")
-                                   .addArg("/dev/null")
-                                   .setStderrConfig(Command::IOConfig::Null)
-                                   .output()
-                                   .stdout;
-    std::istringstream iss(output);
-    std::string line;
-
-    while (std::getline(iss, line)) {
-      if (line.starts_with("CXX = ")) {
-        this->cxx = line.substr("CXX = "sv.size());
-        return;
+  this->cxx = getToolchain().cxx;
+}
+
+void
+BuildConfig::setOutBasePath(const fs::path& outBasePath) {
+  this->outBasePath = outBasePath;
+  buildOutPath = outBasePath / (packageName + ".d");
+  unittestOutPath = outBasePath / "unittests";
+  benchOutPath = outBasePath / "benchmarks";
+  // The first include is the package's own, relative to the Makefile.
+  includes.front() =
+      "-I"
+      + fs::relative(getProjectBasePath() / "include", outBasePath).string();
+}
+
+void
+BuildConfig::joinWorkspace(const fs::path& workspaceOutBasePath) {
+  setOutBasePath(workspaceOutBasePath);
+  unittestOutPath = outBasePath / "unittests" / packageName;
+  benchOutPath = outBasePath / "benchmarks" / packageName;
+  varPrefix = toMacroName(packageName) + '_';
+}
+
+static bool
+hasLibSource(const fs::path& srcDir) {
+  for (const auto& entry : fs::directory_iterator(srcDir)) {
+    const fs::path& path = entry.path();
+    if (SOURCE_FILE_EXTS.contains(path.extension())
+        && path.filename().stem() == "lib") {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+BuildConfig::linkMember(const BuildConfig& member, const fs::path& memberDir) {
+  // The member's own include directory comes first in its includes, and it
+  // is relative to the shared output directory.
+  for (const std::string& include : member.includes) {
+    if (std::ranges::find(includes, include) == includes.end()) {
+      includes.push_back(include);
+    }
+  }
+
+  if (hasLibSource(memberDir / "src")) {
+    const std::string libPath = member.outBasePath / member.libName;
+    memberLibs.push_back(libPath);
+    // Static libraries must precede the libraries they depend on.
+    libs.push_back(libPath);
+  }
+  memberLibs.insert(
+      memberLibs.end(), member.memberLibs.begin(), member.memberLibs.end()
+  );
+  libs.insert(libs.end(), member.libs.begin(), member.libs.end());
+}
+
+void
+BuildConfig::mergeMember(const BuildConfig& member) {
+  for (const auto& [name, value] : member.variables) {
+    // Only shared variables, such as CXX, have the same name across members,
+    // and they have the same value.
+    variables[name] = value;
+  }
+  for (const auto& [name, deps] : member.varDeps) {
+    varDeps[name].insert(varDeps[name].end(), deps.begin(), deps.end());
+  }
+
+  for (const auto& [name, target] : member.targets) {
+    if (!targets.contains(name)) {
+      defineTarget(name, target.commands, target.remDeps, target.sourceFile);
+      continue;
+    }
+
+    // Targets shared across members aggregate their deps.
+    for (const std::string& dep : target.remDeps) {
+      if (targets[name].remDeps.insert(dep).second) {
+        targetDeps[dep].push_back(name);
       }
     }
-    throw PoacError("failed to get CXX from make");
   }
+
+  if (member.phony.has_value()) {
+    for (const std::string& target : member.phony.value()) {
+      addPhony(target);
+    }
+  }
+
+  hasBinaryTarget = hasBinaryTarget || member.hasBinaryTarget;
+  hasLibraryTarget = hasLibraryTarget || member.hasLibraryTarget;
+
+  // The `all` target of the workspace builds every member's outputs.
+  outputs.insert(outputs.end(), member.outputs.begin(), member.outputs.end());
+  setAll({ outputs.begin(), outputs.end() });
 }
 
 // Generally split the string by space character, but it will properly interpret
 // the quotes and some escape sequences. (More specifically it will ignore
 // whatever character that goes after a backslash and preserve all characters,
 // usually used to pass an argument containing spaces, between quotes.)
-static std::vector<std::string>
+std::vector<std::string>
 parseEnvFlags(std::string_view env) {
   std::vector<std::string> result;
   std::string buffer;
@@ -310,6 +388,11 @@ BuildConfig::emitMakefile(std::ostream& os) const {
   if (all.has_value()) {
     emitTarget(os, "all", all.value());
   }
+  if (!targets.empty()) {
+    // .cmd files are written by poac, not make.  Without this, a missing one
+    // would stop make with "No rule to make target" instead of rebuilding.
+    os << "%.cmd: ;\n\n";
+  }
 
   const std::vector<std::string> sortedTargets = topoSort(targets, targetDeps);
   for (const auto& sortedTarget : std::ranges::reverse_view(sortedTargets)) {
@@ -384,19 +467,6 @@ BuildConfig::emitCompdb(std::ostream& os) const {
   os << "]\n";
 }
 
-std::string
-BuildConfig::runMM(const std::string& sourceFile, const bool isTest) const {
-  Command command =
-      Command(cxx).addArgs(cxxflags).addArgs(defines).addArgs(includes);
-  if (isTest) {
-    command.addArg("-DPOAC_TEST");
-  }
-  command.addArg("-MM");
-  command.addArg(sourceFile);
-  command.setWorkingDirectory(outBasePath);
-  return getCmdOutput(command);
-}
-
 static std::unordered_set<std::string>
 parseMMOutput(const std::string& mmOutput, std::string& target) {
   std::istringstream iss(mmOutput);
@@ -423,30 +493,104 @@ parseMMOutput(const std::string& mmOutput, std::string& target) {
   return deps;
 }
 
+// Outputs of the scanning commands are not interesting unless they fail.
+static void
+checkExitCode(const Command& cmd, const int exitCode) {
+  if (exitCode != EXIT_SUCCESS) {
+    throw PoacError("Command `", cmd, "` failed with exit code ", exitCode);
+  }
+}
+
+void
+BuildConfig::runMM(
+    CommandPool& pool, const std::string& sourceFile,
+    const std::string_view condMacro,
+    std::function<void(std::string, std::unordered_set<std::string>)> onDeps
+) const {
+  Command command =
+      Command(cxx).addArgs(cxxflags).addArgs(defines).addArgs(includes);
+  if (!condMacro.empty()) {
+    command.addArg(fmt::format("-D{}", condMacro));
+  }
+  command.addArg("-MM");
+  command.addArg(sourceFile);
+  command.setWorkingDirectory(outBasePath);
+
+  logger::debug("Running `{}`", command.toString());
+  pool.submit(
+      command,
+      [command, onDeps = std::move(onDeps)](
+          const CommandPool::Result& result, CommandOutput&& output
+      ) {
+        checkExitCode(command, result.exitCode);
+        std::string objTarget;
+        std::unordered_set<std::string> deps =
+            parseMMOutput(output.stdout, objTarget);
+        onDeps(std::move(objTarget), std::move(deps));
+      }
+  );
+}
+
+// Make does not notice changes of flags, the toolchain, or dependencies, so
+// outputs are regenerated when the fingerprint of the configuration they were
+// generated with, stored next to them, changes.
 static bool
-isUpToDate(const std::string_view makefilePath) {
+isFingerprintUnchanged(
+    const std::string& outputPath, const std::string& fingerprint
+) {
+  std::ifstream ifs(outputPath + ".fingerprint");
+  std::string recorded;
+  return std::getline(ifs, recorded) && recorded == fingerprint;
+}
+
+static void
+writeFingerprint(
+    const std::string& outputPath, const std::string& fingerprint
+) {
+  std::ofstream(outputPath + ".fingerprint") << fingerprint << '\n';
+}
+
+static bool
+isUpToDate(
+    const std::string_view makefilePath,
+    const std::vector<fs::path>& projectBasePaths
+) {
   if (!fs::exists(makefilePath)) {
     return false;
   }
 
   const fs::file_time_type makefileTime = fs::last_write_time(makefilePath);
-  // Makefile depends on all files in ./src and poac.toml.
-  const fs::path srcDir = getProjectBasePath() / "src";
-  for (const auto& entry : fs::recursive_directory_iterator(srcDir)) {
-    if (fs::last_write_time(entry.path()) > makefileTime) {
+  const fs::path outDir = fs::path(makefilePath).parent_path();
+  for (const fs::path& projectBasePath : projectBasePaths) {
+    // Makefile depends on all files in ./src and poac.toml.
+    const fs::path srcDir = projectBasePath / "src";
+    const std::vector<WalkEntry> entries =
+        FileWalker(srcDir)
+            .includeDirs()
+            .statFiles()
+            .setSnapshotPath(FileWalker::snapshotPathFor(outDir, srcDir))
+            .walk();
+    for (const WalkEntry& entry : entries) {
+      if (entry.mtime > makefileTime) {
+        return false;
+      }
+    }
+    if (fs::last_write_time(projectBasePath / "poac.toml") > makefileTime) {
       return false;
     }
   }
-  return fs::last_write_time(getProjectBasePath() / "poac.toml")
-         <= makefileTime;
+  return true;
 }
 
-bool
-BuildConfig::containsTestCode(const std::string& sourceFile) const {
+void
+BuildConfig::containsCondCode(
+    CommandPool& pool, const std::string& sourceFile,
+    const std::string_view condMacro, std::function<void(bool)> onResult
+) const {
   std::ifstream ifs(sourceFile);
   std::string line;
   while (std::getline(ifs, line)) {
-    if (line.find("POAC_TEST") != std::string::npos) {
+    if (line.find(condMacro) != std::string::npos) {
       // TODO: Can't we somehow elegantly make the compiler command sharable?
       Command command(cxx);
       command.addArg("-E");
@@ -454,40 +598,116 @@ BuildConfig::containsTestCode(const std::string& sourceFile) const {
       command.addArgs(defines);
       command.addArgs(includes);
       command.addArg(sourceFile);
+      Command testCommand = command;
+      testCommand.addArg(fmt::format("-D{}", condMacro));
+
+      // If the source file contains the macro, e.g., POAC_TEST, by
+      // processing the source file with -E, we can check if the source file
+      // contains POAC_TEST or not semantically.  If the source file contains
+      // POAC_TEST, the test source file should be different from the
+      // original source file.  The preprocessed sources can be megabytes;
+      // compare their hashes instead of keeping them.
+      struct State {
+        HashSink src;
+        HashSink testSrc;
+        NullSink stderrSink;
+        int numPending = 2;
+      };
+      const auto state = std::make_shared<State>();
+      const auto onExit = [state, sourceFile, condMacro,
+                           onResult](const Command& cmd) {
+        return [state, sourceFile, condMacro, onResult,
+                cmd](const CommandPool::Result& result) {
+          checkExitCode(cmd, result.exitCode);
+          if (--state->numPending > 0) {
+            return;
+          }
+          const bool containsTest =
+              state->src.digest() != state->testSrc.digest();
+          if (containsTest) {
+            logger::debug("Found {} code: {}", condMacro, sourceFile);
+          }
+          onResult(containsTest);
+        };
+      };
+
+      logger::debug("Running `{}`", command.toString());
+      pool.submit(command, state->src, state->stderrSink, onExit(command));
+      logger::debug("Running `{}`", testCommand.toString());
+      pool.submit(
+          testCommand, state->testSrc, state->stderrSink, onExit(testCommand)
+      );
+      return;
+    }
+  }
+  onResult(false);
+}
 
-      const std::string src = getCmdOutput(command);
-
-      command.addArg("-DPOAC_TEST");
-      const std::string testSrc = getCmdOutput(command);
-
-      // If the source file contains POAC_TEST, by processing the source
-      // file with -E, we can check if the source file contains POAC_TEST
-      // or not semantically.  If the source file contains POAC_TEST, the
-      // test source file should be different from the original source
-      // file.
-      const bool containsTest = src != testSrc;
-      if (containsTest) {
-        logger::debug("Found test code: ", sourceFile);
-      }
-      return containsTest;
+// Writes `content` to `path` unless it already has it, so that make does
+// not consider the file, and what depends on it, out of date.
+static void
+writeIfChanged(const fs::path& path, const std::string& content) {
+  if (std::ifstream ifs(path); ifs) {
+    const std::string current{ std::istreambuf_iterator<char>(ifs),
+                               std::istreambuf_iterator<char>() };
+    if (current == content) {
+      return;
     }
   }
-  return false;
+  fs::create_directories(path.parent_path());
+  std::ofstream(path) << content;
+}
+
+// Records the expanded command of `target` in `target.cmd`, and returns its
+// path for the target to depend on.  The file is rewritten only when the
+// command changes, so make rebuilds exactly the targets whose command line
+// changed, e.g., after editing a profile.
+static std::string
+recordCommand(const std::string& target, const std::string& command) {
+  const std::string cmdPath = target + ".cmd";
+  writeIfChanged(cmdPath, command);
+  return cmdPath;
 }
 
 void
 BuildConfig::defineCompileTarget(
     const std::string& objTarget, const std::string& sourceFile,
-    const std::unordered_set<std::string>& remDeps, const bool isTest
+    const std::unordered_set<std::string>& remDeps,
+    const std::string_view condMacro
 ) {
   std::vector<std::string> commands;
   commands.emplace_back("@mkdir -p $(@D)");
-  commands.emplace_back("$(CXX) $(CXXFLAGS) $(DEFINES) $(INCLUDES)");
-  if (isTest) {
-    commands.back() += " -DPOAC_TEST";
+  commands.emplace_back(fmt::format(
+      "$(CXX) {} {} {}", varRef("CXXFLAGS"), varRef("DEFINES"),
+      varRef("INCLUDES")
+  ));
+  if (!condMacro.empty()) {
+    commands.back() += fmt::format(" -D{}", condMacro);
   }
   commands.back() += " -c $< -o $@";
-  defineTarget(objTarget, commands, remDeps, sourceFile);
+
+  std::string command = fmt::format(
+      "{} {} {} {}", cxx, fmt::join(cxxflags, " "), fmt::join(defines, " "),
+      fmt::join(includes, " ")
+  );
+  if (!condMacro.empty()) {
+    command += fmt::format(" -D{}", condMacro);
+  }
+  command += " -c " + sourceFile;
+  std::unordered_set<std::string> objTargetDeps = remDeps;
+  objTargetDeps.insert(recordCommand(objTarget, command));
+
+  defineTarget(objTarget, commands, objTargetDeps, sourceFile);
+}
+
+std::string
+BuildConfig::recordLinkCommand(const std::string& target) const {
+  return recordCommand(
+      target, fmt::format(
+                  "{} {} {}", cxx, fmt::join(cxxflags, " "),
+                  fmt::join(libs, " ")
+              )
+  );
 }
 
 void
@@ -572,13 +792,160 @@ BuildConfig::collectBinDepObjs(  // NOLINT(misc-no-recursion)
   }
 }
 
+std::string
+BuildConfig::buildDepLib(const fs::path& packageDir) const {
+  // Dependencies are built with the profile of the package depending on
+  // them, so it is looked up before entering the dependency's manifest.
+  const Profile& profile = getProfile();
+  const ManifestScope scope(packageDir);
+  BuildConfig config(getPackageName(), isDebug);
+  config.cxx = cxx;
+  config.consumerProfile = &profile;
+
+  if (!hasLibSource(packageDir / "src")) {
+    logger::debug("{} has no library sources", config.packageName);
+    return "";
+  }
+
+  // Transitive dependencies are built first; their flags are part of the key.
+  config.installDeps(/*includeDevDeps=*/false);
+
+  git2::Repository repo{};
+  repo.open(packageDir.string());
+  const std::string commitHash = repo.refNameToId("HEAD").toString();
+
+  // The library is reusable across projects as long as the sources, the
+  // toolchain, and the flags affecting the object code are the same.
+  std::vector<std::string> profileFlags(
+      profile.cxxflags.begin(), profile.cxxflags.end()
+  );
+  std::ranges::sort(profileFlags);  // unordered_set has no specified order.
+
+  Hasher hasher;
+  hasher.updateField(commitHash)
+      .updateField(cxx)
+      .updateField(getToolchain().cxxVersion)
+      .updateField(getToolchain().targetTriple)
+      .updateField(modeToString(isDebug))
+      .updateField(getPackageEdition().getString())
+      .updateField(profile.lto ? "lto" : "")
+      .updateField(fmt::format("{}", fmt::join(profileFlags, " ")))
+      .updateField(fmt::format("{}", fmt::join(getEnvFlags("CXXFLAGS"), " ")))
+      .updateField(fmt::format("{}", fmt::join(config.includes, " ")))
+      .updateField(fmt::format("{}", fmt::join(config.libs, " ")));
+
+  const fs::path libDir = getCacheDir() / "lib"
+                          / (config.packageName + '-' + hasher.hexDigest());
+  config.setOutBasePath(libDir);
+  const fs::path libPath = libDir / config.libName;
+
+  // Another poac process may be building the same library into the cache.
+  fs::create_directories(libDir.parent_path());
+  const FileLock lock(libDir.string() + ".lock");
+  if (fs::exists(libPath)) {
+    logger::debug("{} is already built", config.packageName);
+    emitEvent(
+        "cache-hit", { { "kind", "library" }, { "name", config.packageName } }
+    );
+  } else {
+    config.writeBuildInfo();
+    config.configureBuild();
+    {
+      std::ofstream ofs(libDir / "Makefile");
+      config.emitMakefile(ofs);
+    }
+
+    logger::info(
+        "Compiling", "{} v{} ({})", config.packageName,
+        getPackageVersion().toString(), packageDir.string()
+    );
+    const Command makeCmd = getMakeCommand()
+                                .addArg("-C")
+                                .addArg(libDir.string())
+                                .addArg(libPath.string());
+    if (execCmd(makeCmd) != EXIT_SUCCESS) {
+      throw PoacError("failed to build `", config.packageName, "`");
+    }
+  }
+
+  // Static libraries must precede the libraries they depend on.
+  std::vector<std::string> libFlags = { libPath.string() };
+  libFlags.insert(libFlags.end(), config.libs.begin(), config.libs.end());
+  return fmt::format("{}", fmt::join(libFlags, " "));
+}
+
+std::string
+BuildConfig::getConfigFingerprint() const {
+  const Toolchain& toolchain = getToolchain();
+  Hasher hasher;
+  hasher.updateField(cxx)
+      .updateField(toolchain.cxxVersion)
+      .updateField(toolchain.targetTriple)
+      .updateField(modeToString(isDebug))
+      .updateField(shouldColor() ? "color" : "")
+      .updateField(fmt::format("{}", fmt::join(getEnvFlags("CXXFLAGS"), " ")))
+      .updateField(fmt::format("{}", fmt::join(includes, " ")))
+      .updateField(fmt::format("{}", fmt::join(libs, " ")));
+  return hasher.hexDigest();
+}
+
 void
-BuildConfig::installDeps(const bool includeDevDeps) {
-  const std::vector<DepMetadata> deps = installDependencies(includeDevDeps);
+BuildConfig::writeBuildInfo() const {
+  std::string commitHash;
+  std::string commitShortHash;
+  std::string commitDate;
+  try {
+    git2::Repository repo{};
+    repo.open(getProjectBasePath().string());
+
+    const git2::Oid oid = repo.refNameToId("HEAD");
+    commitHash = oid.toString();
+    commitShortHash = commitHash.substr(0, git2::SHORT_HASH_LEN);
+    commitDate = git2::Commit().lookup(repo, oid).time().toString();
+  } catch (const git2::Exception& e) {
+    logger::debug("No git repository found");
+  }
+
+  const std::string pkgName = toMacroName(packageName);
+  const std::string content = fmt::format(
+      "// Generated by poac.  Do not edit.\n"
+      "#pragma once\n"
+      "\n"
+      "#define POAC_{0}_COMMIT_HASH \"{1}\"\n"
+      "#define POAC_{0}_COMMIT_SHORT_HASH \"{2}\"\n"
+      "#define POAC_{0}_COMMIT_DATE \"{3}\"\n",
+      pkgName, commitHash, commitShortHash, commitDate
+  );
+
+  // Rewriting the header only when it changes keeps the sources including it
+  // from being rebuilt on every run.
+  writeIfChanged(buildOutPath / "gen" / "poac" / "build_info.hpp", content);
+}
+
+const Profile&
+BuildConfig::getProfile() const {
+  if (consumerProfile != nullptr) {
+    return *consumerProfile;
+  }
+  return isDebug ? getDevProfile() : getReleaseProfile();
+}
+
+void
+BuildConfig::installDeps(
+    const bool includeDevDeps,
+    const std::unordered_set<std::string>& memberNames
+) {
+  const std::vector<DepMetadata> deps =
+      installDependencies(includeDevDeps, memberNames);
   for (const DepMetadata& dep : deps) {
     if (!dep.includes.empty()) {
       includes.push_back(replaceAll(dep.includes, "-I", "-isystem"));
     }
+    if (dep.packageDir.has_value()) {
+      if (std::string lib = buildDepLib(dep.packageDir.value()); !lib.empty()) {
+        libs.push_back(std::move(lib));
+      }
+    }
     if (!dep.libs.empty()) {
       libs.push_back(dep.libs);
     }
@@ -599,7 +966,7 @@ BuildConfig::setVariables() {
   this->defineSimpleVar("CXX", cxx);
 
   cxxflags.push_back("-std=c++" + getPackageEdition().getString());
-  if (shouldColor()) {
+  if (shouldColor() && isFlagSupported("-fdiagnostics-color")) {
     cxxflags.emplace_back("-fdiagnostics-color");
   }
   if (isDebug) {
@@ -610,7 +977,7 @@ BuildConfig::setVariables() {
     cxxflags.emplace_back("-O3");
     cxxflags.emplace_back("-DNDEBUG");
   }
-  const Profile& profile = isDebug ? getDevProfile() : getReleaseProfile();
+  const Profile& profile = getProfile();
   if (profile.lto) {
     cxxflags.emplace_back("-flto");
   }
@@ -624,25 +991,11 @@ BuildConfig::setVariables() {
     cxxflags.emplace_back(flag);
   }
   this->defineSimpleVar(
-      "CXXFLAGS", fmt::format("{:s}", fmt::join(cxxflags, " "))
+      varPrefix + "CXXFLAGS", fmt::format("{:s}", fmt::join(cxxflags, " "))
   );
 
   const std::string pkgName = toMacroName(this->packageName);
   const Version& pkgVersion = getPackageVersion();
-  std::string commitHash;
-  std::string commitShortHash;
-  std::string commitDate;
-  try {
-    git2::Repository repo{};
-    repo.open(".");
-
-    const git2::Oid oid = repo.refNameToId("HEAD");
-    commitHash = oid.toString();
-    commitShortHash = commitHash.substr(0, git2::SHORT_HASH_LEN);
-    commitDate = git2::Commit().lookup(repo, oid).time().toString();
-  } catch (const git2::Exception& e) {
-    logger::debug("No git repository found");
-  }
 
   // Variables Poac sets for the user.
   const std::vector<std::pair<std::string, std::string>> defines{
@@ -656,9 +1009,6 @@ BuildConfig::setVariables() {
       std::to_string(pkgVersion.patch) },
     { fmt::format("POAC_{}_PKG_VERSION_PRE", pkgName),
       pkgVersion.pre.toString() },
-    { fmt::format("POAC_{}_COMMIT_HASH", pkgName), commitHash },
-    { fmt::format("POAC_{}_COMMIT_SHORT_HASH", pkgName), commitShortHash },
-    { fmt::format("POAC_{}_COMMIT_DATE", pkgName), commitDate },
     { fmt::format("POAC_{}_PROFILE", pkgName),
       std::string(modeToString(isDebug)) },
   };
@@ -667,10 +1017,12 @@ BuildConfig::setVariables() {
   }
 
   this->defineSimpleVar(
-      "DEFINES", fmt::format("{:s}", fmt::join(this->defines, " "))
+      varPrefix + "DEFINES", fmt::format("{:s}", fmt::join(this->defines, " "))
   );
+  // For the generated <poac/build_info.hpp>.
+  includes.push_back("-I" + (buildOutPath / "gen").string());
   this->defineSimpleVar(
-      "INCLUDES", fmt::format("{:s}", fmt::join(includes, " "))
+      varPrefix + "INCLUDES", fmt::format("{:s}", fmt::join(includes, " "))
   );
 
   // Environment variables takes the highest precedence and will be appended at
@@ -678,119 +1030,121 @@ BuildConfig::setVariables() {
   for (const std::string& flag : getEnvFlags("LDFLAGS")) {
     libs.push_back(flag);
   }
-  this->defineSimpleVar("LIBS", fmt::format("{:s}", fmt::join(libs, " ")));
+  this->defineSimpleVar(
+      varPrefix + "LIBS", fmt::format("{:s}", fmt::join(libs, " "))
+  );
 }
 
 void
 BuildConfig::processSrc(
-    const fs::path& sourceFilePath,
-    std::unordered_set<std::string>& buildObjTargets, tbb::spin_mutex* mtx
+    CommandPool& pool, const fs::path& sourceFilePath,
+    std::unordered_set<std::string>& buildObjTargets
 ) {
-  std::string objTarget;  // source.o
-  const std::unordered_set<std::string> objTargetDeps =
-      parseMMOutput(runMM(sourceFilePath), objTarget);
-
-  const fs::path targetBaseDir =
-      fs::relative(sourceFilePath.parent_path(), getProjectBasePath() / "src");
-  fs::path buildTargetBaseDir = buildOutPath;
-  if (targetBaseDir != ".") {
-    buildTargetBaseDir /= targetBaseDir;
-  }
-
-  const std::string buildObjTarget = buildTargetBaseDir / objTarget;
+  runMM(
+      pool, sourceFilePath, /*condMacro=*/"",
+      [this, sourceFilePath, &buildObjTargets](
+          const std::string& objTarget,
+          const std::unordered_set<std::string>& objTargetDeps
+      ) {
+        const fs::path targetBaseDir = fs::relative(
+            sourceFilePath.parent_path(), getProjectBasePath() / "src"
+        );
+        fs::path buildTargetBaseDir = buildOutPath;
+        if (targetBaseDir != ".") {
+          buildTargetBaseDir /= targetBaseDir;
+        }
 
-  if (mtx) {
-    mtx->lock();
-  }
-  buildObjTargets.insert(buildObjTarget);
-  defineCompileTarget(buildObjTarget, sourceFilePath, objTargetDeps);
-  if (mtx) {
-    mtx->unlock();
-  }
+        const std::string buildObjTarget = buildTargetBaseDir / objTarget;
+        buildObjTargets.insert(buildObjTarget);
+        defineCompileTarget(buildObjTarget, sourceFilePath, objTargetDeps);
+      }
+  );
 }
 
 std::unordered_set<std::string>
 BuildConfig::processSources(const std::vector<fs::path>& sourceFilePaths) {
   std::unordered_set<std::string> buildObjTargets;
 
-  if (isParallel()) {
-    tbb::spin_mutex mtx;
-    tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, sourceFilePaths.size()),
-        [&](const tbb::blocked_range<size_t>& rng) {
-          for (size_t i = rng.begin(); i != rng.end(); ++i) {
-            processSrc(sourceFilePaths[i], buildObjTargets, &mtx);
-          }
-        }
-    );
-  } else {
-    for (const fs::path& sourceFilePath : sourceFilePaths) {
-      processSrc(sourceFilePath, buildObjTargets);
-    }
+  // Callbacks run on this thread, so the build graph needs no lock.
+  CommandPool pool(getParallelism());
+  for (const fs::path& sourceFilePath : sourceFilePaths) {
+    processSrc(pool, sourceFilePath, buildObjTargets);
   }
+  pool.wait();
 
   return buildObjTargets;
 }
 
 void
-BuildConfig::processUnittestSrc(
-    const fs::path& sourceFilePath,
-    const std::unordered_set<std::string>& buildObjTargets,
-    std::unordered_set<std::string>& testTargets, tbb::spin_mutex* mtx
+BuildConfig::processCondSrc(
+    CommandPool& pool, const fs::path& sourceFilePath,
+    const std::string_view condMacro, const fs::path& outPath,
+    const std::string_view suffix,
+    const std::unordered_set<std::string>& buildObjTargets
 ) {
-  if (!containsTestCode(sourceFilePath)) {
-    return;
-  }
-
-  std::string objTarget;  // source.o
-  const std::unordered_set<std::string> objTargetDeps =
-      parseMMOutput(runMM(sourceFilePath, /*isTest=*/true), objTarget);
-
-  const fs::path targetBaseDir = fs::relative(
-      sourceFilePath.parent_path(), getProjectBasePath() / "src"_path
-  );
-  fs::path testTargetBaseDir = unittestOutPath;
-  if (targetBaseDir != ".") {
-    testTargetBaseDir /= targetBaseDir;
-  }
-
-  const std::string testObjTarget = testTargetBaseDir / objTarget;
-  const std::string testTarget =
-      (testTargetBaseDir / sourceFilePath.filename()).string() + ".test";
-
-  // Test binary target.
-  std::unordered_set<std::string> testTargetDeps = { testObjTarget };
-  collectBinDepObjs(
-      testTargetDeps, sourceFilePath.stem().string(), objTargetDeps,
-      buildObjTargets
-  );
-
-  if (mtx) {
-    mtx->lock();
-  }
-  // Test object target.
-  defineCompileTarget(
-      testObjTarget, sourceFilePath, objTargetDeps, /*isTest=*/true
+  containsCondCode(
+      pool, sourceFilePath, condMacro,
+      [this, &pool, sourceFilePath, condMacro, outPath, suffix,
+       &buildObjTargets](const bool containsCode) {
+        if (!containsCode) {
+          return;
+        }
+        runMM(
+            pool, sourceFilePath, condMacro,
+            [this, sourceFilePath, condMacro, outPath, suffix,
+             &buildObjTargets](
+                const std::string& objTarget,
+                const std::unordered_set<std::string>& objTargetDeps
+            ) {
+              const fs::path targetBaseDir = fs::relative(
+                  sourceFilePath.parent_path(),
+                  getProjectBasePath() / "src"_path
+              );
+              fs::path condTargetBaseDir = outPath;
+              if (targetBaseDir != ".") {
+                condTargetBaseDir /= targetBaseDir;
+              }
+
+              const std::string condObjTarget = condTargetBaseDir / objTarget;
+              const std::string condTarget =
+                  (condTargetBaseDir / sourceFilePath.filename()).string()
+                  + std::string(suffix);
+
+              std::unordered_set<std::string> condTargetDeps = {
+                condObjTarget, recordLinkCommand(condTarget)
+              };
+              condTargetDeps.insert(memberLibs.begin(), memberLibs.end());
+              collectBinDepObjs(
+                  condTargetDeps, sourceFilePath.stem().string(),
+                  objTargetDeps, buildObjTargets
+              );
+
+              // Object target.
+              defineCompileTarget(
+                  condObjTarget, sourceFilePath, objTargetDeps, condMacro
+              );
+
+              // Binary target.
+              const std::vector<std::string> commands = { linkBinCommand() };
+              defineTarget(condTarget, commands, condTargetDeps);
+            }
+        );
+      }
   );
-
-  // Test binary target.
-  const std::vector<std::string> commands = { LINK_BIN_COMMAND };
-  defineTarget(testTarget, commands, testTargetDeps);
-
-  testTargets.insert(testTarget);
-  if (mtx) {
-    mtx->unlock();
-  }
 }
 
 static std::vector<fs::path>
-listSourceFilePaths(const fs::path& dir) {
+listSourceFilePaths(const fs::path& dir, const fs::path& outDir) {
   std::vector<fs::path> sourceFilePaths;
-  for (const auto& entry : fs::recursive_directory_iterator(dir)) {
-    if (!SOURCE_FILE_EXTS.contains(entry.path().extension())) {
+  const std::vector<WalkEntry> entries =
+      FileWalker(dir)
+          .setSnapshotPath(FileWalker::snapshotPathFor(outDir, dir))
+          .walk();
+  for (const WalkEntry& entry : entries) {
+    if (!SOURCE_FILE_EXTS.contains(entry.path.extension())) {
       continue;
     }
-    sourceFilePaths.emplace_back(entry.path());
+    sourceFilePaths.emplace_back(dir / entry.path);
   }
   return sourceFilePaths;
 }
@@ -865,7 +1219,8 @@ BuildConfig::configureBuild() {
   setAll(all);
   addPhony("all");
 
-  std::vector<fs::path> sourceFilePaths = listSourceFilePaths(srcDir);
+  std::vector<fs::path> sourceFilePaths =
+      listSourceFilePaths(srcDir, outBasePath);
   std::string srcs;
   for (const fs::path& sourceFilePath : sourceFilePaths) {
     if (sourceFilePath != mainSource && isMainSource(sourceFilePath)) {
@@ -889,18 +1244,26 @@ BuildConfig::configureBuild() {
     srcs += ' ' + sourceFilePath.string();
   }
 
-  defineSimpleVar("SRCS", srcs);
+  defineSimpleVar(varPrefix + "SRCS", srcs);
 
   // Source Pass
   const std::unordered_set<std::string> buildObjTargets =
       processSources(sourceFilePaths);
 
   if (hasBinaryTarget) {
-    const std::vector<std::string> commands = { LINK_BIN_COMMAND };
+    const std::vector<std::string> commands = { linkBinCommand() };
     defineOutputTarget(
         buildObjTargets, buildOutPath / "main.o", commands,
         outBasePath / packageName
     );
+    const std::string cmdPath = recordLinkCommand(outBasePath / packageName);
+    for (const std::string& dep : memberLibs) {
+      targets[outBasePath / packageName].remDeps.insert(dep);
+      targetDeps[dep].push_back(outBasePath / packageName);
+    }
+    targets[outBasePath / packageName].remDeps.insert(cmdPath);
+    targetDeps[cmdPath].push_back(outBasePath / packageName);
+    outputs.push_back(outBasePath / packageName);
   }
 
   if (hasLibraryTarget) {
@@ -908,60 +1271,211 @@ BuildConfig::configureBuild() {
     defineOutputTarget(
         buildObjTargets, buildOutPath / "lib.o", commands, outBasePath / libName
     );
+    outputs.push_back(outBasePath / libName);
   }
 
-  // Test Pass
-  std::unordered_set<std::string> testTargets;
-  if (isParallel()) {
-    tbb::spin_mutex mtx;
-    tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, sourceFilePaths.size()),
-        [&](const tbb::blocked_range<size_t>& rng) {
-          for (size_t i = rng.begin(); i != rng.end(); ++i) {
-            processUnittestSrc(
-                sourceFilePaths[i], buildObjTargets, testTargets, &mtx
-            );
-          }
-        }
-    );
-  } else {
+  // Test and Bench Pass
+  {
+    CommandPool pool(getParallelism());
     for (const fs::path& sourceFilePath : sourceFilePaths) {
-      processUnittestSrc(sourceFilePath, buildObjTargets, testTargets);
+      processCondSrc(
+          pool, sourceFilePath, "POAC_TEST", unittestOutPath, ".test",
+          buildObjTargets
+      );
+      processCondSrc(
+          pool, sourceFilePath, "POAC_BENCH", benchOutPath, ".bench",
+          buildObjTargets
+      );
     }
+    pool.wait();
   }
+}
 
-  // Tidy Pass
-  defineCondVar("POAC_TIDY", "clang-tidy");
-  defineSimpleVar("TIDY_TARGETS", "$(patsubst %,tidy_%,$(SRCS))", { "SRCS" });
-  defineTarget("tidy", {}, { "$(TIDY_TARGETS)" });
-  defineTarget(
-      "$(TIDY_TARGETS)",
-      { "$(POAC_TIDY) $(POAC_TIDY_FLAGS) $< -- $(CXXFLAGS) "
-        "$(DEFINES) -DPOAC_TEST $(INCLUDES)" },
-      { "tidy_%: %" }
-  );
-  addPhony("tidy");
-  addPhony("$(TIDY_TARGETS)");
+namespace {
+
+struct WorkspaceMember {
+  fs::path path;
+  std::string name;
+  // Indices of the members this one depends on, which come before it.
+  std::vector<size_t> deps;
+};
+
+}  // namespace
+
+// Orders the workspace members so that each one comes after the members it
+// depends on, keeping the manifest order otherwise.
+static std::vector<WorkspaceMember>
+orderWorkspaceMembers(const bool includeDevDeps) {
+  std::vector<WorkspaceMember> members;
+  std::vector<std::vector<std::string>> depNames;
+  std::unordered_map<std::string, size_t> indexOf;
+  for (const fs::path& path : getWorkspaceMembers()) {
+    const ManifestScope scope(path);
+    const std::string name = getPackageName();
+    if (!indexOf.emplace(name, members.size()).second) {
+      throw PoacError(
+          "workspace members `", members[indexOf.at(name)].path.string(),
+          "` and `", path.string(), "` are both named `", name, '`'
+      );
+    }
+    members.push_back({ .path = path, .name = name, .deps = {} });
+    depNames.push_back(getDependencyNames(includeDevDeps));
+  }
+
+  enum class Mark : uint8_t { None, Visiting, Done };
+  std::vector<Mark> marks(members.size(), Mark::None);
+  std::vector<size_t> order;
+  std::vector<std::string> chain;
+  const std::function<void(size_t)> visit = [&](const size_t i) {
+    if (marks[i] == Mark::Done) {
+      return;
+    }
+    chain.push_back(members[i].name);
+    if (marks[i] == Mark::Visiting) {
+      const auto cycle = std::ranges::find(chain, members[i].name);
+      throw PoacError(fmt::format(
+          "workspace members depend on each other: {}",
+          fmt::join(cycle, chain.end(), " -> ")
+      ));
+    }
+    marks[i] = Mark::Visiting;
+    for (const std::string& depName : depNames[i]) {
+      if (const auto it = indexOf.find(depName); it != indexOf.end()) {
+        visit(it->second);
+      }
+    }
+    marks[i] = Mark::Done;
+    chain.pop_back();
+    order.push_back(i);
+  };
+  for (size_t i = 0; i < members.size(); ++i) {
+    visit(i);
+  }
+
+  std::vector<size_t> position(members.size());
+  for (size_t pos = 0; pos < order.size(); ++pos) {
+    position[order[pos]] = pos;
+  }
+  std::vector<WorkspaceMember> ordered;
+  for (const size_t i : order) {
+    WorkspaceMember& member = ordered.emplace_back(std::move(members[i]));
+    for (const std::string& depName : depNames[i]) {
+      if (const auto it = indexOf.find(depName); it != indexOf.end()) {
+        member.deps.push_back(position[it->second]);
+      }
+    }
+  }
+  return ordered;
 }
 
-BuildConfig
-emitMakefile(const bool isDebug, const bool includeDevDeps) {
+// Configures every workspace member into one build graph sharing the output
+// directory, installed dependencies, and toolchain, so a single make
+// invocation can schedule all of them.  Members depending on other members
+// use their headers and libraries from the same graph.
+static BuildConfig
+emitWorkspaceMakefile(
+    const bool isDebug, const bool includeDevDeps, bool& isFresh
+) {
+  const std::vector<WorkspaceMember> members =
+      orderWorkspaceMembers(includeDevDeps);
+  std::unordered_set<std::string> memberNames;
+  for (const WorkspaceMember& member : members) {
+    memberNames.insert(member.name);
+  }
+  const fs::path rootPath = getProjectBasePath();
+  BuildConfig workspace(rootPath.filename().string(), isDebug);
+
+  // Dependencies must be installed even if the Makefile is up to date.
+  std::vector<BuildConfig> memberConfigs;
+  Hasher fingerprint;
+  for (const WorkspaceMember& member : members) {
+    const ManifestScope scope(member.path);
+    BuildConfig& config = memberConfigs.emplace_back(member.name, isDebug);
+    config.joinWorkspace(workspace.outBasePath);
+    config.installDeps(includeDevDeps, memberNames);
+    for (const size_t dep : member.deps) {
+      config.linkMember(memberConfigs[dep], members[dep].path);
+    }
+    config.writeBuildInfo();
+    fingerprint.updateField(config.getConfigFingerprint());
+  }
+
+  const std::string makefilePath = workspace.outBasePath / "Makefile";
+  std::vector<fs::path> projectBasePaths;
+  for (const WorkspaceMember& member : members) {
+    projectBasePaths.push_back(member.path);
+  }
+  projectBasePaths.push_back(rootPath);
+  if (isUpToDate(makefilePath, projectBasePaths)
+      && isFingerprintUnchanged(makefilePath, fingerprint.hexDigest())) {
+    logger::debug("Makefile is up to date");
+    isFresh = true;
+    return workspace;
+  }
+  logger::debug("Makefile is NOT up to date");
+
+  for (size_t i = 0; i < members.size(); ++i) {
+    const ManifestScope scope(members[i].path);
+    memberConfigs[i].configureBuild();
+    workspace.mergeMember(memberConfigs[i]);
+  }
+
+  workspace.addPhony("all");
+  {
+    std::ofstream ofs(makefilePath);
+    workspace.emitMakefile(ofs);
+  }
+  writeFingerprint(makefilePath, fingerprint.hexDigest());
+  return workspace;
+}
+
+static BuildConfig
+emitPackageMakefile(
+    const bool isDebug, const bool includeDevDeps, bool& isFresh
+) {
   BuildConfig config(getPackageName(), isDebug);
 
   // When emitting Makefile, we also build the project.  So, we need to
   // make sure the dependencies are installed.
   config.installDeps(includeDevDeps);
+  config.writeBuildInfo();
 
   const std::string makefilePath = config.outBasePath / "Makefile";
-  if (isUpToDate(makefilePath)) {
+  const std::string fingerprint = config.getConfigFingerprint();
+  if (isUpToDate(makefilePath, { getProjectBasePath() })
+      && isFingerprintUnchanged(makefilePath, fingerprint)) {
     logger::debug("Makefile is up to date");
+    isFresh = true;
     return config;
   }
   logger::debug("Makefile is NOT up to date");
 
   config.configureBuild();
-  std::ofstream ofs(makefilePath);
-  config.emitMakefile(ofs);
+  {
+    std::ofstream ofs(makefilePath);
+    config.emitMakefile(ofs);
+  }
+  writeFingerprint(makefilePath, fingerprint);
+  return config;
+}
+
+BuildConfig
+emitMakefile(const bool isDebug, const bool includeDevDeps) {
+  emitEvent("configure-started", { { "profile", modeToProfile(isDebug) } });
+  const auto start = std::chrono::steady_clock::now();
+
+  bool isFresh = false;
+  BuildConfig config =
+      getWorkspaceMembers().empty()
+          ? emitPackageMakefile(isDebug, includeDevDeps, isFresh)
+          : emitWorkspaceMakefile(isDebug, includeDevDeps, isFresh);
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  emitEvent(
+      "configure-finished",
+      { { "fresh", isFresh }, { "duration", elapsed.count() } }
+  );
   return config;
 }
 
@@ -972,17 +1486,23 @@ emitCompdb(const bool isDebug, const bool includeDevDeps) {
 
   // compile_commands.json also needs INCLUDES, but not LIBS.
   config.installDeps(includeDevDeps);
+  config.writeBuildInfo();
 
   const std::string compdbPath = config.outBasePath / "compile_commands.json";
-  if (isUpToDate(compdbPath)) {
+  const std::string fingerprint = config.getConfigFingerprint();
+  if (isUpToDate(compdbPath, { getProjectBasePath() })
+      && isFingerprintUnchanged(compdbPath, fingerprint)) {
     logger::debug("compile_commands.json is up to date");
     return config.outBasePath;
   }
   logger::debug("compile_commands.json is NOT up to date");
 
   config.configureBuild();
-  std::ofstream ofs(compdbPath);
-  config.emitCompdb(ofs);
+  {
+    std::ofstream ofs(compdbPath);
+    config.emitCompdb(ofs);
+  }
+  writeFingerprint(compdbPath, fingerprint);
   return config.outBasePath;
 }
 
@@ -1014,6 +1534,108 @@ getMakeCommand() {
   return makeCommand;
 }
 
+static std::string
+normalizeDep(const fs::path& baseDir, const std::string_view dep) {
+  return (baseDir / dep).lexically_normal().string();
+}
+
+MakefileDeps
+parseMakefileDeps(std::istream& is, const fs::path& baseDir) {
+  MakefileDeps deps;
+  std::string line;
+  while (std::getline(is, line)) {
+    // Join continuation lines.
+    while (line.ends_with('\\')) {
+      line.pop_back();
+      std::string next;
+      if (!std::getline(is, next)) {
+        break;
+      }
+      line += ' ' + next;
+    }
+    // Skip recipes, comments, and directives.
+    if (line.empty() || line.front() == '\t' || line.front() == '#'
+        || line.front() == ' ') {
+      continue;
+    }
+
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos
+        || line.find_first_of("=$") < colon) {  // variables
+      continue;
+    }
+    if (colon + 1 < line.size() && line[colon + 1] == '=') {
+      continue;  // :=
+    }
+
+    std::istringstream targetIss(line.substr(0, colon));
+    std::istringstream prereqIss(line.substr(colon + 1));
+    std::vector<std::string> prereqs;
+    std::string prereq;
+    while (prereqIss >> prereq) {
+      if (prereq.find('$') == std::string::npos) {
+        prereqs.push_back(normalizeDep(baseDir, prereq));
+      }
+    }
+    std::string target;
+    while (targetIss >> target) {
+      // .PHONY and the like, and pattern rules
+      if (target.starts_with('.') || target.find('%') != std::string::npos) {
+        continue;
+      }
+      std::vector<std::string>& targetDeps =
+          deps[normalizeDep(baseDir, target)];
+      targetDeps.insert(targetDeps.end(), prereqs.begin(), prereqs.end());
+    }
+  }
+  return deps;
+}
+
+static bool
+dependsOnAny(  // NOLINT(misc-no-recursion)
+    const MakefileDeps& deps, const std::string& target,
+    const std::unordered_set<std::string>& changedFiles,
+    std::unordered_map<std::string, bool>& visited
+) {
+  if (const auto found = visited.find(target); found != visited.end()) {
+    return found->second;
+  }
+  // Assume false while visiting to stop at cycles.
+  visited[target] = false;
+
+  bool affected = changedFiles.contains(target);
+  if (!affected) {
+    if (const auto found = deps.find(target); found != deps.end()) {
+      for (const std::string& dep : found->second) {
+        if (dependsOnAny(deps, dep, changedFiles, visited)) {
+          affected = true;
+          break;
+        }
+      }
+    }
+  }
+  visited[target] = affected;
+  return affected;
+}
+
+std::vector<std::string>
+findAffectedTargets(
+    const MakefileDeps& deps, const std::vector<std::string>& targets,
+    const std::unordered_set<std::string>& changedFiles
+) {
+  std::unordered_map<std::string, bool> visited;
+  std::vector<std::string> affected;
+  for (const std::string& target : targets) {
+    if (dependsOnAny(
+            deps, fs::path(target).lexically_normal().string(), changedFiles,
+            visited
+        )) {
+      affected.push_back(target);
+    }
+  }
+  return affected;
+}
+
 #ifdef POAC_TEST
 
 namespace tests {
@@ -1169,6 +1791,218 @@ testParseEnvFlags() {
   pass();
 }
 
+static void
+testFindAffectedTargets() {
+  std::istringstream makefile(
+      "CXX ?= g++\n"
+      "CXXFLAGS := -std=c++20 \\\n"
+      "  -Wall\n"
+      ".PHONY: all test\n"
+      "all: /out/app\n"
+      "\n"
+      "%.cmd: ;\n"
+      "\n"
+      "/out/app: /out/app.d/main.o /out/app.d/a.o\n"
+      "\t$(CXX) $(CXXFLAGS) $^ -o $@\n"
+      "\n"
+      "/out/app.d/a.o: ../../src/a.cc ../../src/a.hpp \\\n"
+      "  ../../src/b.hpp /out/app.d/a.o.cmd\n"
+      "\t$(CXX) -c $< -o $@\n"
+      "\n"
+      "/out/app.d/main.o: ../../src/main.cc ../../src/a.hpp\n"
+      "/out/unittests/a.test: /out/unittests/a.o /out/app.d/a.o\n"
+      "/out/unittests/main.test: /out/unittests/main.o\n"
+      "/out/unittests/a.o: ../../src/a.cc ../../src/a.hpp ../../src/b.hpp\n"
+      "/out/unittests/main.o: ../../src/main.cc ../../src/a.hpp\n"
+  );
+  const MakefileDeps deps = parseMakefileDeps(makefile, "/proj/poac-out/debug");
+  assertFalse(deps.contains("/proj/poac-out/debug/CXXFLAGS"));
+  assertFalse(deps.contains("/proj/poac-out/debug/.PHONY"));
+  assertFalse(deps.contains("/proj/poac-out/debug/%.cmd"));
+  assertEq(deps.at("/out/app.d/a.o").size(), static_cast<size_t>(4));
+  assertEq(deps.at("/out/app.d/a.o")[2], "/proj/src/b.hpp");
+
+  const std::vector<std::string> tests = { "/out/unittests/a.test",
+                                           "/out/unittests/main.test" };
+  const std::vector<std::string> affectedByB =
+      findAffectedTargets(deps, tests, { "/proj/src/b.hpp" });
+  assertEq(affectedByB.size(), static_cast<size_t>(1));
+  assertEq(affectedByB[0], "/out/unittests/a.test");
+  assertTrue(findAffectedTargets(deps, tests, { "/proj/src/a.hpp" }) == tests);
+  assertTrue(findAffectedTargets(deps, tests, { "/proj/README.md" }).empty());
+
+  pass();
+}
+
+static void
+testWriteIfChanged() {
+  const TempDir tmpDir("poac-write-if-changed");
+  const fs::path& dir = tmpDir.path();
+  const fs::path header = dir / "gen" / "poac" / "build_info.hpp";
+  const auto old = fs::file_time_type::clock::now() - std::chrono::hours(1);
+
+  writeIfChanged(header, "#pragma once\n");
+  fs::last_write_time(header, old);
+  writeIfChanged(header, "#pragma once\n");
+  assertTrue(fs::last_write_time(header) == old);
+
+  writeIfChanged(header, "#pragma once\n#define A\n");
+  assertTrue(fs::last_write_time(header) > old);
+  std::ifstream ifs(header);
+  assertEq(
+      std::string(
+          std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()
+      ),
+      "#pragma once\n#define A\n"
+  );
+
+  pass();
+}
+
+static void
+testCommandChangeRebuilds() {
+  const TempDir tmpDir("poac-record-command");
+  const fs::path& dir = tmpDir.path();
+  const std::string aObj = (dir / "a.o").string();
+  const std::string bObj = (dir / "b.o").string();
+  const fs::path log = dir / "log";
+
+  // Runs make, and returns the objects it rebuilt.
+  const auto make = [&]() {
+    fs::remove(log);
+    const CommandOutput output = Command("make")
+                                     .addArg("-C")
+                                     .addArg(dir.string())
+                                     .addArg(aObj)
+                                     .addArg(bObj)
+                                     .setStdoutConfig(Command::IOConfig::Null)
+                                     .output();
+    assertEq(output.exitCode, EXIT_SUCCESS);
+
+    // Pretend the build happened long ago, so that only a rewrite of a .cmd
+    // file can make an object out of date.
+    const auto now = fs::file_time_type::clock::now();
+    for (const std::string& obj : { aObj, bObj }) {
+      if (fs::exists(obj + ".cmd")) {
+        fs::last_write_time(obj + ".cmd", now - std::chrono::hours(2));
+      }
+      fs::last_write_time(obj, now - std::chrono::hours(1));
+    }
+
+    std::vector<std::string> rebuilt;
+    std::ifstream ifs(log);
+    for (std::string line; std::getline(ifs, line);) {
+      rebuilt.push_back(line);
+    }
+    std::ranges::sort(rebuilt);
+    return rebuilt;
+  };
+  const auto configure = [&](const std::string& aFlags,
+                             const std::string& bFlags) {
+    BuildConfig config("test");
+    for (const auto& [obj, flags] :
+         { std::pair{ aObj, aFlags }, std::pair{ bObj, bFlags } }) {
+      config.defineTarget(
+          obj, { "@touch $@", "@echo $@ >> " + log.string() },
+          { recordCommand(obj, "c++ " + flags) }
+      );
+    }
+    std::ofstream ofs(dir / "Makefile");
+    config.emitMakefile(ofs);
+  };
+
+  configure("-O0", "-O0");
+  assertTrue(make() == std::vector{ aObj, bObj });
+  configure("-O0", "-O0");
+  assertTrue(make().empty());
+  configure("-O0", "-O2");
+  assertTrue(make() == std::vector{ bObj });
+
+  // A missing .cmd file rebuilds its target instead of stopping make.
+  fs::remove(aObj + ".cmd");
+  assertTrue(make() == std::vector{ aObj });
+
+  pass();
+}
+
+static void
+testWorkspaceMemberDeps() {
+  const TempDir tmpDir("poac-workspace-deps");
+  const fs::path& root = tmpDir.path();
+  const auto writeFile = [&root](const fs::path& path,
+                                 const std::string& content) {
+    fs::create_directories((root / path).parent_path());
+    std::ofstream(root / path) << content;
+  };
+  const auto manifest = [](const std::string& name, const std::string& deps) {
+    return "[package]\nname = \"" + name
+           + "\"\nedition = \"20\"\nversion = \"0.1.0\"\n\n"
+           + "[dependencies]\n" + deps;
+  };
+
+  // `app` depends on `greet`, which is listed after it.  The Git source is
+  // used only when `app` is built on its own, so it is never fetched here.
+  writeFile(
+      "ws/poac.toml", "[workspace]\nmembers = [\"app\", \"greet\"]\n"
+  );
+  writeFile(
+      "ws/app/poac.toml",
+      manifest("app", "greet = { git = \"https://example.invalid/greet\" }\n")
+  );
+  writeFile(
+      "ws/app/src/main.cc",
+      "#include <greet/greet.hpp>\nint main() { return greet() == 42 ? 0 : 1; "
+      "}\n"
+  );
+  writeFile("ws/greet/poac.toml", manifest("greet", ""));
+  writeFile("ws/greet/include/greet/greet.hpp", "int greet();\n");
+  writeFile(
+      "ws/greet/src/lib.cc",
+      "#include <greet/greet.hpp>\nint greet() { return 42; }\n"
+  );
+
+  {
+    const ManifestScope scope(root / "ws");
+    const BuildConfig config = emitMakefile(/*isDebug=*/true, false);
+    const fs::path app = config.outBasePath / "app";
+    const std::string libGreet = config.outBasePath / "libgreet.a";
+
+    std::ifstream ifs(config.outBasePath / "Makefile");
+    const MakefileDeps deps = parseMakefileDeps(ifs, config.outBasePath);
+    assertTrue(std::ranges::count(deps.at(app.string()), libGreet) == 1);
+
+    const CommandOutput make = Command("make")
+                                   .addArg("-C")
+                                   .addArg(config.outBasePath.string())
+                                   .setStdoutConfig(Command::IOConfig::Null)
+                                   .output();
+    assertEq(make.exitCode, EXIT_SUCCESS);
+    assertTrue(fs::exists(libGreet));
+    assertEq(Command(app.string()).output().exitCode, EXIT_SUCCESS);
+  }
+
+  writeFile(
+      "cycle/poac.toml", "[workspace]\nmembers = [\"foo\", \"bar\"]\n"
+  );
+  writeFile(
+      "cycle/foo/poac.toml",
+      manifest("foo", "bar = { git = \"https://example.invalid/bar\" }\n")
+  );
+  writeFile(
+      "cycle/bar/poac.toml",
+      manifest("bar", "foo = { git = \"https://example.invalid/foo\" }\n")
+  );
+  {
+    const ManifestScope scope(root / "cycle");
+    assertException<PoacError>(
+        []() { emitMakefile(/*isDebug=*/true, false); },
+        "workspace members depend on each other: foo -> bar -> foo"
+    );
+  }
+
+  pass();
+}
+
 }  // namespace tests
 
 int
@@ -1180,5 +2014,9 @@ main() {
   tests::testSimpleTargets();
   tests::testDependOnUnregisteredTarget();
   tests::testParseEnvFlags();
+  tests::testFindAffectedTargets();
+  tests::testWriteIfChanged();
+  tests::testCommandChangeRebuilds();
+  tests::testWorkspaceMemberDeps();
 }
 #endif
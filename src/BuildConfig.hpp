@@ -1,14 +1,16 @@
 #pragma once
 
 #include "Command.hpp"
+#include "CommandPool.hpp"
 #include "Exception.hpp"
 #include "Rustify.hpp"
 
 #include <cstdint>
+#include <functional>
+#include <istream>
 #include <optional>
 #include <string>
 #include <string_view>
-#include <tbb/spin_mutex.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -22,8 +24,6 @@ inline const std::unordered_set<std::string> HEADER_FILE_EXTS{
 };
 // clang-format on
 
-inline const std::string LINK_BIN_COMMAND =
-    "$(CXX) $(CXXFLAGS) $^ $(LIBS) -o $@";
 inline const std::string ARCHIVE_LIB_COMMAND = "ar rcs $@ $^";
 
 enum class VarType : uint8_t {
@@ -39,6 +39,8 @@ struct Variable {
   VarType type = VarType::Simple;
 };
 
+struct Profile;
+
 struct Target {
   std::vector<std::string> commands;
   std::optional<std::string> sourceFile;
@@ -54,8 +56,22 @@ private:
   std::string libName;
   fs::path buildOutPath;
   fs::path unittestOutPath;
+  fs::path benchOutPath;
   bool isDebug;
 
+  // Prefix of the per-package variables (CXXFLAGS, DEFINES, ...).  Empty
+  // unless this package is configured as a workspace member, where packages
+  // share one Makefile.
+  std::string varPrefix;
+  // Binaries and libraries this config builds.
+  std::vector<std::string> outputs;
+  // Libraries of the workspace members this package depends on, built in
+  // the same graph; see linkMember.
+  std::vector<std::string> memberLibs;
+  // The profile of the package depending on this one, if this config builds
+  // a Git dependency; see buildDepLib.
+  const Profile* consumerProfile = nullptr;
+
   // if we are building an binary
   bool hasBinaryTarget{ false };
   // if we are building a hasLibraryTarget
@@ -87,6 +103,19 @@ public:
     return this->libName;
   }
 
+  // Reference to a per-package variable, e.g., $(CXXFLAGS).
+  std::string varRef(std::string_view name) const {
+    return "$(" + varPrefix + std::string(name) + ')';
+  }
+  // Command fingerprints (*.cmd) are prerequisites but not inputs.  So are
+  // the libraries of workspace members, which LIBS lists in link order.
+  std::string linkBinCommand() const {
+    return "$(CXX) " + varRef("CXXFLAGS") + " $(filter-out %.cmd %.a,$^) "
+           + varRef("LIBS") + " -o $@";
+  }
+  // Records the expanded link command of `target`; see defineCompileTarget.
+  std::string recordLinkCommand(const std::string& target) const;
+
   void defineVar(
       const std::string& name, const Variable& value,
       const std::unordered_set<std::string>& dependsOn = {}
@@ -145,24 +174,51 @@ public:
   void emitVariable(std::ostream& os, const std::string& varName) const;
   void emitMakefile(std::ostream& os) const;
   void emitCompdb(std::ostream& os) const;
-  std::string runMM(const std::string& sourceFile, bool isTest = false) const;
-  bool containsTestCode(const std::string& sourceFile) const;
+  // Runs `-MM` on `sourceFile` in `pool`, with `condMacro` defined unless
+  // empty, and passes the object target and its prerequisites to `onDeps`.
+  void runMM(
+      CommandPool& pool, const std::string& sourceFile,
+      std::string_view condMacro,
+      std::function<void(std::string, std::unordered_set<std::string>)> onDeps
+  ) const;
+  // Passes whether `sourceFile` has code enabled by `condMacro`, e.g.,
+  // POAC_TEST, to `onResult`.
+  void containsCondCode(
+      CommandPool& pool, const std::string& sourceFile,
+      std::string_view condMacro, std::function<void(bool)> onResult
+  ) const;
+
+  // Identifies the inputs of the build not tracked by make or by the
+  // Makefile's own prerequisites: the toolchain, environment flags, and
+  // dependencies.  Call after installDeps.
+  std::string getConfigFingerprint() const;
+  // Writes <poac/build_info.hpp> with the commit metadata of the package.
+  // Only the sources including it are rebuilt when the commit changes.
+  void writeBuildInfo() const;
 
-  void installDeps(bool includeDevDeps);
+  // The profile of the package, or of the package depending on it.
+  const Profile& getProfile() const;
+
+  // Dependencies named in `memberNames` are workspace members; they are not
+  // installed but linked with linkMember.
+  void installDeps(
+      bool includeDevDeps,
+      const std::unordered_set<std::string>& memberNames = {}
+  );
   void addDefine(std::string_view name, std::string_view value);
   void setVariables();
 
   void processSrc(
-      const fs::path& sourceFilePath,
-      std::unordered_set<std::string>& buildObjTargets,
-      tbb::spin_mutex* mtx = nullptr
+      CommandPool& pool, const fs::path& sourceFilePath,
+      std::unordered_set<std::string>& buildObjTargets
   );
   std::unordered_set<std::string>
   processSources(const std::vector<fs::path>& sourceFilePaths);
 
   void defineCompileTarget(
       const std::string& objTarget, const std::string& sourceFile,
-      const std::unordered_set<std::string>& remDeps, bool isTest = false
+      const std::unordered_set<std::string>& remDeps,
+      std::string_view condMacro = ""
   );
 
   void defineOutputTarget(
@@ -178,18 +234,54 @@ public:
       const std::unordered_set<std::string>& buildObjTargets
   ) const;
 
-  void processUnittestSrc(
-      const fs::path& sourceFilePath,
-      const std::unordered_set<std::string>& buildObjTargets,
-      std::unordered_set<std::string>& testTargets,
-      tbb::spin_mutex* mtx = nullptr
+  // Defines `<outPath>/<source><suffix>`, a binary of the code enabled by
+  // `condMacro` in `sourceFilePath`, e.g., a unit test for POAC_TEST.
+  void processCondSrc(
+      CommandPool& pool, const fs::path& sourceFilePath,
+      std::string_view condMacro, const fs::path& outPath,
+      std::string_view suffix,
+      const std::unordered_set<std::string>& buildObjTargets
   );
 
   void configureBuild();
+
+  // Builds into `outBasePath` instead of the package's poac-out directory.
+  void setOutBasePath(const fs::path& outBasePath);
+  // Places this package in the combined build graph of a workspace whose
+  // output directory is `workspaceOutBasePath`.  Must be called before
+  // installDeps and configureBuild.
+  void joinWorkspace(const fs::path& workspaceOutBasePath);
+  // Makes this workspace member use `member`, another member in `memberDir`
+  // that it depends on: its headers, and its library if it has one, along
+  // with those of its own dependencies.  Call after both have called
+  // installDeps, and before configureBuild.
+  void linkMember(const BuildConfig& member, const fs::path& memberDir);
+  // Builds the library of the Git dependency in `packageDir` with this
+  // package's toolchain and profile, and returns the flags to link it.  The
+  // library is cached under getCacheDir() and shared across projects and
+  // poac processes.
+  std::string buildDepLib(const fs::path& packageDir) const;
+  // Merges the configured build graph of a workspace member into this one.
+  void mergeMember(const BuildConfig& member);
 };
 
+// Splits flags, e.g., of CXXFLAGS or a command in compile_commands.json, by
+// spaces, interpreting quotes and backslashes like the shell.
+std::vector<std::string> parseEnvFlags(std::string_view env);
+
 BuildConfig emitMakefile(bool isDebug, bool includeDevDeps);
 std::string emitCompdb(bool isDebug, bool includeDevDeps);
 std::string_view modeToString(bool isDebug);
 std::string_view modeToProfile(bool isDebug);
 Command getMakeCommand();
+
+// Prerequisites of each target in a Makefile, with paths resolved against
+// `baseDir` and normalized.
+using MakefileDeps = std::unordered_map<std::string, std::vector<std::string>>;
+MakefileDeps parseMakefileDeps(std::istream& is, const fs::path& baseDir);
+// Returns the `targets` whose transitive prerequisites include any of
+// `changedFiles`, given as normalized absolute paths.
+std::vector<std::string> findAffectedTargets(
+    const MakefileDeps& deps, const std::vector<std::string>& targets,
+    const std::unordered_set<std::string>& changedFiles
+);
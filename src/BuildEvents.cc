@@ -0,0 +1,269 @@
+#include "BuildEvents.hpp"
+
+#include "Algos.hpp"
+#include "Command.hpp"
+#include "Exception.hpp"
+#include "Logger.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+static MessageFormat messageFormat = MessageFormat::Human;
+static std::mutex eventMtx;
+
+std::optional<MessageFormat>
+parseMessageFormat(const std::string_view str) noexcept {
+  if (str == "human") {
+    return MessageFormat::Human;
+  } else if (str == "json") {
+    return MessageFormat::Json;
+  }
+  return std::nullopt;
+}
+
+void
+setMessageFormat(const MessageFormat format) noexcept {
+  messageFormat = format;
+}
+
+bool
+isJsonMessageFormat() noexcept {
+  return messageFormat == MessageFormat::Json;
+}
+
+void
+emitEvent(const std::string_view event, nlohmann::json fields) {
+  if (!isJsonMessageFormat()) {
+    return;
+  }
+  fields["event"] = event;
+
+  // Dependencies are installed in parallel, so events may come from several
+  // threads; keep lines whole.
+  const std::string line = fields.dump(
+      /*indent=*/-1, /*indent_char=*/' ', /*ensure_ascii=*/false,
+      nlohmann::json::error_handler_t::replace
+  );
+  const std::lock_guard lock(eventMtx);
+  std::cout << line << std::endl;
+}
+
+static std::string
+stripEscapeSequences(const std::string_view str) {
+  std::string res;
+  res.reserve(str.size());
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] == '\x1b' && i + 1 < str.size() && str[i + 1] == '[') {
+      // Skip CSI sequences such as `\x1b[01;31m`.
+      i += 2;
+      while (i < str.size() && !(str[i] >= '@' && str[i] <= '~')) {
+        ++i;
+      }
+      continue;
+    }
+    res += str[i];
+  }
+  return res;
+}
+
+static std::optional<size_t>
+parseNumber(const std::string_view str) noexcept {
+  size_t num{};
+  const auto [ptr, ec] = std::from_chars(str.begin(), str.end(), num);
+  if (ec != std::errc() || ptr != str.end()) {
+    return std::nullopt;
+  }
+  return num;
+}
+
+static std::optional<Diagnostic>
+parseDiagnostic(const std::string_view line) {
+  static constexpr std::string_view levels[] = {
+    "fatal error", "error", "warning", "note"
+  };
+  for (const std::string_view level : levels) {
+    const std::string marker = fmt::format(": {}: ", level);
+    const size_t levelPos = line.find(marker);
+    if (levelPos == std::string_view::npos) {
+      continue;
+    }
+
+    // `location` is either `file:line:col` or `file:line`.
+    std::string_view location = line.substr(0, levelPos);
+    Diagnostic diag;
+    size_t sep = location.rfind(':');
+    if (sep == std::string_view::npos) {
+      continue;
+    }
+    std::optional<size_t> last = parseNumber(location.substr(sep + 1));
+    if (!last.has_value()) {
+      continue;
+    }
+    location = location.substr(0, sep);
+    sep = location.rfind(':');
+    const std::optional<size_t> lineNum = sep == std::string_view::npos
+                                              ? std::nullopt
+                                              : parseNumber(location.substr(
+                                                    sep + 1
+                                                ));
+    if (lineNum.has_value()) {
+      diag.line = lineNum.value();
+      diag.column = last.value();
+      location = location.substr(0, sep);
+    } else {
+      diag.line = last.value();
+    }
+    if (location.empty()) {
+      continue;
+    }
+
+    diag.file = location;
+    diag.level = level;
+    diag.message = line.substr(levelPos + marker.size());
+    return diag;
+  }
+  return std::nullopt;
+}
+
+std::vector<Diagnostic>
+parseDiagnostics(const std::string_view output) {
+  const std::string stripped = stripEscapeSequences(output);
+  std::vector<Diagnostic> diags;
+  std::string_view rest = stripped;
+  while (!rest.empty()) {
+    const size_t eol = rest.find('\n');
+    const std::string_view line = rest.substr(0, eol);
+    if (auto diag = parseDiagnostic(line)) {
+      diags.push_back(std::move(diag.value()));
+    }
+    if (eol == std::string_view::npos) {
+      break;
+    }
+    rest.remove_prefix(eol + 1);
+  }
+  return diags;
+}
+
+int
+execTargetCmd(const Command& cmd, const std::string_view target) {
+  if (!isJsonMessageFormat()) {
+    return execCmd(cmd);
+  }
+
+  emitEvent("target-started", { { "target", target } });
+  const auto start = std::chrono::steady_clock::now();
+
+  // Forward the output as it comes, reporting diagnostics line by line.
+  const auto onLine = [target](const std::string_view line) {
+    std::cerr << line << '\n' << std::flush;
+    for (const Diagnostic& diag : parseDiagnostics(line)) {
+      emitEvent(
+          "compiler-message", { { "target", target },
+                                { "file", diag.file },
+                                { "line", diag.line },
+                                { "column", diag.column },
+                                { "level", diag.level },
+                                { "message", diag.message } }
+      );
+    }
+  };
+  LineSink stdoutSink(onLine);
+  LineSink stderrSink(onLine);
+
+  logger::debug("Running `{}`", cmd.toString());
+  int exitCode = EXIT_COMMAND_NOT_FOUND;
+  try {
+    exitCode = cmd.output(stdoutSink, stderrSink);
+  } catch (const PoacError& e) {
+    logger::error("{}", e.what());
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  emitEvent(
+      "target-finished", { { "target", target },
+                           { "duration", elapsed.count() },
+                           { "exit_code", exitCode },
+                           { "success", exitCode == EXIT_SUCCESS } }
+  );
+  return exitCode;
+}
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+static void
+testParseMessageFormat() {
+  assertTrue(parseMessageFormat("human") == MessageFormat::Human);
+  assertTrue(parseMessageFormat("json") == MessageFormat::Json);
+  assertFalse(parseMessageFormat("JSON").has_value());
+  assertFalse(parseMessageFormat("").has_value());
+
+  pass();
+}
+
+static void
+testParseDiagnostics() {
+  const std::vector<Diagnostic> diags = parseDiagnostics(
+      "In file included from src/main.cc:1:\n"
+      "src/Foo.hpp:3:10: error: 'bar' was not declared in this scope\n"
+      "    3 |   return bar;\n"
+      "      |          ^~~\n"
+      "src/main.cc:12: warning: unused variable 'x'\n"
+      "make: *** [Makefile:10: main.o] Error 1"
+  );
+  assertEq(diags.size(), 2UL);
+
+  assertEq(diags[0].file, "src/Foo.hpp");
+  assertEq(diags[0].line, 3UL);
+  assertEq(diags[0].column, 10UL);
+  assertEq(diags[0].level, "error");
+  assertEq(diags[0].message, "'bar' was not declared in this scope");
+
+  assertEq(diags[1].file, "src/main.cc");
+  assertEq(diags[1].line, 12UL);
+  assertEq(diags[1].column, 0UL);
+  assertEq(diags[1].level, "warning");
+
+  pass();
+}
+
+static void
+testParseDiagnosticsColored() {
+  const std::vector<Diagnostic> diags = parseDiagnostics(
+      "\x1b[01m\x1b[Ksrc/a.cc:1:2:\x1b[m\x1b[K \x1b[01;31m\x1b[Kfatal "
+      "error: \x1b[m\x1b[Kfoo.hpp: No such file or directory\n"
+  );
+  assertEq(diags.size(), 1UL);
+  assertEq(diags[0].file, "src/a.cc");
+  assertEq(diags[0].line, 1UL);
+  assertEq(diags[0].column, 2UL);
+  assertEq(diags[0].level, "fatal error");
+  assertEq(diags[0].message, "foo.hpp: No such file or directory");
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testParseMessageFormat();
+  tests::testParseDiagnostics();
+  tests::testParseDiagnosticsColored();
+}
+
+#endif
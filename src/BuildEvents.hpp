@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Command.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Machine-readable events for `--message-format=json`.  Each event is written
+// to stdout as a single JSON object per line with an "event" field naming it;
+// human-readable logs and tool output keep going to stderr.
+
+enum class MessageFormat : uint8_t {
+  Human,
+  Json,
+};
+
+std::optional<MessageFormat> parseMessageFormat(std::string_view str) noexcept;
+void setMessageFormat(MessageFormat format) noexcept;
+bool isJsonMessageFormat() noexcept;
+
+// Writes an event if the message format is JSON; otherwise does nothing.
+void emitEvent(
+    std::string_view event, nlohmann::json fields = nlohmann::json::object()
+);
+
+struct Diagnostic {
+  std::string file;
+  size_t line = 0;
+  size_t column = 0;  // 0 if the compiler did not report a column.
+  std::string level;  // "error", "warning", "note", or "fatal error"
+  std::string message;
+};
+
+// Extracts GCC/Clang-style `file:line:col: level: message` lines from
+// compiler output.  Color escape sequences are ignored.
+std::vector<Diagnostic> parseDiagnostics(std::string_view output);
+
+// Runs `cmd`, which builds `target`.  With the JSON message format, this
+// reports the start and finish of the target and its compiler diagnostics,
+// forwarding the output of `cmd` to stderr; otherwise this is execCmd.
+int execTargetCmd(const Command& cmd, std::string_view target);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Cmd/Add.hpp"
+#include "Cmd/Bench.hpp"
 #include "Cmd/Build.hpp"
 #include "Cmd/Clean.hpp"
 #include "Cmd/Fmt.hpp"
@@ -0,0 +1,135 @@
+#include "Bench.hpp"
+
+#include "../Algos.hpp"
+#include "../BuildConfig.hpp"
+#include "../Cli.hpp"
+#include "../Logger.hpp"
+#include "../Manifest.hpp"
+#include "../Parallelism.hpp"
+#include "Common.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static int benchMain(std::span<const std::string_view> args);
+
+const Subcmd BENCH_CMD =  //
+    Subcmd{ "bench" }
+        .setDesc("Run the benchmarks of a local package")
+        .addOpt(OPT_JOBS)
+        .setMainFn(benchMain);
+
+static int
+benchMain(const std::span<const std::string_view> args) {
+  // Parse args
+  for (auto itr = args.begin(); itr != args.end(); ++itr) {
+    if (const auto res = Cli::handleGlobalOpts(itr, args.end(), "bench")) {
+      if (res.value() == Cli::CONTINUE) {
+        continue;
+      } else {
+        return res.value();
+      }
+    } else if (*itr == "-j" || *itr == "--jobs") {
+      if (itr + 1 == args.end()) {
+        return Subcmd::missingArgumentForOpt(*itr);
+      }
+      ++itr;
+
+      uint64_t numThreads{};
+      auto [ptr, ec] =
+          std::from_chars(itr->data(), itr->data() + itr->size(), numThreads);
+      if (ec == std::errc()) {
+        setParallelism(numThreads);
+      } else {
+        logger::error("invalid number of threads: ", *itr);
+        return EXIT_FAILURE;
+      }
+    } else {
+      return BENCH_CMD.noSuchArg(*itr);
+    }
+  }
+
+  rejectWorkspaceRoot("bench");
+  const auto start = std::chrono::steady_clock::now();
+
+  // Benchmarks are meaningful only with optimizations.
+  const bool isDebug = false;
+  const BuildConfig config = emitMakefile(isDebug, /*includeDevDeps=*/true);
+
+  // Collect bench targets from the generated Makefile.
+  const std::string benchTargetPrefix =
+      (config.outBasePath / "benchmarks").string() + '/';
+  std::vector<std::string> benchTargets;
+  std::ifstream infile(config.outBasePath / "Makefile");
+  std::string line;
+  while (std::getline(infile, line)) {
+    if (!line.starts_with(benchTargetPrefix)) {
+      continue;
+    }
+    line = line.substr(0, line.find(':'));
+    if (!line.ends_with(".bench")) {
+      continue;
+    }
+    benchTargets.push_back(line);
+  }
+
+  if (benchTargets.empty()) {
+    logger::warn("No bench targets found");
+    return EXIT_SUCCESS;
+  }
+
+  // Build all of them with one make invocation so that make schedules jobs
+  // across them.
+  Command makeCmd =
+      getMakeCommand().addArg("-C").addArg(config.outBasePath.string());
+  makeCmd.addArgs(benchTargets);
+  Command checkUpToDateCmd = makeCmd;
+  checkUpToDateCmd.addArg("--question");
+  if (execCmd(checkUpToDateCmd) != EXIT_SUCCESS) {
+    logger::info(
+        "Compiling", "{} v{} ({})", getPackageName(),
+        getPackageVersion().toString(), getProjectBasePath().string()
+    );
+    const int exitCode = execCmd(makeCmd);
+    if (exitCode != EXIT_SUCCESS) {
+      // Compilation failed; don't proceed to run benchmarks.
+      return exitCode;
+    }
+  }
+
+  // Run benchmarks one at a time not to disturb each other's timings.
+  int exitCode{};
+  for (const std::string& target : benchTargets) {
+    // `target` always starts with "benchmarks/" and ends with ".bench".
+    std::string sourcePath = target;
+    sourcePath.replace(0, benchTargetPrefix.size(), "src/");
+    sourcePath.resize(sourcePath.size() - ".bench"sv.size());
+
+    const std::string benchBinPath =
+        fs::relative(target, getProjectBasePath()).string();
+    logger::info("Running", "benches {} ({})", sourcePath, benchBinPath);
+
+    const int curExitCode = execCmd(Command(target));
+    if (curExitCode != EXIT_SUCCESS) {
+      exitCode = curExitCode;
+    }
+  }
+
+  const auto end = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> elapsed = end - start;
+
+  if (exitCode == EXIT_SUCCESS) {
+    logger::info(
+        "Finished", "{} benchmark(s) in {:.2f}s", benchTargets.size(),
+        elapsed.count()
+    );
+  }
+  return exitCode;
+}
@@ -2,6 +2,7 @@
 
 #include "../Algos.hpp"
 #include "../BuildConfig.hpp"
+#include "../BuildEvents.hpp"
 #include "../Logger.hpp"
 #include "../Manifest.hpp"
 #include "../Parallelism.hpp"
@@ -30,6 +31,7 @@ const Subcmd BUILD_CMD =
             "Generate compilation database instead of building"
         ))
         .addOpt(OPT_JOBS)
+        .addOpt(OPT_MESSAGE_FORMAT)
         .setMainFn(buildMain);
 
 int
@@ -50,7 +52,31 @@ runBuildCommand(
         "Compiling", "{} v{} ({})", targetName, getPackageVersion().toString(),
         getProjectBasePath().string()
     );
-    exitCode = execCmd(makeCmd);
+    exitCode = execTargetCmd(makeCmd, targetName);
+  } else {
+    emitEvent("cache-hit", { { "kind", "target" }, { "name", targetName } });
+  }
+  return exitCode;
+}
+
+// Builds all the workspace members with a single make invocation so that
+// make schedules jobs across members.
+static int
+runWorkspaceBuildCommand(const std::string& outDir) {
+  const Command makeCmd =
+      getMakeCommand().addArg("-C").addArg(outDir).addArg("all");
+  Command checkUpToDateCmd = makeCmd;
+  checkUpToDateCmd.addArg("--question");
+
+  int exitCode = execCmd(checkUpToDateCmd);
+  if (exitCode != EXIT_SUCCESS) {
+    logger::info(
+        "Compiling", "{} workspace member(s) ({})",
+        getWorkspaceMembers().size(), getProjectBasePath().string()
+    );
+    exitCode = execTargetCmd(makeCmd, "all");
+  } else {
+    emitEvent("cache-hit", { { "kind", "target" }, { "name", "all" } });
   }
   return exitCode;
 }
@@ -62,19 +88,27 @@ buildImpl(std::string& outDir, const bool isDebug) {
   const BuildConfig config = emitMakefile(isDebug, /*includeDevDeps=*/false);
   outDir = config.outBasePath;
 
-  const std::string& packageName = getPackageName();
   int exitCode = 0;
-  if (config.hasBinTarget()) {
-    exitCode = runBuildCommand(outDir, config, packageName);
-  }
+  if (!getWorkspaceMembers().empty()) {
+    exitCode = runWorkspaceBuildCommand(outDir);
+  } else {
+    if (config.hasBinTarget()) {
+      exitCode = runBuildCommand(outDir, config, getPackageName());
+    }
 
-  if (config.hasLibTarget() && exitCode == 0) {
-    const std::string& libName = config.getLibName();
-    exitCode = runBuildCommand(outDir, config, libName);
+    if (config.hasLibTarget() && exitCode == 0) {
+      const std::string& libName = config.getLibName();
+      exitCode = runBuildCommand(outDir, config, libName);
+    }
   }
 
   const auto end = std::chrono::steady_clock::now();
   const std::chrono::duration<double> elapsed = end - start;
+  emitEvent(
+      "build-finished", { { "profile", modeToProfile(isDebug) },
+                          { "duration", elapsed.count() },
+                          { "success", exitCode == EXIT_SUCCESS } }
+  );
 
   if (exitCode == EXIT_SUCCESS) {
     const Profile& profile = isDebug ? getDevProfile() : getReleaseProfile();
@@ -115,6 +149,14 @@ buildMain(const std::span<const std::string_view> args) {
       isDebug = false;
     } else if (*itr == "--compdb") {
       buildCompdb = true;
+    } else if (*itr == "--message-format") {
+      if (itr + 1 == args.end()) {
+        return Subcmd::missingArgumentForOpt(*itr);
+      }
+      ++itr;
+      if (const auto res = handleMessageFormat(*itr)) {
+        return res.value();
+      }
     } else if (*itr == "-j" || *itr == "--jobs") {
       if (itr + 1 == args.end()) {
         return Subcmd::missingArgumentForOpt(*itr);
@@ -141,6 +183,7 @@ buildMain(const std::span<const std::string_view> args) {
   }
 
   // Build compilation database
+  rejectWorkspaceRoot("build --compdb");
   const std::string outDir = emitCompdb(isDebug, /*includeDevDeps=*/false);
   logger::info("Generated", "{}/compile_commands.json", outDir);
   return EXIT_SUCCESS;
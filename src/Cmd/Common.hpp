@@ -1,8 +1,28 @@
 #pragma once
 
+#include "../Algos.hpp"
+#include "../BuildEvents.hpp"
 #include "../Cli.hpp"
+#include "../Git2.hpp"
+#include "../Hash.hpp"
+#include "../Logger.hpp"
+#include "../Manifest.hpp"
 #include "../Parallelism.hpp"
 
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 inline constinit const Opt OPT_DEBUG = Opt{ "--debug" }.setShort("-d").setDesc(
     "Build with debug information [default]"
 );
@@ -21,3 +41,179 @@ inline const Opt OPT_JOBS =
         .setDesc("Set the number of jobs to run in parallel")
         .setPlaceholder("<NUM>")
         .setDefault(NUM_DEFAULT_THREADS);
+
+inline constinit const Opt OPT_MESSAGE_FORMAT =
+    Opt{ "--message-format" }
+        .setDesc("Output format of messages: human or json (events on stdout)")
+        .setPlaceholder("<FMT>")
+        .setDefault("human");
+
+// Handles the value of `--message-format`.  Returns an exit code on error.
+inline std::optional<int>
+handleMessageFormat(const std::string_view value) {
+  if (const auto format = parseMessageFormat(value)) {
+    setMessageFormat(format.value());
+    return std::nullopt;
+  }
+  logger::error("invalid message format: {}", value);
+  return EXIT_FAILURE;
+}
+
+inline constinit const Opt OPT_CHANGED =
+    Opt{ "--changed" }
+        .setDesc("Only process files changed since a ref")
+        .setPlaceholder("[<REF>]")
+        .setDefault("HEAD");
+
+// Handles `--changed`, whose ref is optional: the next argument is taken as
+// the ref unless it is another option.  Returns the ref.
+inline std::string
+handleChanged(
+    std::forward_iterator auto& itr, const std::forward_iterator auto end
+) {
+  if (itr + 1 != end && !(itr + 1)->starts_with('-')) {
+    return std::string(*++itr);
+  }
+  return "HEAD";
+}
+
+// Returns the files that differ between `ref` and the working tree,
+// including untracked ones, as normalized paths under the project base path.
+inline std::unordered_set<std::string>
+getChangedFiles(const std::string& ref) {
+  git2::Repository repo;
+  repo.discover(getProjectBasePath().string());
+  const git2::Object obj = repo.revparseSingle(ref);
+  git2::Tree tree;
+  tree.peel(obj);
+  git2::DiffOptions opts;
+  opts.includeUntracked(true);
+  git2::Diff diff;
+  diff.treeToWorkdirWithIndex(repo, tree, opts);
+
+  // libgit2 may resolve symlinks in the working directory path, while paths
+  // elsewhere, e.g., in the Makefile, are under the project base path as is.
+  const fs::path workdir = fs::weakly_canonical(repo.workdir());
+  const fs::path projectBasePath = getProjectBasePath();
+  const fs::path canonicalBasePath = fs::weakly_canonical(projectBasePath);
+  std::unordered_set<std::string> changedFiles;
+  for (const std::string& path : diff.paths()) {
+    const fs::path relPath =
+        (workdir / path).lexically_relative(canonicalBasePath);
+    changedFiles.insert((projectBasePath / relPath).lexically_normal().string()
+    );
+  }
+  return changedFiles;
+}
+
+// Hashes the config files a tool reads for the files in a directory: in
+// each directory up to the root, the first existing file of `names`.  With
+// `nearestOnly`, only the nearest one counts, like clang-format's
+// --style=file; otherwise those of the parents are chained in as well.
+class ConfigHasher {
+  std::vector<std::string> names;
+  bool nearestOnly;
+  std::unordered_map<std::string, std::string> hashes;
+
+public:
+  ConfigHasher(
+      const std::initializer_list<std::string_view> names,
+      const bool nearestOnly
+  )
+      : names(names.begin(), names.end()), nearestOnly(nearestOnly) {}
+
+  // NOLINTNEXTLINE(misc-no-recursion)
+  const std::string& hash(const fs::path& dir) {
+    if (const auto found = hashes.find(dir.string()); found != hashes.end()) {
+      return found->second;
+    }
+
+    Hasher hasher;
+    bool hasConfig = false;
+    for (const std::string& name : names) {
+      if (std::ifstream ifs(dir / name, std::ios::binary); ifs) {
+        std::ostringstream content;
+        content << ifs.rdbuf();
+        hasher.updateField(name).updateField(content.str());
+        hasConfig = true;
+        break;
+      }
+    }
+    if ((!hasConfig || !nearestOnly) && dir.has_parent_path()
+        && dir.parent_path() != dir) {
+      hasher.updateField(hash(dir.parent_path()));
+    }
+    return hashes[dir.string()] = hasher.hexDigest();
+  }
+};
+
+// Results of a tool recorded by a hash of everything they depend on, so that
+// the tool only runs again on inputs that changed.  The cache is a JSON
+// object from the keys to the results; a broken file or entry is a miss.
+class ResultCache {
+  fs::path cachePath;
+  std::string_view name;
+  nlohmann::json cache = nlohmann::json::object();
+  nlohmann::json used = nlohmann::json::object();
+  bool isBroken = false;
+
+public:
+  ResultCache(fs::path cachePath, const std::string_view name)
+      : cachePath(std::move(cachePath)), name(name) {
+    std::ifstream ifs(this->cachePath);
+    if (!ifs) {
+      return;
+    }
+    try {
+      cache = nlohmann::json::parse(ifs);
+    } catch (const nlohmann::json::exception& e) {
+      logger::debug("ignoring broken {} cache: {}", name, e.what());
+      isBroken = true;
+    }
+    if (!cache.is_object()) {
+      cache = nlohmann::json::object();
+      isBroken = true;
+    }
+  }
+
+  template <typename T>
+  std::optional<T> get(const std::string& key) {
+    const auto found = cache.find(key);
+    if (found == cache.end()) {
+      return std::nullopt;
+    }
+    try {
+      T result = found->get<T>();
+      used[key] = *found;
+      return result;
+    } catch (const nlohmann::json::exception& e) {
+      logger::debug("ignoring broken {} cache entry: {}", name, e.what());
+      return std::nullopt;
+    }
+  }
+  void insert(const std::string& key, nlohmann::json result) {
+    used[key] = std::move(result);
+  }
+
+  // Keeps the entries used by this run, and the others too if only some of
+  // the inputs were processed.  Nothing is written if nothing changed.
+  void save(const bool keepUnused) {
+    if (keepUnused) {
+      // Without overwriting the entries that replaced broken ones.
+      for (const auto& [key, result] : cache.items()) {
+        if (!used.contains(key)) {
+          used[key] = result;
+        }
+      }
+    }
+    if (used == cache && !isBroken) {
+      return;  // Unchanged
+    }
+    try {
+      fs::create_directories(cachePath.parent_path());
+      writeFileAtomically(cachePath, used.dump());
+    } catch (const fs::filesystem_error& e) {
+      logger::debug("failed to save {} cache: {}", name, e.what());
+    }
+  }
+};
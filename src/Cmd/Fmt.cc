@@ -3,19 +3,27 @@
 #include "../Algos.hpp"
 #include "../BuildConfig.hpp"
 #include "../Cli.hpp"
-#include "../Git2/Exception.hpp"
-#include "../Git2/Repository.hpp"
+#include "../CommandPool.hpp"
+#include "../FileWalker.hpp"
+#include "../Hash.hpp"
 #include "../Logger.hpp"
 #include "../Manifest.hpp"
+#include "../Parallelism.hpp"
 #include "../Rustify.hpp"
+#include "../Toolchain.hpp"
+#include "Common.hpp"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdlib>
 #include <fstream>
-#include <ranges>
+#include <iostream>
+#include <optional>
 #include <span>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -28,64 +36,76 @@ const Subcmd FMT_CMD =
         .addOpt(Opt{ "--exclude" }
                     .setDesc("Exclude files from formatting")
                     .setPlaceholder("<FILE>"))
+        .addOpt(OPT_CHANGED)
         .setMainFn(fmtMain);
 
 static void
 collectFormatTargetFiles(
     const fs::path& manifestDir, const std::vector<fs::path>& excludes,
-    std::vector<std::string>& clangFormatArgs
+    std::vector<std::string>& targetFiles
 ) {
-  // Read git repository if exists
-  git2::Repository repo = git2::Repository();
-  bool hasGitRepo = false;
-  try {
-    repo.open(manifestDir.string());
-    hasGitRepo = true;
-  } catch (const git2::Exception& e) {
-    logger::debug("No git repository found");
+  FileWalker walker(manifestDir);
+  walker.respectGitignore().setSnapshotPath(
+      FileWalker::snapshotPathFor(manifestDir / "poac-out", manifestDir)
+  );
+  for (const fs::path& exclude : excludes) {
+    walker.exclude(fs::relative(exclude, manifestDir).generic_string());
   }
 
-  const auto isExcluded = [&](std::string_view path) -> bool {
-    return std::ranges::find_if(
-               excludes,
-               [&](const fs::path& path2) {
-                 return fs::relative(path2, manifestDir).string() == path;
-               }
-           )
-           != excludes.end();
-  };
-
   // Automatically collects format-target files
-  for (auto entry = fs::recursive_directory_iterator(manifestDir);
-       entry != fs::recursive_directory_iterator(); ++entry) {
-    if (entry->is_directory()) {
-      const std::string path =
-          fs::relative(entry->path(), manifestDir).string();
-      if ((hasGitRepo && repo.isIgnored(path)) || isExcluded(path)) {
-        logger::debug("Ignore: ", path);
-        entry.disable_recursion_pending();
-        continue;
-      }
-    } else if (entry->is_regular_file()) {
-      const fs::path path = fs::relative(entry->path(), manifestDir);
-      if ((hasGitRepo && repo.isIgnored(path.string()))
-          || isExcluded(path.string())) {
-        logger::debug("Ignore: ", path.string());
-        continue;
-      }
-
-      const std::string ext = path.extension().string();
-      if (SOURCE_FILE_EXTS.contains(ext) || HEADER_FILE_EXTS.contains(ext)) {
-        clangFormatArgs.push_back(path.string());
-      }
+  for (const WalkEntry& entry : walker.walk()) {
+    const std::string ext = entry.path.extension().string();
+    if (SOURCE_FILE_EXTS.contains(ext) || HEADER_FILE_EXTS.contains(ext)) {
+      targetFiles.push_back(entry.path.string());
     }
   }
 }
 
+// Files verified to be formatted are recorded by a hash of their content and
+// of everything else clang-format's output depends on, so unchanged files are
+// skipped without spawning clang-format.
+class FmtCache : public ResultCache {
+  std::string fmtStamp;
+  // --style=file uses the nearest .clang-format or _clang-format up the tree.
+  ConfigHasher styleHasher{ { ".clang-format", "_clang-format" },
+                            /*nearestOnly=*/true };
+
+public:
+  FmtCache(fs::path cachePath, const std::string_view poacFmt)
+      : ResultCache(std::move(cachePath), "fmt") {
+    if (const auto tool = findTool(poacFmt)) {
+      fmtStamp = tool->stamp;
+    }
+  }
+
+  // Returns the key of `file`, or an empty string if it cannot be read.
+  std::string key(const fs::path& file) {
+    std::ifstream ifs(file, std::ios::binary);
+    if (!ifs) {
+      return "";
+    }
+    std::ostringstream content;
+    content << ifs.rdbuf();
+    return Hasher()
+        .updateField(fmtStamp)
+        .updateField(styleHasher.hash(file.parent_path()))
+        .updateField(content.str())
+        .hexDigest();
+  }
+
+  bool isFormatted(const std::string& key) {
+    return get<bool>(key).value_or(false);
+  }
+  void setFormatted(const std::string& key) {
+    insert(key, true);
+  }
+};
+
 static int
 fmtMain(const std::span<const std::string_view> args) {
   std::vector<fs::path> excludes;
   bool isCheck = false;
+  std::optional<std::string> changedSince;
   // Parse args
   for (auto itr = args.begin(); itr != args.end(); ++itr) {
     if (const auto res = Cli::handleGlobalOpts(itr, args.end(), "fmt")) {
@@ -102,12 +122,14 @@ fmtMain(const std::span<const std::string_view> args) {
       }
 
       excludes.emplace_back(*++itr);
+    } else if (*itr == "--changed") {
+      changedSince = handleChanged(itr, args.end());
     } else {
       return FMT_CMD.noSuchArg(*itr);
     }
   }
 
-  if (!commandExists("clang-format")) {
+  if (!findTool("clang-format")) {
     logger::error(
         "fmt command requires clang-format; try installing it by:\n"
         "  apt/brew install clang-format"
@@ -132,15 +154,75 @@ fmtMain(const std::span<const std::string_view> args) {
   }
 
   const fs::path projectPath = getProjectBasePath();
-  collectFormatTargetFiles(projectPath, excludes, clangFormatArgs);
+  std::vector<std::string> targetFiles;
+  collectFormatTargetFiles(projectPath, excludes, targetFiles);
+  if (changedSince.has_value()) {
+    const std::unordered_set<std::string> changedFiles =
+        getChangedFiles(changedSince.value());
+    std::erase_if(targetFiles, [&](const std::string& file) {
+      return !changedFiles.contains((projectPath / file).string());
+    });
+  }
 
   const char* poacFmt = std::getenv("POAC_FMT");
   if (poacFmt == nullptr) {
     poacFmt = "clang-format";
   }
 
-  const Command clangFormat = Command(poacFmt, std::move(clangFormatArgs))
-                                  .setWorkingDirectory(projectPath.string());
+  FmtCache cache(projectPath / "poac-out" / ".fmt-cache.json", poacFmt);
+  std::vector<std::string> files;
+  for (std::string& file : targetFiles) {
+    const std::string key = cache.key(projectPath / file);
+    if (!key.empty() && cache.isFormatted(key)) {
+      logger::debug("Skip formatted: {}", file);
+      continue;
+    }
+    files.push_back(std::move(file));
+  }
+  logger::debug(
+      "{} of {} file(s) need clang-format", files.size(), targetFiles.size()
+  );
+  const bool keepUnused = changedSince.has_value();
+  if (files.empty()) {
+    cache.save(keepUnused);
+    return EXIT_SUCCESS;
+  }
+
+  // clang-format handles one file at a time, so split the files into a shard
+  // per job.
+  const size_t numShards = std::min(getParallelism(), files.size());
+  const size_t shardSize = (files.size() + numShards - 1) / numShards;
+  int exitCode = EXIT_SUCCESS;
+  CommandPool pool(numShards);
+  for (size_t begin = 0; begin < files.size(); begin += shardSize) {
+    const std::span<const std::string> shard(
+        files.begin() + static_cast<std::ptrdiff_t>(begin),
+        std::min(shardSize, files.size() - begin)
+    );
+    Command clangFormat = Command(poacFmt, clangFormatArgs)
+                              .addArgs(std::vector(shard.begin(), shard.end()))
+                              .setWorkingDirectory(projectPath.string());
+    pool.submit(
+        std::move(clangFormat),
+        [&, shard](const CommandPool::Result& result, CommandOutput&& output) {
+          std::cout << output.stdout << std::flush;
+          std::cerr << output.stderr << std::flush;
+          if (result.exitCode != EXIT_SUCCESS) {
+            exitCode = result.exitCode;
+            return;
+          }
+          // Files are now formatted, if they were not.
+          for (const std::string& file : shard) {
+            const std::string key = cache.key(projectPath / file);
+            if (!key.empty()) {
+              cache.setFormatted(key);
+            }
+          }
+        }
+    );
+  }
+  pool.wait();
 
-  return execCmd(clangFormat);
+  cache.save(keepUnused);
+  return exitCode;
 }
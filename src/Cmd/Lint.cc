@@ -1,56 +1,233 @@
 #include "Lint.hpp"
 
 #include "../Algos.hpp"
+#include "../BuildConfig.hpp"
 #include "../Cli.hpp"
+#include "../CommandPool.hpp"
+#include "../FileWalker.hpp"
+#include "../Hash.hpp"
 #include "../Logger.hpp"
 #include "../Manifest.hpp"
+#include "../Parallelism.hpp"
 #include "../Rustify.hpp"
+#include "../Toolchain.hpp"
+#include "Common.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdlib>
 #include <fstream>
+#include <iostream>
+#include <optional>
 #include <span>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 static int lintMain(std::span<const std::string_view> args);
 
-const Subcmd LINT_CMD = Subcmd{ "lint" }
-                            .setDesc("Lint codes using cpplint")
-                            .addOpt(Opt{ "--exclude" }
-                                        .setDesc("Exclude files from linting")
-                                        .setPlaceholder("<FILE>"))
-                            .setMainFn(lintMain);
+const Subcmd LINT_CMD =
+    Subcmd{ "lint" }
+        .setDesc("Lint codes using cpplint")
+        .addOpt(Opt{ "--exclude" }
+                    .setDesc("Exclude files from linting")
+                    .setPlaceholder("<FILE>"))
+        .addOpt(OPT_CHANGED)
+        .setMainFn(lintMain);
 
 struct LintArgs {
   std::vector<std::string> excludes;
+  std::optional<std::string> changedSince;
+};
+
+// Diagnostics of files are recorded by a hash of their content, path, and
+// everything else cpplint's output depends on, so that unchanged files are
+// not linted again.
+class LintCache : public ResultCache {
+  std::string baseKey;
+  // cpplint reads CPPLINT.cfg in the directory of a file and its parents.
+  ConfigHasher cfgHasher{ { "CPPLINT.cfg" }, /*nearestOnly=*/false };
+
+public:
+  LintCache(fs::path cachePath, const std::vector<std::string>& cpplintArgs)
+      : ResultCache(std::move(cachePath), "lint") {
+    Hasher hasher;
+    if (const auto tool = findTool("cpplint")) {
+      hasher.updateField(tool->stamp);
+    }
+    for (const std::string& arg : cpplintArgs) {
+      hasher.updateField(arg);
+    }
+    baseKey = hasher.hexDigest();
+  }
+
+  // Returns the key of `file`, or an empty string if it cannot be read.
+  std::string key(const fs::path& file) {
+    std::ifstream ifs(file, std::ios::binary);
+    if (!ifs) {
+      return "";
+    }
+    std::ostringstream content;
+    content << ifs.rdbuf();
+    return Hasher()
+        .updateField(baseKey)
+        .updateField(cfgHasher.hash(fs::absolute(file).parent_path()))
+        .updateField(file.generic_string())
+        .updateField(content.str())
+        .hexDigest();
+  }
 };
 
 static int
-lint(const std::string_view name, const std::vector<std::string>& cpplintArgs) {
+lint(
+    const std::string_view name, const std::vector<std::string>& cpplintArgs,
+    const LintArgs& lintArgs
+) {
   logger::info("Linting", "{}", name);
 
-  Command cpplintCmd("cpplint", cpplintArgs);
-  if (!isVerbose()) {
-    cpplintCmd.addArg("--quiet");
+  // Pass the files ourselves rather than letting cpplint recurse, so that
+  // the tree is walked in parallel and .gitignore is honored in full.
+  FileWalker walker(".");
+  walker.respectGitignore().setSnapshotPath(
+      FileWalker::snapshotPathFor("poac-out", ".")
+  );
+  for (const std::string& exclude : lintArgs.excludes) {
+    walker.exclude(exclude);
+  }
+  std::optional<std::unordered_set<std::string>> changedFiles;
+  if (lintArgs.changedSince.has_value()) {
+    changedFiles = getChangedFiles(lintArgs.changedSince.value());
+  }
+  std::vector<std::string> files;
+  for (const WalkEntry& entry : walker.walk()) {
+    const std::string ext = entry.path.extension().string();
+    if (!SOURCE_FILE_EXTS.contains(ext) && !HEADER_FILE_EXTS.contains(ext)) {
+      continue;
+    }
+    if (changedFiles.has_value()
+        && !changedFiles->contains(
+            fs::absolute(entry.path).lexically_normal().string()
+        )) {
+      continue;
+    }
+    files.push_back(entry.path.string());
   }
 
-  // Read .gitignore if exists
-  if (fs::exists(".gitignore")) {
-    std::ifstream ifs(".gitignore");
-    std::string line;
-    while (std::getline(ifs, line)) {
-      if (line.empty() || line[0] == '#') {
-        continue;
+  LintCache cache(fs::path("poac-out") / ".lint-cache.json", cpplintArgs);
+  // Diagnostics of each file, in the order of `files`.
+  std::vector<std::optional<std::vector<std::string>>> diags(files.size());
+  std::vector<std::string> keys(files.size());
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < files.size(); ++i) {
+    keys[i] = cache.key(files[i]);
+    if (!keys[i].empty()) {
+      diags[i] = cache.get<std::vector<std::string>>(keys[i]);
+    }
+    if (!diags[i].has_value()) {
+      pending.push_back(i);
+    }
+  }
+  logger::debug("{} of {} file(s) need cpplint", pending.size(), files.size());
+
+  // cpplint is single-threaded, so split the files into a shard per job.
+  int exitCode = EXIT_SUCCESS;
+  if (!pending.empty()) {
+    const size_t numShards = std::min(getParallelism(), pending.size());
+    const size_t shardSize = (pending.size() + numShards - 1) / numShards;
+    CommandPool pool(numShards);
+    for (size_t begin = 0; begin < pending.size(); begin += shardSize) {
+      const std::vector<size_t> shard(
+          pending.begin() + static_cast<std::ptrdiff_t>(begin),
+          pending.begin()
+              + static_cast<std::ptrdiff_t>(
+                  std::min(begin + shardSize, pending.size())
+              )
+      );
+      Command cpplintCmd("cpplint", cpplintArgs);
+      if (!isVerbose()) {
+        cpplintCmd.addArg("--quiet");
       }
+      for (const size_t i : shard) {
+        cpplintCmd.addArg(files[i]);
+      }
+      logger::debug("Running `{}`", cpplintCmd.toString());
+
+      pool.submit(
+          std::move(cpplintCmd),
+          [&, shard](
+              const CommandPool::Result& result, CommandOutput&& output
+          ) {
+            std::cout << output.stdout << std::flush;
+
+            // Errors are reported as `<file>:<line>:  <message>` on stderr.
+            std::vector<std::vector<std::string>> shardDiags(shard.size());
+            size_t numErrors = 0;
+            std::istringstream iss(output.stderr);
+            std::string line;
+            while (std::getline(iss, line)) {
+              if (line.starts_with("Total errors found:")) {
+                continue;
+              }
+              bool isError = false;
+              for (size_t j = 0; j < shard.size(); ++j) {
+                const std::string& file = files[shard[j]];
+                if (line.starts_with(file) && line.size() > file.size()
+                    && line[file.size()] == ':') {
+                  shardDiags[j].push_back(line);
+                  isError = true;
+                  ++numErrors;
+                  break;
+                }
+              }
+              if (!isError) {
+                std::cerr << line << '\n';
+              }
+            }
 
-      cpplintCmd.addArg("--exclude=" + line);
+            // cpplint exits with 1 on lint errors, but also on fatal ones.
+            if (result.exitCode != EXIT_SUCCESS
+                && (result.exitCode != EXIT_FAILURE || numErrors == 0)) {
+              exitCode = result.exitCode;
+              return;
+            }
+            for (size_t j = 0; j < shard.size(); ++j) {
+              const size_t i = shard[j];
+              if (!keys[i].empty()) {
+                cache.insert(keys[i], shardDiags[j]);
+              }
+              diags[i] = std::move(shardDiags[j]);
+            }
+          }
+      );
     }
+    pool.wait();
+  }
+  cache.save(/*keepUnused=*/changedFiles.has_value());
+  if (exitCode != EXIT_SUCCESS) {
+    logger::error("`cpplint` exited with status {}", exitCode);
+    return exitCode;
+  }
+
+  // Merge the reports of the shards and the cache.
+  size_t numErrors = 0;
+  for (const auto& fileDiags : diags) {
+    if (!fileDiags.has_value()) {
+      continue;
+    }
+    for (const std::string& diag : fileDiags.value()) {
+      std::cerr << diag << '\n';
+      ++numErrors;
+    }
+  }
+  std::cerr << std::flush;
+  if (numErrors > 0) {
+    std::cerr << "Total errors found: " << numErrors << '\n';
+    return EXIT_FAILURE;
   }
-  // NOTE: This should come after the `--exclude` options.
-  cpplintCmd.addArg("--recursive");
-  cpplintCmd.addArg(".");
-  return execCmd(cpplintCmd);
+  return EXIT_SUCCESS;
 }
 
 static int
@@ -68,13 +245,15 @@ lintMain(const std::span<const std::string_view> args) {
         return Subcmd::missingArgumentForOpt(*itr);
       }
 
-      lintArgs.excludes.push_back("--exclude=" + std::string(*++itr));
+      lintArgs.excludes.emplace_back(*++itr);
+    } else if (*itr == "--changed") {
+      lintArgs.changedSince = handleChanged(itr, args.end());
     } else {
       return LINT_CMD.noSuchArg(*itr);
     }
   }
 
-  if (!commandExists("cpplint")) {
+  if (!findTool("cpplint")) {
     logger::error(
         "lint command requires cpplint; try installing it by:\n"
         "  pip install cpplint"
@@ -82,11 +261,11 @@ lintMain(const std::span<const std::string_view> args) {
     return EXIT_FAILURE;
   }
 
-  std::vector<std::string> cpplintArgs = lintArgs.excludes;
+  std::vector<std::string> cpplintArgs;
   const std::string_view packageName = getPackageName();
   if (fs::exists("CPPLINT.cfg")) {
     logger::debug("Using CPPLINT.cfg for lint ...");
-    return lint(packageName, cpplintArgs);
+    return lint(packageName, cpplintArgs, lintArgs);
   }
 
   if (fs::exists("include")) {
@@ -106,13 +285,13 @@ lintMain(const std::span<const std::string_view> args) {
     // Remove last comma
     filterArg.pop_back();
     cpplintArgs.push_back(filterArg);
-    return lint(packageName, cpplintArgs);
+    return lint(packageName, cpplintArgs, lintArgs);
   } else {
     logger::debug("Using default arguments for lint ...");
     if (Edition::Cpp11 < getPackageEdition()) {
       // Disable C++11-related lints
       cpplintArgs.emplace_back("--filter=-build/c++11");
     }
-    return lint(packageName, cpplintArgs);
+    return lint(packageName, cpplintArgs, lintArgs);
   }
 }
@@ -74,6 +74,7 @@ runMain(const std::span<const std::string_view> args) {
     runArgs.emplace_back(*itr);
   }
 
+  rejectWorkspaceRoot("run");
   std::string outDir;
   if (buildImpl(outDir, isDebug) != EXIT_SUCCESS) {
     return EXIT_FAILURE;
@@ -1,17 +1,25 @@
 #include "Search.hpp"
 
 #include "../Cli.hpp"
+#include "../Exception.hpp"
+#include "../Http.hpp"
 #include "../Logger.hpp"
+#include "../Manifest.hpp"
+#include "../RegistryIndex.hpp"
+#include "../Rustify.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdlib>
-#include <curl/curl.h>
 #include <iomanip>
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <span>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <vector>
 
 static int searchMain(std::span<const std::string_view> args);
 
@@ -26,6 +34,9 @@ const Subcmd SEARCH_CMD =
                     .setDesc("Page number of results to show")
                     .setPlaceholder("<NUM>")
                     .setDefault("1"))
+        .addOpt(Opt{ "--offline" }.setDesc(
+            "Search the local registry index without updating it"
+        ))
         .setArg(Arg{ "name" })
         .setMainFn(searchMain);
 
@@ -33,49 +44,81 @@ struct SearchArgs {
   std::string name;
   size_t perPage = 10;
   size_t page = 1;
+  bool offline = false;
 };
 
-static size_t
-writeCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
-  userp->append(static_cast<char*>(contents), size * nmemb);
-  return size * nmemb;
+// The index is synced again once it is as old as the registry caches
+// search results.
+static constexpr auto INDEX_TTL = std::chrono::minutes(10);
+
+static std::string
+getRegistryUrl() {
+  // Can point to a local stand-in of the registry, e.g., for testing.
+  if (const char* url = std::getenv("POAC_REGISTRY_URL")) {
+    return url;
+  }
+  return "https://poac.hasura.app/v1/graphql";
 }
 
 static nlohmann::json
-searchPackages(const SearchArgs& args) {
-  nlohmann::json req;
-  req["query"] =
-#include "../GraphQL/SearchPackages.gql"
-      ;
-  req["variables"]["name"] = "%" + args.name + "%";
-  req["variables"]["limit"] = args.perPage;
-  req["variables"]["offset"] = (args.page - 1) * args.perPage;
-
-  const std::string reqStr = req.dump();
-  std::string resStr;
-
-  CURL* curl = curl_easy_init();
-  if (!curl) {
-    logger::error("curl_easy_init() failed");
-    return EXIT_FAILURE;
+postGraphQL(http::Client& client, const nlohmann::json& req) {
+  const std::string url = getRegistryUrl();
+  const http::Response res = client.send({
+      .url = url,
+      .body = req.dump(),
+      .headers = { "Content-Type: application/json" },
+  });
+  if (!res.error.empty()) {
+    throw PoacError("failed to reach ", url, ": ", res.error);
   }
+  if (!res.ok()) {
+    throw PoacError(url, " responded with status ", res.status);
+  }
+  try {
+    return nlohmann::json::parse(res.body);
+  } catch (const nlohmann::json::exception& e) {
+    throw PoacError("invalid response from ", url, ": ", e.what());
+  }
+}
 
-  curl_easy_setopt(curl, CURLOPT_URL, "https://poac.hasura.app/v1/graphql");
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resStr);
-  curl_easy_setopt(curl, CURLOPT_POST, 1L);
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, reqStr.c_str());
-  curl_easy_perform(curl);  // TODO: Handle CURLCode
+static bool
+isFresh(const fs::path& indexPath) {
+  std::error_code ec;
+  const fs::file_time_type mtime = fs::last_write_time(indexPath, ec);
+  return !ec && fs::file_time_type::clock::now() - mtime < INDEX_TTL;
+}
 
-  curl_easy_cleanup(curl);
+static RegistryIndex
+loadRegistryIndex(const bool offline) {
+  const fs::path indexPath = getCacheDir() / "registry-index";
+  RegistryIndex index = RegistryIndex::load(indexPath);
+  if (offline || (!index.empty() && isFresh(indexPath))) {
+    return index;
+  }
 
-  const nlohmann::json res = nlohmann::json::parse(resStr);
-  const nlohmann::json packages = res["data"]["packages"];
-  return packages;
+  logger::info("Updating", "registry index");
+  try {
+    // Pages of the sync share the connection.
+    http::Client client;
+    const size_t numReceived =
+        syncRegistryIndex(index, [&](const nlohmann::json& req) {
+          return postGraphQL(client, req);
+        });
+    logger::debug("received {} package(s) from the registry", numReceived);
+  } catch (const PoacError& e) {
+    if (index.empty()) {
+      throw;
+    }
+    logger::warn("{}; using the local registry index", e.what());
+    return index;
+  }
+  // Saving also renews the mtime for the TTL when nothing was received.
+  index.save(indexPath);
+  return index;
 }
 
 static void
-printTable(const nlohmann::json& packages) {
+printTable(const std::span<const IndexedPackage* const> packages) {
   constexpr int tableWidth = 80;
   constexpr int nameWidth = 30;
   constexpr int verWidth = 10;
@@ -83,13 +126,10 @@ printTable(const nlohmann::json& packages) {
   std::cout << std::left << std::setw(nameWidth) << "Name"
             << std::setw(verWidth) << "Version" << "Description" << '\n';
   std::cout << std::string(tableWidth, '-') << '\n';
-  for (const auto& package : packages) {
-    const std::string name = package["name"];
-    const std::string version = package["version"];
-    const std::string description = package["description"];
-
-    std::cout << std::left << std::setw(nameWidth) << name
-              << std::setw(verWidth) << version << description << '\n';
+  for (const IndexedPackage* package : packages) {
+    std::cout << std::left << std::setw(nameWidth) << package->name
+              << std::setw(verWidth) << package->version
+              << package->description << '\n';
   }
 }
 
@@ -117,6 +157,8 @@ searchMain(const std::span<const std::string_view> args) {
         logger::error("missing argument for `--page`");
         return EXIT_FAILURE;
       }
+    } else if (*itr == "--offline") {
+      searchArgs.offline = true;
     } else if (searchArgs.name.empty()) {
       searchArgs.name = *itr;
     } else {
@@ -129,12 +171,17 @@ searchMain(const std::span<const std::string_view> args) {
     return EXIT_FAILURE;
   }
 
-  const nlohmann::json packages = searchPackages(searchArgs);
-  if (packages.empty()) {
+  const RegistryIndex index = loadRegistryIndex(searchArgs.offline);
+  const std::vector<const IndexedPackage*> packages =
+      index.search(searchArgs.name);
+  const size_t begin = (searchArgs.page - 1) * searchArgs.perPage;
+  if (begin >= packages.size()) {
     logger::warn("no packages found");
     return EXIT_SUCCESS;
   }
 
-  printTable(packages);
+  printTable(std::span(packages).subspan(
+      begin, std::min(searchArgs.perPage, packages.size() - begin)
+  ));
   return EXIT_SUCCESS;
 }
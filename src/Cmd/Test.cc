@@ -2,7 +2,9 @@
 
 #include "../Algos.hpp"
 #include "../BuildConfig.hpp"
+#include "../BuildEvents.hpp"
 #include "../Cli.hpp"
+#include "../CommandPool.hpp"
 #include "../Logger.hpp"
 #include "../Manifest.hpp"
 #include "../Parallelism.hpp"
@@ -10,13 +12,18 @@
 
 #include <charconv>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <fmt/core.h>
 #include <fstream>
+#include <iostream>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 static int testMain(std::span<const std::string_view> args);
@@ -28,12 +35,15 @@ const Subcmd TEST_CMD =  //
         .addOpt(OPT_DEBUG)
         .addOpt(OPT_RELEASE)
         .addOpt(OPT_JOBS)
+        .addOpt(OPT_MESSAGE_FORMAT)
+        .addOpt(OPT_CHANGED)
         .setMainFn(testMain);
 
 static int
 testMain(const std::span<const std::string_view> args) {
   // Parse args
   bool isDebug = true;
+  std::optional<std::string> changedSince;
   for (auto itr = args.begin(); itr != args.end(); ++itr) {
     if (const auto res = Cli::handleGlobalOpts(itr, args.end(), "test")) {
       if (res.value() == Cli::CONTINUE) {
@@ -64,11 +74,22 @@ testMain(const std::span<const std::string_view> args) {
         logger::error("invalid number of threads: ", *itr);
         return EXIT_FAILURE;
       }
+    } else if (*itr == "--message-format") {
+      if (itr + 1 == args.end()) {
+        return Subcmd::missingArgumentForOpt(*itr);
+      }
+      ++itr;
+      if (const auto res = handleMessageFormat(*itr)) {
+        return res.value();
+      }
+    } else if (*itr == "--changed") {
+      changedSince = handleChanged(itr, args.end());
     } else {
       return TEST_CMD.noSuchArg(*itr);
     }
   }
 
+  rejectWorkspaceRoot("test");
   const auto start = std::chrono::steady_clock::now();
 
   const BuildConfig config = emitMakefile(isDebug, /*includeDevDeps=*/true);
@@ -95,19 +116,57 @@ testMain(const std::span<const std::string_view> args) {
     return EXIT_SUCCESS;
   }
 
+  if (changedSince.has_value()) {
+    const std::unordered_set<std::string> changedFiles =
+        getChangedFiles(changedSince.value());
+    // Changes to the manifest may affect every target, e.g., via flags.
+    if (changedFiles.contains((getProjectBasePath() / "poac.toml").string())) {
+      logger::debug("poac.toml has changed; running all tests");
+    } else {
+      infile.clear();
+      infile.seekg(0);
+      const MakefileDeps deps = parseMakefileDeps(infile, config.outBasePath);
+      std::vector<std::string> affected =
+          findAffectedTargets(deps, unittestTargets, changedFiles);
+      logger::info(
+          "Selected", "{} of {} test(s) affected by changes since {}",
+          affected.size(), unittestTargets.size(), changedSince.value()
+      );
+      if (affected.empty()) {
+        return EXIT_SUCCESS;
+      }
+      unittestTargets = std::move(affected);
+    }
+  }
+
   const std::string& packageName = getPackageName();
   const Command baseMakeCmd =
       getMakeCommand().addArg("-C").addArg(config.outBasePath.string());
 
-  // Find not up-to-date test targets, emit compilation status once, and
-  // compile them.
+  // Find not up-to-date test targets.  The checks only read the tree, so
+  // they run concurrently.
+  std::vector<char> isUpToDate(unittestTargets.size());
+  {
+    CommandPool pool(getParallelism());
+    for (size_t i = 0; i < unittestTargets.size(); ++i) {
+      Command checkUpToDateCmd = baseMakeCmd;
+      checkUpToDateCmd.addArg("--question").addArg(unittestTargets[i]);
+      pool.submit(
+          checkUpToDateCmd,
+          [&isUpToDate, i](const CommandPool::Result& result, CommandOutput&&) {
+            isUpToDate[i] = result.exitCode == EXIT_SUCCESS;
+          }
+      );
+    }
+    pool.wait();
+  }
+
+  // Emit compilation status once, and compile them.
   int exitCode{};
   bool alreadyEmitted = false;
-  for (const std::string& target : unittestTargets) {
-    Command checkUpToDateCmd = baseMakeCmd;
-    checkUpToDateCmd.addArg("--question").addArg(target);
-    if (execCmd(checkUpToDateCmd) != EXIT_SUCCESS) {
-      // This test target is not up-to-date.
+  for (size_t i = 0; i < unittestTargets.size(); ++i) {
+    const std::string& target = unittestTargets[i];
+    if (!isUpToDate[i]) {
       if (!alreadyEmitted) {
         logger::info(
             "Compiling", "{} v{} ({})", packageName,
@@ -118,10 +177,12 @@ testMain(const std::span<const std::string_view> args) {
 
       Command testCmd = baseMakeCmd;
       testCmd.addArg(target);
-      const int curExitCode = execCmd(testCmd);
+      const int curExitCode = execTargetCmd(testCmd, target);
       if (curExitCode != EXIT_SUCCESS) {
         exitCode = curExitCode;
       }
+    } else {
+      emitEvent("cache-hit", { { "kind", "target" }, { "name", target } });
     }
   }
   if (exitCode != EXIT_SUCCESS) {
@@ -129,7 +190,15 @@ testMain(const std::span<const std::string_view> args) {
     return exitCode;
   }
 
-  // Run tests.
+  // Run tests concurrently, reporting them in order as they complete so that
+  // the output of each test stays together.
+  struct TestRun {
+    std::string sourcePath;
+    std::string testBinPath;
+    std::optional<CommandOutput> output;
+    double duration = 0.0;
+  };
+  std::vector<TestRun> runs;
   for (const std::string& target : unittestTargets) {
     // `target` always starts with "unittests/" and ends with ".test".
     // We need to replace "unittests/" with "src/" and remove ".test" to get
@@ -138,18 +207,68 @@ testMain(const std::span<const std::string_view> args) {
     sourcePath.replace(0, unittestTargetPrefix.size(), "src/");
     sourcePath.resize(sourcePath.size() - ".test"sv.size());
 
-    const std::string testBinPath =
-        fs::relative(target, getProjectBasePath()).string();
-    logger::info("Running", "unittests {} ({})", sourcePath, testBinPath);
+    runs.push_back({ .sourcePath = std::move(sourcePath),
+                     .testBinPath =
+                         fs::relative(target, getProjectBasePath()).string(),
+                     .output = std::nullopt });
+  }
+
+  size_t numPassed = 0;
+  const auto report = [&](const TestRun& run) {
+    logger::info(
+        "Running", "unittests {} ({})", run.sourcePath, run.testBinPath
+    );
+    const CommandOutput& output = run.output.value();
+    // Keep stdout for events.
+    (isJsonMessageFormat() ? std::cerr : std::cout) << output.stdout
+                                                    << std::flush;
+    std::cerr << output.stderr << std::flush;
 
-    const int curExitCode = execCmd(Command(target));
-    if (curExitCode != EXIT_SUCCESS) {
-      exitCode = curExitCode;
+    nlohmann::json result = { { "name", run.sourcePath },
+                              { "binary", run.testBinPath },
+                              { "duration", run.duration },
+                              { "exit_code", output.exitCode },
+                              { "passed", output.exitCode == EXIT_SUCCESS } };
+    if (output.exitCode == EXIT_SUCCESS) {
+      ++numPassed;
+    } else {
+      exitCode = output.exitCode;
+      result["output"] = output.stdout + output.stderr;
     }
+    emitEvent("test-finished", std::move(result));
+  };
+
+  CommandPool pool(getParallelism());
+  size_t numReported = 0;
+  for (size_t i = 0; i < unittestTargets.size(); ++i) {
+    pool.submit(
+        Command(unittestTargets[i]),
+        [&, i](const CommandPool::Result& result, CommandOutput&& output) {
+          runs[i].output = std::move(output);
+          runs[i].duration = result.elapsed.count();
+          while (numReported < runs.size()
+                 && runs[numReported].output.has_value()) {
+            report(runs[numReported++]);
+          }
+        },
+        // Emitted when the test actually starts, not when it is queued.
+        [&, i]() {
+          emitEvent(
+              "test-started", { { "name", runs[i].sourcePath },
+                                { "binary", runs[i].testBinPath } }
+          );
+        }
+    );
   }
+  pool.wait();
 
   const auto end = std::chrono::steady_clock::now();
   const std::chrono::duration<double> elapsed = end - start;
+  emitEvent(
+      "test-summary", { { "passed", numPassed },
+                        { "failed", unittestTargets.size() - numPassed },
+                        { "duration", elapsed.count() } }
+  );
 
   if (exitCode == EXIT_SUCCESS) {
     logger::info(
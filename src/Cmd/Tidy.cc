@@ -3,17 +3,35 @@
 #include "../Algos.hpp"
 #include "../BuildConfig.hpp"
 #include "../Cli.hpp"
+#include "../Command.hpp"
+#include "../CommandPool.hpp"
+#include "../Hash.hpp"
 #include "../Logger.hpp"
+#include "../Manifest.hpp"
 #include "../Parallelism.hpp"
+#include "../Replacements.hpp"
+#include "../Toolchain.hpp"
 #include "Common.hpp"
 
 #include <charconv>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <fmt/core.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
 #include <span>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 static int tidyMain(std::span<const std::string_view> args);
 
@@ -24,11 +42,233 @@ const Subcmd TIDY_CMD =
         .addOpt(OPT_JOBS)
         .setMainFn(tidyMain);
 
+// A translation unit from compile_commands.json.
+struct TidyUnit {
+  fs::path file;
+  // Preprocesses the unit with the flags it is analyzed with.
+  Command preprocessCmd;
+};
+
+static std::vector<TidyUnit>
+loadCompdb(const fs::path& compdbPath) {
+  std::ifstream ifs(compdbPath);
+  const nlohmann::json compdb = nlohmann::json::parse(ifs);
+
+  std::vector<TidyUnit> units;
+  std::unordered_set<std::string> seen;
+  for (const nlohmann::json& entry : compdb) {
+    const fs::path directory = entry.at("directory").get<std::string>();
+    const fs::path file =
+        (directory / entry.at("file").get<std::string>()).lexically_normal();
+    if (!seen.insert(file.string()).second) {
+      continue;  // e.g., the object of a unit test
+    }
+
+    const std::vector<std::string> args =
+        parseEnvFlags(entry.at("command").get<std::string>());
+    if (args.empty()) {
+      continue;
+    }
+    Command preprocessCmd(args.front());
+    for (auto arg = args.begin() + 1; arg != args.end(); ++arg) {
+      if (*arg == "-c") {
+        continue;
+      }
+      if (*arg == "-o") {
+        if (arg + 1 != args.end()) {
+          ++arg;
+        }
+        continue;
+      }
+      preprocessCmd.addArg(*arg);
+    }
+    preprocessCmd.addArg("-E").setWorkingDirectory(directory.string());
+    units.push_back({ .file = file, .preprocessCmd = std::move(preprocessCmd) }
+    );
+  }
+  return units;
+}
+
+static void
+to_json(nlohmann::json& json, const CommandOutput& output) {
+  json = { { "exit_code", output.exitCode },
+           { "stdout", output.stdout },
+           { "stderr", output.stderr } };
+}
+
+static void
+from_json(const nlohmann::json& json, CommandOutput& output) {
+  output.exitCode = json.at("exit_code").get<int>();
+  output.stdout = json.at("stdout").get<std::string>();
+  output.stderr = json.at("stderr").get<std::string>();
+}
+
+// Results of clang-tidy are recorded by a hash of the preprocessed unit and
+// of everything else they depend on, so that only the units whose inputs
+// changed are analyzed again.
+class TidyCache : public ResultCache {
+  std::string baseKey;
+  // clang-tidy reads the nearest .clang-tidy, which may inherit its parents.
+  ConfigHasher configHasher{ { ".clang-tidy" }, /*nearestOnly=*/false };
+
+public:
+  TidyCache(
+      fs::path cachePath, const std::string_view tidyVersion,
+      const std::vector<std::string>& tidyArgs
+  )
+      : ResultCache(std::move(cachePath), "tidy") {
+    Hasher hasher;
+    hasher.updateField(tidyVersion);
+    for (const std::string& arg : tidyArgs) {
+      hasher.updateField(arg);
+    }
+    baseKey = hasher.hexDigest();
+  }
+
+  std::string key(const TidyUnit& unit, const uint64_t preprocessedDigest) {
+    return Hasher()
+        .updateField(baseKey)
+        .updateField(configHasher.hash(unit.file.parent_path()))
+        .updateField(unit.preprocessCmd.toString())
+        .updateField(std::to_string(preprocessedDigest))
+        .hexDigest();
+  }
+};
+
+// Applies the fixes exported by all the units in one step, so that units
+// sharing a header can be analyzed in parallel without racing to edit it.
+static int
+applyFixes(const fs::path& fixesDir) {
+  std::vector<Replacement> replacements;
+  for (const auto& entry : fs::directory_iterator(fixesDir)) {
+    std::ifstream ifs(entry.path());
+    std::ostringstream content;
+    content << ifs.rdbuf();
+    std::vector<Replacement> exported = parseExportedFixes(content.str());
+    replacements.insert(
+        replacements.end(), std::make_move_iterator(exported.begin()),
+        std::make_move_iterator(exported.end())
+    );
+  }
+
+  const MergedReplacements merged =
+      mergeReplacements(std::move(replacements));
+  for (const std::string& file : merged.conflicts) {
+    logger::warn("skipped fixes of {} due to conflicting replacements", file);
+  }
+  for (const auto& [file, fileReplacements] : merged.files) {
+    std::string content;
+    {
+      std::ifstream ifs(file, std::ios::binary);
+      std::ostringstream oss;
+      oss << ifs.rdbuf();
+      content = oss.str();
+    }
+    std::ofstream(file, std::ios::binary)
+        << applyReplacements(content, fileReplacements);
+  }
+  if (!merged.files.empty()) {
+    logger::info("Fixed", "{} file(s)", merged.files.size());
+  }
+  return merged.conflicts.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 static int
-tidyImpl(const Command& makeCmd) {
+tidyImpl(
+    const std::vector<TidyUnit>& units, const std::string& poacTidy,
+    const std::string& tidyVersion, const std::vector<std::string>& tidyArgs,
+    const fs::path& outDir, const bool fix
+) {
   const auto start = std::chrono::steady_clock::now();
 
-  const int exitCode = execCmd(makeCmd);
+  TidyCache cache(outDir / ".tidy-cache.json", tidyVersion, tidyArgs);
+  const fs::path fixesDir = outDir / "tidy-fixes";
+  if (fix) {
+    fs::remove_all(fixesDir);
+    fs::create_directories(fixesDir);
+  }
+
+  std::vector<std::optional<CommandOutput>> outputs(units.size());
+  size_t numReported = 0;
+  size_t numCached = 0;
+  int exitCode = EXIT_SUCCESS;
+  const auto complete = [&](const size_t i, CommandOutput&& output) {
+    outputs[i] = std::move(output);
+    // Report in order so that the output does not depend on scheduling.
+    while (numReported < outputs.size()
+           && outputs[numReported].has_value()) {
+      const CommandOutput& reported = outputs[numReported++].value();
+      std::cout << reported.stdout << std::flush;
+      std::cerr << reported.stderr << std::flush;
+      if (reported.exitCode != EXIT_SUCCESS) {
+        exitCode = reported.exitCode;
+      }
+    }
+  };
+
+  CommandPool pool(getParallelism());
+  for (size_t i = 0; i < units.size(); ++i) {
+    const TidyUnit& unit = units[i];
+    Command tidyCmd = Command(poacTidy, tidyArgs).addArg(unit.file.string());
+    if (fix) {
+      tidyCmd.addArg(
+          "-export-fixes=" + (fixesDir / fmt::format("{}.yaml", i)).string()
+      );
+    }
+
+    struct State {
+      HashSink preprocessed;
+      NullSink stderrSink;
+    };
+    const auto state = std::make_shared<State>();
+    logger::debug("Running `{}`", unit.preprocessCmd.toString());
+    pool.submit(
+        unit.preprocessCmd, state->preprocessed, state->stderrSink,
+        [&, i, state, tidyCmd](const CommandPool::Result& result) {
+          // If the unit does not even preprocess, let clang-tidy report it.
+          std::string key;
+          if (result.exitCode == EXIT_SUCCESS) {
+            key = cache.key(units[i], state->preprocessed.digest());
+            if (auto cached = cache.get<CommandOutput>(key)) {
+              // Fixes need to be exported again unless the unit is clean.
+              if (!fix || cached->stdout.empty()) {
+                ++numCached;
+                complete(i, std::move(cached.value()));
+                return;
+              }
+            }
+          }
+
+          logger::debug("Running `{}`", tidyCmd.toString());
+          pool.submit(
+              tidyCmd,
+              [&, i, key](
+                  const CommandPool::Result& tidyResult, CommandOutput&& output
+              ) {
+                // clang-tidy exits with 1 on errors in the analyzed code.
+                if (!key.empty()
+                    && (tidyResult.exitCode == EXIT_SUCCESS
+                        || tidyResult.exitCode == EXIT_FAILURE)) {
+                  cache.insert(key, output);
+                }
+                complete(i, std::move(output));
+              }
+          );
+        }
+    );
+  }
+  pool.wait();
+  // Keeps the entries used by this run only.
+  cache.save(/*keepUnused=*/false);
+  logger::debug("{} of {} unit(s) from the cache", numCached, units.size());
+
+  if (fix) {
+    // Apply fixes to as many files as possible even if some units failed.
+    const int fixExitCode = applyFixes(fixesDir);
+    if (exitCode == EXIT_SUCCESS) {
+      exitCode = fixExitCode;
+    }
+  }
 
   const auto end = std::chrono::steady_clock::now();
   const std::chrono::duration<double> elapsed = end - start;
@@ -72,41 +312,31 @@ tidyMain(const std::span<const std::string_view> args) {
     }
   }
 
-  if (!commandExists("clang-tidy")) {
-    logger::error("clang-tidy not found");
-    return EXIT_FAILURE;
+  const char* poacTidy = std::getenv("POAC_TIDY");
+  if (poacTidy == nullptr) {
+    poacTidy = "clang-tidy";
   }
-
-  if (fix && isParallel()) {
-    logger::warn("`--fix` implies `--jobs 1` to avoid race conditions");
-    setParallelism(1);
+  const std::optional<Tool> tidy = findTool(poacTidy);
+  if (!tidy.has_value()) {
+    logger::error("{} not found", poacTidy);
+    return EXIT_FAILURE;
   }
 
-  const BuildConfig config =
-      emitMakefile(/*isDebug=*/true, /*includeDevDeps=*/false);
+  rejectWorkspaceRoot("tidy");
+  const fs::path outDir =
+      emitCompdb(/*isDebug=*/true, /*includeDevDeps=*/false);
+  const std::vector<TidyUnit> units =
+      loadCompdb(outDir / "compile_commands.json");
 
-  std::string tidyFlags = "POAC_TIDY_FLAGS=";
+  std::vector<std::string> tidyArgs;
   if (!isVerbose()) {
-    tidyFlags += "-quiet";
+    tidyArgs.emplace_back("-quiet");
   }
+  tidyArgs.push_back("-p=" + outDir.string());
   if (fs::exists(".clang-tidy")) {
-    // clang-tidy will run within the poac-out/debug directory.
-    tidyFlags += " --config-file=../../.clang-tidy";
-  }
-  if (fix) {
-    tidyFlags += " -fix";
-  }
-
-  Command makeCmd(getMakeCommand());
-  makeCmd.addArg("-C");
-  makeCmd.addArg(config.outBasePath.string());
-  makeCmd.addArg(tidyFlags);
-  makeCmd.addArg("tidy");
-  if (fix) {
-    // Keep going to apply fixes to as many files as possible.
-    makeCmd.addArg("--keep-going");
+    tidyArgs.push_back("--config-file=" + fs::absolute(".clang-tidy").string());
   }
 
   logger::info("Running", "clang-tidy");
-  return tidyImpl(makeCmd);
+  return tidyImpl(units, poacTidy, tidy->version, tidyArgs, outDir, fix);
 }
@@ -11,6 +11,12 @@
 #include <span>
 #include <string_view>
 
+// Generated by poac when building itself; the bootstrap Makefile passes the
+// commit metadata on the command line instead.
+#if __has_include(<poac/build_info.hpp>)
+#  include <poac/build_info.hpp>
+#endif
+
 #ifndef POAC_POAC_PKG_VERSION
 #  error "POAC_POAC_PKG_VERSION is not defined"
 #endif
@@ -1,19 +1,62 @@
 #include "Command.hpp"
 
 #include "Exception.hpp"
-#include "Rustify.hpp"
 
-#include <algorithm>
 #include <array>
+#include <cerrno>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <string>
+#include <string_view>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
-constexpr std::size_t BUFFER_SIZE = 128;
+extern char** environ;  // NOLINT(readability-redundant-declaration)
+
+// Large enough to drain a full pipe (64 KiB on Linux) with one read().
+constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+
+void
+LineSink::write(std::string_view chunk) {
+  while (!chunk.empty()) {
+    const std::size_t eol = chunk.find('\n');
+    if (eol == std::string_view::npos) {
+      partial.append(chunk);
+      return;
+    }
+    if (partial.empty()) {
+      onLine(chunk.substr(0, eol));
+    } else {
+      partial.append(chunk.substr(0, eol));
+      onLine(partial);
+      partial.clear();
+    }
+    chunk.remove_prefix(eol + 1);
+  }
+}
+
+void
+LineSink::finish() {
+  if (!partial.empty()) {
+    onLine(partial);
+    partial.clear();
+  }
+}
+
+int
+toExitCode(const int status) noexcept {
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
 
 int
 Child::wait() const {
@@ -35,84 +78,78 @@ Child::wait() const {
     close(stderrfd);
   }
 
-  const int exitCode = WEXITSTATUS(status);
-  return exitCode;
+  return toExitCode(status);
 }
 
 CommandOutput
 Child::waitWithOutput() const {
-  std::string stdoutOutput;
-  std::string stderrOutput;
-
-  int maxfd = -1;
-  fd_set readfds;
-
-  // Determine the maximum file descriptor
-  maxfd = std::max(maxfd, stdoutfd);
-  maxfd = std::max(maxfd, stderrfd);
-
-  bool stdoutEOF = (stdoutfd == -1);
-  bool stderrEOF = (stderrfd == -1);
-
-  while (!stdoutEOF || !stderrEOF) {
-    FD_ZERO(&readfds);
-    if (!stdoutEOF) {
-      FD_SET(stdoutfd, &readfds);
-    }
-    if (!stderrEOF) {
-      FD_SET(stderrfd, &readfds);
-    }
+  StringSink stdoutSink;
+  StringSink stderrSink;
+  const int exitCode = waitWithOutput(stdoutSink, stderrSink);
+  return { .exitCode = exitCode,
+           .stdout = std::move(stdoutSink.get()),
+           .stderr = std::move(stderrSink.get()) };
+}
 
-    const int ret = select(maxfd + 1, &readfds, nullptr, nullptr, nullptr);
-    if (ret == -1) {
-      if (stdoutfd != -1) {
-        close(stdoutfd);
-      }
-      if (stderrfd != -1) {
-        close(stderrfd);
+int
+Child::waitWithOutput(OutputSink& stdoutSink, OutputSink& stderrSink) const {
+  std::array<pollfd, 2> fds{
+    pollfd{ .fd = stdoutfd, .events = POLLIN, .revents = 0 },
+    pollfd{ .fd = stderrfd, .events = POLLIN, .revents = 0 },
+  };
+  const std::array<OutputSink*, 2> sinks{ &stdoutSink, &stderrSink };
+  const auto closeFds = [&fds] {
+    for (pollfd& pfd : fds) {
+      if (pfd.fd != -1) {
+        close(pfd.fd);
+        pfd.fd = -1;  // poll() ignores negative fds.
       }
-      throw PoacError("select() failed");
     }
+  };
+  const auto reap = [this] {
+    int status{};
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+  };
 
-    // Read from stdout if available
-    if (!stdoutEOF && FD_ISSET(stdoutfd, &readfds)) {
-      std::array<char, BUFFER_SIZE> buffer{};
-      const ssize_t count = read(stdoutfd, buffer.data(), buffer.size());
-      if (count == -1) {
-        if (stdoutfd != -1) {
-          close(stdoutfd);
-        }
-        if (stderrfd != -1) {
-          close(stderrfd);
+  // Reused across calls; outputs like `-E` can be megabytes.
+  thread_local std::vector<char> buffer(BUFFER_SIZE);
+  try {
+    while (fds[0].fd != -1 || fds[1].fd != -1) {
+      if (poll(fds.data(), fds.size(), -1) == -1) {
+        if (errno == EINTR) {
+          continue;
         }
-        throw PoacError("read() failed on stdout");
-      } else if (count == 0) {
-        stdoutEOF = true;
-        close(stdoutfd);
-      } else {
-        stdoutOutput.append(buffer.data(), static_cast<std::size_t>(count));
+        throw PoacError("poll() failed");
       }
-    }
 
-    // Read from stderr if available
-    if (!stderrEOF && FD_ISSET(stderrfd, &readfds)) {
-      std::array<char, BUFFER_SIZE> buffer{};
-      const ssize_t count = read(stderrfd, buffer.data(), buffer.size());
-      if (count == -1) {
-        if (stdoutfd != -1) {
-          close(stdoutfd);
+      for (std::size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i].fd == -1 || fds[i].revents == 0) {
+          continue;
         }
-        if (stderrfd != -1) {
-          close(stderrfd);
+        const ssize_t count = read(fds[i].fd, buffer.data(), buffer.size());
+        if (count == -1) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw PoacError(
+              "read() failed on ", i == 0 ? "stdout" : "stderr"
+          );
+        } else if (count == 0) {
+          close(fds[i].fd);
+          fds[i].fd = -1;
+          sinks[i]->finish();
+        } else {
+          sinks[i]->write(
+              { buffer.data(), static_cast<std::size_t>(count) }
+          );
         }
-        throw PoacError("read() failed on stderr");
-      } else if (count == 0) {
-        stderrEOF = true;
-        close(stderrfd);
-      } else {
-        stderrOutput.append(buffer.data(), static_cast<std::size_t>(count));
       }
     }
+  } catch (...) {
+    closeFds();
+    reap();
+    throw;
   }
 
   int status{};
@@ -120,105 +157,142 @@ Child::waitWithOutput() const {
     throw PoacError("waitpid() failed");
   }
 
-  const int exitCode = WEXITSTATUS(status);
-  return { .exitCode = exitCode,
-           .stdout = stdoutOutput,
-           .stderr = stderrOutput };
+  return toExitCode(status);
+}
+
+// The pipe ends must not leak into other children spawned concurrently, or
+// their readers would not see EOF until those children exit.
+static void
+makePipe(std::array<int, 2>& fds, const char* name) {
+#ifdef __linux__
+  // Atomically, so no other thread can spawn a child in between.
+  if (pipe2(fds.data(), O_CLOEXEC) == -1) {
+    throw PoacError("pipe2() failed for ", name, ": ", std::strerror(errno));
+  }
+#else
+  if (pipe(fds.data()) == -1) {
+    throw PoacError("pipe() failed for ", name, ": ", std::strerror(errno));
+  }
+  for (const int fd : fds) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+      const int err = errno;
+      close(fds[0]);
+      close(fds[1]);
+      throw PoacError(
+          "fcntl() failed for ", name, " pipe: ", std::strerror(err)
+      );
+    }
+  }
+#endif
+}
+
+// Redirects `targetFd` of the child as `config` specifies.  dup2() clears
+// FD_CLOEXEC on the target, so the pipe itself is closed by exec.  Returns
+// an error number like the posix_spawn_file_actions_*() functions, or 0.
+static int
+addRedirect(
+    posix_spawn_file_actions_t& actions, const Command::IOConfig config,
+    const int pipeWriteFd, const int targetFd
+) {
+  if (config == Command::IOConfig::Piped) {
+    return posix_spawn_file_actions_adddup2(&actions, pipeWriteFd, targetFd);
+  } else if (config == Command::IOConfig::Null) {
+    return posix_spawn_file_actions_addopen(
+        &actions, targetFd, "/dev/null", O_WRONLY, 0
+    );
+  }
+  return 0;
 }
 
 Child
 Command::spawn() const {
-  std::array<int, 2> stdoutPipe{};
-  std::array<int, 2> stderrPipe{};
+  std::array<int, 2> stdoutPipe{ -1, -1 };
+  std::array<int, 2> stderrPipe{ -1, -1 };
+  const auto closePipes = [&] {
+    for (const int fd : { stdoutPipe[0], stdoutPipe[1], stderrPipe[0],
+                          stderrPipe[1] }) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+  };
 
   // Set up stdout pipe if needed
   if (stdoutConfig == IOConfig::Piped) {
-    if (pipe(stdoutPipe.data()) == -1) {
-      throw PoacError("pipe() failed for stdout");
-    }
+    makePipe(stdoutPipe, "stdout");
   }
   // Set up stderr pipe if needed
   if (stderrConfig == IOConfig::Piped) {
-    if (pipe(stderrPipe.data()) == -1) {
-      throw PoacError("pipe() failed for stderr");
+    try {
+      makePipe(stderrPipe, "stderr");
+    } catch (...) {
+      closePipes();
+      throw;
     }
   }
 
-  const pid_t pid = fork();
-  if (pid == -1) {
-    throw PoacError("fork() failed");
-  } else if (pid == 0) {
-    // Child process
-
-    // Redirect stdout
-    if (stdoutConfig == IOConfig::Piped) {
-      close(stdoutPipe[0]);  // Child doesn't read from stdout pipe
-      dup2(stdoutPipe[1], STDOUT_FILENO);
-      close(stdoutPipe[1]);
-    } else if (stdoutConfig == IOConfig::Null) {
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-      const int nullfd = open("/dev/null", O_WRONLY);
-      dup2(nullfd, STDOUT_FILENO);
-      close(nullfd);
-    }
-
-    // Redirect stderr
-    if (stderrConfig == IOConfig::Piped) {
-      close(stderrPipe[0]);  // Child doesn't read from stderr pipe
-      dup2(stderrPipe[1], STDERR_FILENO);
-      close(stderrPipe[1]);
-    } else if (stderrConfig == IOConfig::Null) {
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-      const int nullfd = open("/dev/null", O_WRONLY);
-      dup2(nullfd, STDERR_FILENO);
-      close(nullfd);
-    }
-
-    // Prepare arguments
-    std::vector<std::vector<char>> argBuffers;
-    std::vector<char*> args;
-
-    // Add command
-    argBuffers.emplace_back(command.begin(), command.end());
-    argBuffers.back().push_back('\0');
-    args.push_back(argBuffers.back().data());
-
-    // Add arguments
-    for (const std::string& arg : arguments) {
-      argBuffers.emplace_back(arg.begin(), arg.end());
-      argBuffers.back().push_back('\0');
-      args.push_back(argBuffers.back().data());
-    }
-    args.push_back(nullptr);
-
-    if (!workingDirectory.empty()) {
-      if (chdir(workingDirectory.c_str()) == -1) {
-        perror("chdir() failed");
-        _exit(1);
-      }
-    }
+  // posix_spawn() uses vfork() or clone(CLONE_VFORK) where available, so,
+  // unlike fork(), it does not copy the page tables of this (possibly large
+  // and multi-threaded) process.  Everything the child needs is prepared
+  // here, in the parent.
+  posix_spawn_file_actions_t actions;
+  int err = posix_spawn_file_actions_init(&actions);
+  if (err != 0) {
+    closePipes();
+    throw PoacError(
+        "posix_spawn_file_actions_init() failed: ", std::strerror(err)
+    );
+  }
+  err = addRedirect(actions, stdoutConfig, stdoutPipe[1], STDOUT_FILENO);
+  if (err == 0) {
+    err = addRedirect(actions, stderrConfig, stderrPipe[1], STDERR_FILENO);
+  }
+  if (err == 0 && !workingDirectory.empty()) {
+    err = posix_spawn_file_actions_addchdir_np(
+        &actions, workingDirectory.c_str()
+    );
+  }
+  if (err != 0) {
+    posix_spawn_file_actions_destroy(&actions);
+    closePipes();
+    throw PoacError(
+        "failed to set up file actions for `", command,
+        "`: ", std::strerror(err)
+    );
+  }
 
-    // Execute the command
-    if (execvp(command.c_str(), args.data()) == -1) {
-      perror("execvp() failed");
-      _exit(1);
-    }
-    unreachable();
-  } else {
-    // Parent process
+  std::vector<char*> args;
+  args.reserve(arguments.size() + 2);
+  // posix_spawn() does not modify the arguments.
+  args.push_back(const_cast<char*>(command.c_str()));
+  for (const std::string& arg : arguments) {
+    args.push_back(const_cast<char*>(arg.c_str()));
+  }
+  args.push_back(nullptr);
 
-    // Close unused pipe ends
-    if (stdoutConfig == IOConfig::Piped) {
-      close(stdoutPipe[1]);  // Parent doesn't write to stdout pipe
-    }
-    if (stderrConfig == IOConfig::Piped) {
-      close(stderrPipe[1]);  // Parent doesn't write to stderr pipe
-    }
+  pid_t pid{};
+  err = posix_spawnp(
+      &pid, command.c_str(), &actions, nullptr, args.data(), environ
+  );
+  posix_spawn_file_actions_destroy(&actions);
 
-    // Return the Child object with appropriate file descriptors
-    return { pid, stdoutConfig == IOConfig::Piped ? stdoutPipe[0] : -1,
-             stderrConfig == IOConfig::Piped ? stderrPipe[0] : -1 };
+  // Close unused pipe ends; the parent doesn't write to them.
+  if (stdoutPipe[1] != -1) {
+    close(stdoutPipe[1]);
+    stdoutPipe[1] = -1;
   }
+  if (stderrPipe[1] != -1) {
+    close(stderrPipe[1]);
+    stderrPipe[1] = -1;
+  }
+  if (err != 0) {
+    closePipes();
+    throw PoacError("failed to spawn `", command, "`: ", std::strerror(err));
+  }
+
+  // Return the Child object with appropriate file descriptors
+  return { pid, stdoutPipe[0], stderrPipe[0] };
 }
 
 CommandOutput
@@ -229,6 +303,14 @@ Command::output() const {
   return cmd.spawn().waitWithOutput();
 }
 
+int
+Command::output(OutputSink& stdoutSink, OutputSink& stderrSink) const {
+  Command cmd = *this;
+  cmd.setStdoutConfig(IOConfig::Piped);
+  cmd.setStderrConfig(IOConfig::Piped);
+  return cmd.spawn().waitWithOutput(stdoutSink, stderrSink);
+}
+
 std::string
 Command::toString() const {
   std::string res = command;
@@ -242,3 +324,91 @@ std::ostream&
 operator<<(std::ostream& os, const Command& cmd) {
   return os << cmd.toString();
 }
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <csignal>
+
+namespace tests {
+
+static void
+testLineSink() {
+  std::vector<std::string> lines;
+  LineSink sink([&lines](const std::string_view line) {
+    lines.emplace_back(line);
+  });
+  sink.write("foo\nba");
+  sink.write("r\n\nb");
+  sink.write("az");
+  sink.finish();
+
+  assertEq(lines.size(), 4UL);
+  assertEq(lines[0], "foo");
+  assertEq(lines[1], "bar");
+  assertEq(lines[2], "");
+  assertEq(lines[3], "baz");
+
+  pass();
+}
+
+static void
+testOutput() {
+  // Larger than a pipe buffer, on both streams at once.
+  const Command cmd(
+      "sh", { "-c", "yes 0123456789 | head -n 100000; "
+                    "yes abc | head -n 100000 >&2; exit 3" }
+  );
+  const CommandOutput output = cmd.output();
+  assertEq(output.exitCode, 3);
+  assertEq(output.stdout.size(), 1100000UL);
+  assertEq(output.stderr.size(), 400000UL);
+
+  HashSink stdoutSink;
+  NullSink stderrSink;
+  assertEq(cmd.output(stdoutSink, stderrSink), 3);
+  assertEq(stdoutSink.digest(), Hasher().update(output.stdout).digest());
+
+  pass();
+}
+
+static void
+testSpawn() {
+  const CommandOutput output = Command("pwd")
+                                   .setWorkingDirectory("/")
+                                   .setStderrConfig(Command::IOConfig::Null)
+                                   .output();
+  assertEq(output.exitCode, 0);
+  assertEq(output.stdout, "/\n");
+
+  assertEq(Command("sh", { "-c", "echo foo" })
+               .setStdoutConfig(Command::IOConfig::Null)
+               .spawn()
+               .wait(),
+           0);
+
+  assertEq(Command("sh", { "-c", "kill -TERM $$" }).spawn().wait(),
+           128 + SIGTERM);
+
+  bool thrown = false;
+  try {
+    static_cast<void>(Command("poac-no-such-command").spawn().wait());
+  } catch (const PoacError&) {
+    thrown = true;
+  }
+  assertTrue(thrown);
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testLineSink();
+  tests::testOutput();
+  tests::testSpawn();
+}
+
+#endif
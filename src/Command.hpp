@@ -1,7 +1,10 @@
 #pragma once
 
+#include "Hash.hpp"
+
 #include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <ostream>
 #include <string>
 #include <string_view>
@@ -15,6 +18,72 @@ struct CommandOutput {
   std::string stderr;
 };
 
+// Receives the output of a child process chunk by chunk as it is read, so
+// that callers need not keep the whole output in memory.
+class OutputSink {
+public:
+  OutputSink() = default;
+  OutputSink(const OutputSink&) = delete;
+  OutputSink(OutputSink&&) = delete;
+  OutputSink& operator=(const OutputSink&) = delete;
+  OutputSink& operator=(OutputSink&&) = delete;
+  virtual ~OutputSink() = default;
+
+  virtual void write(std::string_view chunk) = 0;
+  // Called once at EOF.
+  virtual void finish() {}
+};
+
+// Discards the output.
+class NullSink : public OutputSink {
+public:
+  void write(std::string_view /*chunk*/) override {}
+};
+
+// Collects the whole output.
+class StringSink : public OutputSink {
+  std::string str;
+
+public:
+  void write(const std::string_view chunk) override {
+    str.append(chunk);
+  }
+  std::string& get() noexcept {
+    return str;
+  }
+};
+
+// Calls `onLine` for each line without the trailing newline.  The last line
+// is passed at EOF even if it does not end with a newline.
+class LineSink : public OutputSink {
+  std::function<void(std::string_view)> onLine;
+  std::string partial;
+
+public:
+  explicit LineSink(std::function<void(std::string_view)> onLine)
+      : onLine(std::move(onLine)) {}
+
+  void write(std::string_view chunk) override;
+  void finish() override;
+};
+
+// Hashes the output, e.g., to compare outputs without keeping them.
+class HashSink : public OutputSink {
+  Hasher hasher;
+
+public:
+  void write(const std::string_view chunk) override {
+    hasher.update(chunk);
+  }
+  uint64_t digest() const noexcept {
+    return hasher.digest();
+  }
+};
+
+// Converts a status from waitpid() to an exit code.  A child killed by a
+// signal yields 128 plus the signal number, as in shells.
+int toExitCode(int status) noexcept;
+
 class Child {
 private:
   pid_t pid;
@@ -25,10 +94,13 @@ private:
       : pid(pid), stdoutfd(stdoutfd), stderrfd(stderrfd) {}
 
   friend struct Command;
+  friend class CommandPool;
 
 public:
   int wait() const;
   CommandOutput waitWithOutput() const;
+  // Streams piped stdout and stderr into the sinks and returns the exit code.
+  int waitWithOutput(OutputSink& stdoutSink, OutputSink& stderrSink) const;
 };
 
 struct Command {
@@ -74,6 +146,7 @@ struct Command {
 
   Child spawn() const;
   CommandOutput output() const;
+  int output(OutputSink& stdoutSink, OutputSink& stderrSink) const;
 };
 
 std::ostream& operator<<(std::ostream& os, const Command& cmd);
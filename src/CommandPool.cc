@@ -0,0 +1,347 @@
+#include "CommandPool.hpp"
+
+#include "Command.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#  include <sys/syscall.h>
+#endif
+
+// Large enough to drain a full pipe (64 KiB on Linux) with one read().
+constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+CommandPool::CommandPool(const size_t maxInFlight)
+    : maxInFlight(std::max<size_t>(maxInFlight, 1)) {}
+
+CommandPool::~CommandPool() {
+  for (const std::unique_ptr<Job>& job : running) {
+    for (const int fd : { job->stdoutfd, job->stderrfd, job->pidfd }) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+    if (!job->exited) {
+      int status{};
+      waitpid(job->pid, &status, 0);
+    }
+  }
+}
+
+void
+CommandPool::submit(
+    Command cmd, OutputSink& stdoutSink, OutputSink& stderrSink,
+    Callback onExit, SpawnHook onSpawn
+) {
+  queued.push_back(Job{ .cmd = std::move(cmd),
+                        .stdoutSink = &stdoutSink,
+                        .stderrSink = &stderrSink,
+                        .onExit = std::move(onExit),
+                        .onSpawn = std::move(onSpawn) });
+}
+
+void
+CommandPool::submit(
+    Command cmd, std::function<void(const Result&, CommandOutput&&)> onExit,
+    SpawnHook onSpawn
+) {
+  struct Sinks {
+    StringSink stdoutSink;
+    StringSink stderrSink;
+  };
+  const auto sinks = std::make_shared<Sinks>();
+  submit(
+      std::move(cmd), sinks->stdoutSink, sinks->stderrSink,
+      [sinks, onExit = std::move(onExit)](const Result& result) {
+        onExit(
+            result, { .exitCode = result.exitCode,
+                      .stdout = std::move(sinks->stdoutSink.get()),
+                      .stderr = std::move(sinks->stderrSink.get()) }
+        );
+      },
+      std::move(onSpawn)
+  );
+}
+
+void
+CommandPool::spawn(Job job) {
+  job.cmd.setStdoutConfig(Command::IOConfig::Piped)
+      .setStderrConfig(Command::IOConfig::Piped);
+  const Child child = job.cmd.spawn();
+  job.pid = child.pid;
+  job.stdoutfd = child.stdoutfd;
+  job.stderrfd = child.stderrfd;
+  job.start = std::chrono::steady_clock::now();
+#if defined(__linux__) && defined(SYS_pidfd_open)
+  // A pidfd becomes readable when the child exits.  Kernels before 5.3 fail
+  // with ENOSYS; then the child is reaped after its output is drained.
+  job.pidfd = static_cast<int>(syscall(SYS_pidfd_open, job.pid, 0));
+#endif
+  running.push_back(std::make_unique<Job>(std::move(job)));
+  if (running.back()->onSpawn) {
+    running.back()->onSpawn();
+  }
+}
+
+void
+CommandPool::reap(Job& job, const bool block) {
+  int status{};
+  pid_t ret{};
+  do {
+    ret = waitpid(job.pid, &status, block ? 0 : WNOHANG);
+  } while (ret == -1 && errno == EINTR);
+  if (ret == -1) {
+    throw PoacError("waitpid() failed");
+  }
+  if (ret == 0) {
+    return;  // Still running.
+  }
+
+  job.exited = true;
+  job.exitCode = toExitCode(status);
+  if (job.pidfd != -1) {
+    close(job.pidfd);
+    job.pidfd = -1;
+  }
+}
+
+bool
+CommandPool::isDone(const Job& job) noexcept {
+  return job.exited && job.stdoutfd == -1 && job.stderrfd == -1;
+}
+
+void
+CommandPool::wait() {
+  enum class Source : uint8_t { Stdout, Stderr, Pidfd };
+  std::vector<pollfd> fds;
+  std::vector<std::pair<Job*, Source>> sources;
+  thread_local std::vector<char> buffer(BUFFER_SIZE);
+
+  while (!queued.empty() || !running.empty()) {
+    while (running.size() < maxInFlight && !queued.empty()) {
+      Job job = std::move(queued.front());
+      queued.pop_front();
+      spawn(std::move(job));
+    }
+
+    fds.clear();
+    sources.clear();
+    for (const std::unique_ptr<Job>& job : running) {
+      if (job->stdoutfd != -1) {
+        fds.push_back({ .fd = job->stdoutfd, .events = POLLIN, .revents = 0 });
+        sources.emplace_back(job.get(), Source::Stdout);
+      }
+      if (job->stderrfd != -1) {
+        fds.push_back({ .fd = job->stderrfd, .events = POLLIN, .revents = 0 });
+        sources.emplace_back(job.get(), Source::Stderr);
+      }
+      if (job->pidfd != -1) {
+        fds.push_back({ .fd = job->pidfd, .events = POLLIN, .revents = 0 });
+        sources.emplace_back(job.get(), Source::Pidfd);
+      }
+    }
+
+    if (!fds.empty() && poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw PoacError("poll() failed");
+    }
+
+    for (size_t i = 0; i < fds.size(); ++i) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      auto [job, source] = sources[i];
+      if (source == Source::Pidfd) {
+        reap(*job, /*block=*/false);
+        continue;
+      }
+
+      int& fd = source == Source::Stdout ? job->stdoutfd : job->stderrfd;
+      OutputSink& sink =
+          source == Source::Stdout ? *job->stdoutSink : *job->stderrSink;
+      const ssize_t count = read(fd, buffer.data(), buffer.size());
+      if (count == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw PoacError("read() failed for `", job->cmd, '`');
+      } else if (count == 0) {
+        close(fd);
+        fd = -1;
+        sink.finish();
+      } else {
+        sink.write({ buffer.data(), static_cast<size_t>(count) });
+      }
+    }
+
+    // Complete the jobs first so that callbacks can submit more.
+    std::vector<std::unique_ptr<Job>> done;
+    for (auto itr = running.begin(); itr != running.end();) {
+      Job& job = **itr;
+      if (!job.exited && job.pidfd == -1 && job.stdoutfd == -1
+          && job.stderrfd == -1) {
+        // Without a pidfd, the closed output is the only notification.
+        reap(job, /*block=*/true);
+      }
+      if (isDone(job)) {
+        done.push_back(std::move(*itr));
+        itr = running.erase(itr);
+      } else {
+        ++itr;
+      }
+    }
+    for (const std::unique_ptr<Job>& job : done) {
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - job->start;
+      job->onExit({ .exitCode = job->exitCode, .elapsed = elapsed });
+    }
+  }
+}
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <csignal>
+#  include <string>
+
+namespace tests {
+
+static void
+testManyInFlight() {
+  CommandPool pool(64);
+  size_t numDone = 0;
+  int sum = 0;
+  for (int i = 0; i < 200; ++i) {
+    pool.submit(
+        Command("sh", { "-c", "sleep 0.05; echo " + std::to_string(i)
+                                  + "; exit " + std::to_string(i % 2) }),
+        [&, i](const CommandPool::Result& result, CommandOutput&& output) {
+          assertEq(result.exitCode, i % 2);
+          assertEq(output.stdout, std::to_string(i) + '\n');
+          sum += result.exitCode;
+          ++numDone;
+        }
+    );
+  }
+  pool.wait();
+  assertEq(numDone, 200UL);
+  assertEq(sum, 100);
+
+  pass();
+}
+
+static void
+testSubmitFromCallback() {
+  CommandPool pool(1);
+  std::vector<std::string> order;
+  pool.submit(
+      Command("echo", { "first" }),
+      [&](const CommandPool::Result&, CommandOutput&& output) {
+        order.push_back(output.stdout);
+        pool.submit(
+            Command("echo", { "second" }),
+            [&](const CommandPool::Result&, CommandOutput&& output) {
+              order.push_back(output.stdout);
+            }
+        );
+      }
+  );
+  pool.wait();
+  assertEq(order.size(), 2UL);
+  assertEq(order[0], "first\n");
+  assertEq(order[1], "second\n");
+
+  pass();
+}
+
+static void
+testSpawnHook() {
+  CommandPool pool(1);
+  std::vector<std::string> events;
+  for (const std::string name : { "a", "b" }) {
+    pool.submit(
+        Command("true"),
+        [&, name](const CommandPool::Result&, CommandOutput&&) {
+          events.push_back("exit " + name);
+        },
+        [&, name]() { events.push_back("spawn " + name); }
+    );
+  }
+  // Nothing has started before the pool runs.
+  assertTrue(events.empty());
+  pool.wait();
+  // With one slot, `b` starts only after `a` has finished.
+  assertTrue(
+      events
+      == std::vector<std::string>{ "spawn a", "exit a", "spawn b", "exit b" }
+  );
+
+  pass();
+}
+
+static void
+testSinks() {
+  CommandPool pool(2);
+  HashSink stdoutSink;
+  NullSink stderrSink;
+  int exitCode = -1;
+  pool.submit(
+      Command("sh", { "-c", "yes | head -n 100000; echo err >&2" }),
+      stdoutSink, stderrSink,
+      [&](const CommandPool::Result& result) { exitCode = result.exitCode; }
+  );
+  pool.wait();
+  assertEq(exitCode, 0);
+  Hasher expected;
+  for (int i = 0; i < 100000; ++i) {
+    expected.update("y\n");
+  }
+  assertEq(stdoutSink.digest(), expected.digest());
+
+  pass();
+}
+
+static void
+testSignaled() {
+  CommandPool pool(1);
+  int exitCode = -1;
+  pool.submit(
+      Command("sh", { "-c", "kill -SEGV $$" }),
+      [&](const CommandPool::Result& result, CommandOutput&&) {
+        exitCode = result.exitCode;
+      }
+  );
+  pool.wait();
+  // Not 0, which WEXITSTATUS() yields for a signaled child.
+  assertEq(exitCode, 128 + SIGSEGV);
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testManyInFlight();
+  tests::testSubmitFromCallback();
+  tests::testSpawnHook();
+  tests::testSinks();
+  tests::testSignaled();
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Command.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <sys/types.h>
+#include <vector>
+
+// Runs many commands concurrently from a single thread.  One event loop
+// reads the output of every child and reaps it (through a pidfd on Linux), so
+// no thread blocks per child and up to `maxInFlight` children run at once.
+//
+// Callbacks run on the thread calling wait() and may submit more commands.
+class CommandPool {
+public:
+  struct Result {
+    int exitCode;
+    std::chrono::duration<double> elapsed;
+  };
+  using Callback = std::function<void(const Result&)>;
+  using SpawnHook = std::function<void()>;
+
+  explicit CommandPool(size_t maxInFlight);
+  CommandPool(const CommandPool&) = delete;
+  CommandPool(CommandPool&&) = delete;
+  CommandPool& operator=(const CommandPool&) = delete;
+  CommandPool& operator=(CommandPool&&) = delete;
+  // Reaps the children still running, e.g., when a callback threw.
+  ~CommandPool();
+
+  // Queues `cmd` with its stdout and stderr streamed into the sinks, which
+  // must outlive the command.  `onSpawn`, if any, is called once the child
+  // has actually started, i.e., when a slot was free; `onExit` once both
+  // outputs are drained and the child has exited.
+  void submit(
+      Command cmd, OutputSink& stdoutSink, OutputSink& stderrSink,
+      Callback onExit, SpawnHook onSpawn = nullptr
+  );
+  // Same as above, collecting the output.
+  void submit(
+      Command cmd, std::function<void(const Result&, CommandOutput&&)> onExit,
+      SpawnHook onSpawn = nullptr
+  );
+
+  // Runs the event loop until all the commands, including the ones submitted
+  // by callbacks, have completed.  Spawn and I/O errors are thrown.
+  void wait();
+
+private:
+  struct Job {
+    Command cmd;
+    OutputSink* stdoutSink;
+    OutputSink* stderrSink;
+    Callback onExit;
+    SpawnHook onSpawn;
+
+    pid_t pid = -1;
+    int stdoutfd = -1;
+    int stderrfd = -1;
+    int pidfd = -1;
+    bool exited = false;
+    int exitCode = 0;
+    std::chrono::steady_clock::time_point start{};
+  };
+
+  size_t maxInFlight;
+  std::deque<Job> queued;
+  std::vector<std::unique_ptr<Job>> running;
+
+  void spawn(Job job);
+  static void reap(Job& job, bool block);
+  static bool isDone(const Job& job) noexcept;
+};
@@ -0,0 +1,579 @@
+#include "FileWalker.hpp"
+
+#include "Algos.hpp"
+#include "Hash.hpp"
+#include "Logger.hpp"
+#include "Rustify.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tbb/parallel_for_each.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Matches a bracket expression at the start of `glob` against `c`, and
+// advances `glob` past it.  Returns nullopt if the expression is not closed.
+static std::optional<bool>
+matchBracket(std::string_view& glob, const char c) noexcept {
+  size_t i = 1;
+  const bool negated = i < glob.size() && (glob[i] == '!' || glob[i] == '^');
+  if (negated) {
+    ++i;
+  }
+  bool matched = false;
+  const size_t first = i;
+  for (; i < glob.size() && (glob[i] != ']' || i == first); ++i) {
+    if (i + 2 < glob.size() && glob[i + 1] == '-' && glob[i + 2] != ']') {
+      matched |= glob[i] <= c && c <= glob[i + 2];
+      i += 2;
+    } else {
+      matched |= glob[i] == c;
+    }
+  }
+  if (i >= glob.size()) {
+    return std::nullopt;
+  }
+  glob.remove_prefix(i + 1);
+  return matched != negated;
+}
+
+bool
+globMatch(std::string_view glob, std::string_view path) noexcept {
+  while (!glob.empty()) {
+    if (glob.starts_with("**")) {
+      glob.remove_prefix(2);
+      // `**/` matches zero or more whole directories.
+      const bool isDirs = glob.starts_with('/');
+      if (isDirs) {
+        glob.remove_prefix(1);
+      }
+      for (size_t i = 0; i <= path.size(); ++i) {
+        if ((!isDirs || i == 0 || path[i - 1] == '/')
+            && globMatch(glob, path.substr(i))) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    switch (glob.front()) {
+      case '*':
+        glob.remove_prefix(1);
+        for (size_t i = 0; i <= path.size(); ++i) {
+          if (globMatch(glob, path.substr(i))) {
+            return true;
+          }
+          if (i < path.size() && path[i] == '/') {
+            break;
+          }
+        }
+        return false;
+      case '?':
+        if (path.empty() || path.front() == '/') {
+          return false;
+        }
+        glob.remove_prefix(1);
+        break;
+      case '[':
+        if (path.empty() || path.front() == '/') {
+          return false;
+        }
+        if (const auto matched = matchBracket(glob, path.front())) {
+          if (!matched.value()) {
+            return false;
+          }
+          break;
+        }
+        // An unclosed '[' is a literal.
+        if (path.front() != '[') {
+          return false;
+        }
+        glob.remove_prefix(1);
+        break;
+      case '\\':
+        if (glob.size() > 1) {
+          glob.remove_prefix(1);
+        }
+        [[fallthrough]];
+      default:
+        if (path.empty() || path.front() != glob.front()) {
+          return false;
+        }
+        glob.remove_prefix(1);
+        break;
+    }
+    path.remove_prefix(1);
+  }
+  return path.empty();
+}
+
+void
+IgnoreMatcher::add(std::string_view pattern, const std::string_view baseDir) {
+  if (pattern.ends_with('\r')) {
+    pattern.remove_suffix(1);
+  }
+  // Trailing spaces are ignored unless escaped.
+  while (pattern.ends_with(' ') && !pattern.ends_with("\\ ")) {
+    pattern.remove_suffix(1);
+  }
+  if (pattern.empty() || pattern.front() == '#') {
+    return;
+  }
+
+  Rule rule;
+  rule.baseDir = baseDir;
+  if (pattern.front() == '!') {
+    rule.negated = true;
+    pattern.remove_prefix(1);
+  } else if (pattern.starts_with("\\!") || pattern.starts_with("\\#")) {
+    pattern.remove_prefix(1);
+  }
+  if (pattern.ends_with('/')) {
+    rule.dirOnly = true;
+    pattern.remove_suffix(1);
+  }
+  // A pattern with a slash at the beginning or middle is relative to the
+  // directory of the file; otherwise, it matches the name at any depth.
+  rule.anchored = pattern.find('/') != std::string_view::npos;
+  if (pattern.starts_with('/')) {
+    pattern.remove_prefix(1);
+  }
+  if (pattern.empty()) {
+    return;
+  }
+  rule.glob = pattern;
+  rules.push_back(std::move(rule));
+}
+
+void
+IgnoreMatcher::addFile(const fs::path& path, const std::string_view baseDir) {
+  std::ifstream ifs(path);
+  std::string line;
+  while (std::getline(ifs, line)) {
+    add(line, baseDir);
+  }
+}
+
+std::optional<bool>
+IgnoreMatcher::match(const std::string_view path, const bool isDir) const {
+  for (auto rule = rules.rbegin(); rule != rules.rend(); ++rule) {
+    if (rule->dirOnly && !isDir) {
+      continue;
+    }
+
+    std::string_view relPath = path;
+    if (!rule->baseDir.empty()) {
+      if (!relPath.starts_with(rule->baseDir)
+          || relPath.size() <= rule->baseDir.size()
+          || relPath[rule->baseDir.size()] != '/') {
+        continue;
+      }
+      relPath.remove_prefix(rule->baseDir.size() + 1);
+    }
+    if (!rule->anchored) {
+      relPath = relPath.substr(relPath.rfind('/') + 1);
+    }
+    if (globMatch(rule->glob, relPath)) {
+      return !rule->negated;
+    }
+  }
+  return std::nullopt;
+}
+
+FileWalker::FileWalker(fs::path root) : root(std::move(root)) {}
+
+FileWalker&
+FileWalker::respectGitignore(const bool enable) {
+  useGitignore = enable;
+  return *this;
+}
+
+FileWalker&
+FileWalker::exclude(const std::string_view pattern) {
+  excludes.add('/' + std::string(pattern));
+  return *this;
+}
+
+FileWalker&
+FileWalker::includeDirs(const bool enable) {
+  withDirs = enable;
+  return *this;
+}
+
+FileWalker&
+FileWalker::statFiles(const bool enable) {
+  withFileTimes = enable;
+  return *this;
+}
+
+FileWalker&
+FileWalker::setSnapshotPath(fs::path path) {
+  snapshotPath = std::move(path);
+  return *this;
+}
+
+fs::path
+FileWalker::snapshotPathFor(const fs::path& outDir, const fs::path& root) {
+  const std::string key =
+      fs::absolute(root).lexically_normal().generic_string();
+  return outDir / ".walk" / Hasher().update(key).hexDigest();
+}
+
+namespace {
+
+struct DirListing {
+  int64_t mtime = 0;
+  // Names with 'd' for directories and 'f' for files.
+  std::vector<std::pair<std::string, char>> entries;
+};
+using Snapshot = std::unordered_map<std::string, DirListing>;
+
+struct DirTask {
+  fs::path dir;
+  std::string relPath;  // relative to the root
+  std::shared_ptr<const IgnoreMatcher> ignores;
+};
+
+}  // namespace
+
+// The snapshot is a list of directories, each a line of its mtime and path
+// relative to the root, followed by lines of its entries and a blank line.
+static Snapshot
+loadSnapshot(const fs::path& path) {
+  Snapshot snapshot;
+  std::ifstream ifs(path);
+  std::string line;
+  while (std::getline(ifs, line)) {
+    const size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      break;  // broken
+    }
+    DirListing listing;
+    if (std::from_chars(line.data(), line.data() + tab, listing.mtime).ec
+        != std::errc()) {
+      break;
+    }
+    std::string relPath = line.substr(tab + 1);
+    while (std::getline(ifs, line) && !line.empty()) {
+      listing.entries.emplace_back(line.substr(1), line.front());
+    }
+    snapshot.emplace(std::move(relPath), std::move(listing));
+  }
+  return snapshot;
+}
+
+static void
+saveSnapshot(const fs::path& path, const Snapshot& snapshot) {
+  std::string content;
+  for (const auto& [relPath, listing] : snapshot) {
+    content += std::to_string(listing.mtime);
+    content += '\t';
+    content += relPath;
+    content += '\n';
+    for (const auto& [name, type] : listing.entries) {
+      content += type;
+      content += name;
+      content += '\n';
+    }
+    content += '\n';
+  }
+  try {
+    fs::create_directories(path.parent_path());
+    writeFileAtomically(path, content);
+  } catch (const fs::filesystem_error& e) {
+    logger::debug("failed to save walk snapshot: {}", e.what());
+  }
+}
+
+static DirListing
+listDir(const fs::path& dir, const int64_t mtime) {
+  DirListing listing{ .mtime = mtime, .entries = {} };
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(dir, ec)) {
+    std::string name = entry.path().filename().string();
+    // Like recursive_directory_iterator, do not follow directory symlinks.
+    if (entry.is_symlink(ec)) {
+      if (entry.is_regular_file(ec)) {
+        listing.entries.emplace_back(std::move(name), 'f');
+      }
+    } else if (entry.is_directory(ec)) {
+      listing.entries.emplace_back(std::move(name), 'd');
+    } else if (entry.is_regular_file(ec)) {
+      listing.entries.emplace_back(std::move(name), 'f');
+    }
+  }
+  return listing;
+}
+
+static std::string
+joinRelPath(const std::string_view base, const std::string_view name) {
+  if (base.empty()) {
+    return std::string(name);
+  }
+  if (name.empty()) {
+    return std::string(base);
+  }
+  return std::string(base) + '/' + std::string(name);
+}
+
+std::vector<WalkEntry>
+FileWalker::walk() const {
+  if (!fs::is_directory(root)) {
+    return {};
+  }
+
+  // Gitignore patterns are matched against paths relative to the repository
+  // root, which may be above the walk root.
+  std::string gitPrefix;
+  auto rootIgnores = std::make_shared<IgnoreMatcher>();
+  if (useGitignore) {
+    fs::path absRoot = fs::absolute(root).lexically_normal();
+    if (!absRoot.has_filename()) {
+      absRoot = absRoot.parent_path();  // trailing slash
+    }
+    std::optional<fs::path> gitRoot;
+    for (fs::path dir = absRoot;; dir = dir.parent_path()) {
+      if (fs::exists(dir / ".git")) {
+        gitRoot = dir;
+        break;
+      }
+      if (dir == dir.parent_path()) {
+        break;
+      }
+    }
+
+    if (gitRoot.has_value()) {
+      gitPrefix = absRoot.lexically_relative(gitRoot.value()).generic_string();
+      if (gitPrefix == ".") {
+        gitPrefix.clear();
+      }
+      rootIgnores->addFile(gitRoot.value() / ".git" / "info" / "exclude");
+      // The .gitignore files above the root, outer ones first so that inner
+      // ones take precedence.  The root's own is read by the walk.
+      fs::path dir = gitRoot.value();
+      std::string baseDir;
+      for (const fs::path& component : fs::path(gitPrefix)) {
+        rootIgnores->addFile(dir / ".gitignore", baseDir);
+        dir /= component;
+        baseDir = joinRelPath(baseDir, component.string());
+      }
+    }
+  }
+
+  const Snapshot oldSnapshot = snapshotPath.has_value()
+                                   ? loadSnapshot(snapshotPath.value())
+                                   : Snapshot{};
+  Snapshot newSnapshot;
+  // Directories modified within this window may change again within the
+  // granularity of mtime, so they are not recorded.
+  const fs::file_time_type cutoff =
+      fs::file_time_type::clock::now() - std::chrono::seconds(2);
+
+  std::mutex mtx;
+  std::vector<WalkEntry> entries;
+  const auto walkDir = [&](const DirTask& task, tbb::feeder<DirTask>& feeder) {
+    std::error_code ec;
+    const fs::file_time_type mtime = fs::last_write_time(task.dir, ec);
+    if (ec) {
+      return;
+    }
+
+    const int64_t mtimeCount = mtime.time_since_epoch().count();
+    DirListing listing;
+    if (const auto found = oldSnapshot.find(task.relPath);
+        found != oldSnapshot.end() && found->second.mtime == mtimeCount) {
+      listing = found->second;
+    } else {
+      listing = listDir(task.dir, mtimeCount);
+    }
+
+    std::shared_ptr<const IgnoreMatcher> ignores = task.ignores;
+    if (useGitignore
+        && std::ranges::find(listing.entries, std::pair<std::string, char>{
+                                                  ".gitignore", 'f' })
+               != listing.entries.end()) {
+      auto nested = std::make_shared<IgnoreMatcher>(*ignores);
+      nested->addFile(
+          task.dir / ".gitignore", joinRelPath(gitPrefix, task.relPath)
+      );
+      ignores = std::move(nested);
+    }
+
+    std::vector<WalkEntry> found;
+    if (withDirs && !task.relPath.empty()) {
+      found.push_back({ .path = task.relPath, .isDir = true, .mtime = mtime });
+    }
+    for (const auto& [name, type] : listing.entries) {
+      const bool isDir = type == 'd';
+      const std::string relPath = joinRelPath(task.relPath, name);
+      if ((useGitignore && name == ".git")
+          || excludes.isIgnored(relPath, isDir)
+          || ignores->isIgnored(joinRelPath(gitPrefix, relPath), isDir)) {
+        continue;
+      }
+
+      if (isDir) {
+        feeder.add({ .dir = task.dir / name,
+                     .relPath = relPath,
+                     .ignores = ignores });
+        continue;
+      }
+      WalkEntry entry{ .path = relPath, .isDir = false, .mtime = {} };
+      if (withFileTimes) {
+        entry.mtime = fs::last_write_time(task.dir / name, ec);
+      }
+      found.push_back(std::move(entry));
+    }
+
+    const std::lock_guard lock(mtx);
+    entries.insert(
+        entries.end(), std::make_move_iterator(found.begin()),
+        std::make_move_iterator(found.end())
+    );
+    if (mtime < cutoff) {
+      newSnapshot.emplace(task.relPath, std::move(listing));
+    }
+  };
+  const std::vector<DirTask> rootTasks{
+    { .dir = root, .relPath = "", .ignores = rootIgnores }
+  };
+  tbb::parallel_for_each(rootTasks.begin(), rootTasks.end(), walkDir);
+
+  if (snapshotPath.has_value()) {
+    saveSnapshot(snapshotPath.value(), newSnapshot);
+  }
+  std::ranges::sort(entries, {}, &WalkEntry::path);
+  return entries;
+}
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+static void
+testGlobMatch() {
+  assertTrue(globMatch("*.cc", "main.cc"));
+  assertFalse(globMatch("*.cc", "src/main.cc"));
+  assertTrue(globMatch("src/*.cc", "src/main.cc"));
+  assertTrue(globMatch("**/main.cc", "main.cc"));
+  assertTrue(globMatch("**/main.cc", "a/b/main.cc"));
+  assertTrue(globMatch("a/**/b", "a/b"));
+  assertTrue(globMatch("a/**/b", "a/x/y/b"));
+  assertTrue(globMatch("a/**", "a/x/y"));
+  assertTrue(globMatch("?.h", "a.h"));
+  assertFalse(globMatch("?.h", "ab.h"));
+  assertTrue(globMatch("[a-c].h", "b.h"));
+  assertFalse(globMatch("[!a-c].h", "b.h"));
+  assertTrue(globMatch("\\*.h", "*.h"));
+  assertFalse(globMatch("\\*.h", "a.h"));
+
+  pass();
+}
+
+static void
+testIgnoreMatcher() {
+  IgnoreMatcher matcher;
+  matcher.add("# comment");
+  matcher.add("/poac-out");
+  matcher.add("*.o");
+  matcher.add("!keep.o");
+  matcher.add("build/");
+  matcher.add("gen.hpp", "src");
+
+  assertTrue(matcher.isIgnored("poac-out", true));
+  assertFalse(matcher.isIgnored("src/poac-out", true));
+  assertTrue(matcher.isIgnored("src/a.o", false));
+  assertFalse(matcher.isIgnored("src/keep.o", false));
+  assertTrue(matcher.isIgnored("a/build", true));
+  assertFalse(matcher.isIgnored("a/build", false));
+  assertTrue(matcher.isIgnored("src/x/gen.hpp", false));
+  assertFalse(matcher.isIgnored("include/gen.hpp", false));
+  assertFalse(matcher.match("src/main.cc", false).has_value());
+
+  pass();
+}
+
+static void
+testWalk() {
+  const TempDir tmpDir("poac-walk");
+  const fs::path& root = tmpDir.path();
+  fs::create_directories(root / ".git");
+  fs::create_directories(root / "src" / "sub");
+  fs::create_directories(root / "poac-out");
+  const auto touch = [](const fs::path& path, const std::string& content) {
+    std::ofstream(path) << content;
+  };
+  touch(root / ".gitignore", "/poac-out\n*.o\n");
+  touch(root / "src" / ".gitignore", "gen.cc\n");
+  touch(root / "src" / "main.cc", "");
+  touch(root / "src" / "main.o", "");
+  touch(root / "src" / "gen.cc", "");
+  touch(root / "src" / "sub" / "a.cc", "");
+  touch(root / "poac-out" / "b.cc", "");
+
+  const auto paths = [](const std::vector<WalkEntry>& entries) {
+    std::vector<std::string> paths;
+    for (const WalkEntry& entry : entries) {
+      paths.push_back(entry.path.generic_string());
+    }
+    return paths;
+  };
+
+  const fs::path snapshot = root / "snapshot";
+  const std::vector<std::string> expected = {
+    ".gitignore", "src/.gitignore", "src/main.cc", "src/sub/a.cc"
+  };
+  // Directories modified just now are not recorded in the snapshot.
+  const fs::file_time_type past =
+      fs::file_time_type::clock::now() - std::chrono::hours(1);
+  for (const fs::path& dir : { root, root / "src", root / "src" / "sub" }) {
+    fs::last_write_time(dir, past);
+  }
+  FileWalker walker(root);
+  walker.respectGitignore().exclude("snapshot").setSnapshotPath(snapshot);
+  assertTrue(paths(walker.walk()) == expected);
+
+  // Listings of directories whose mtime is unchanged come from the snapshot.
+  touch(root / "src" / "sub" / "b.cc", "");
+  fs::last_write_time(root / "src" / "sub", past);
+  assertTrue(paths(walker.walk()) == expected);
+  fs::last_write_time(root / "src" / "sub", fs::file_time_type::clock::now());
+  assertEq(walker.walk().size(), expected.size() + 1);
+  fs::remove(root / "src" / "sub" / "b.cc");
+
+  // The .gitignore files above the root apply.
+  assertTrue(
+      paths(FileWalker(root / "src").respectGitignore().walk())
+      == std::vector<std::string>{ ".gitignore", "main.cc", "sub/a.cc" }
+  );
+  assertEq(
+      FileWalker(root / "src").includeDirs().walk().size(),
+      static_cast<size_t>(6)
+  );
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testGlobMatch();
+  tests::testIgnoreMatcher();
+  tests::testWalk();
+}
+
+#endif
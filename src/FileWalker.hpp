@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Rustify.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Gitignore patterns compiled into one matcher.  Paths are given relative to
+// the directory the patterns of the top-level file apply to, e.g., the root
+// of the Git repository, with '/' as the separator.
+class IgnoreMatcher {
+  struct Rule {
+    std::string baseDir;  // directory of the file the rule came from
+    std::string glob;
+    bool negated = false;
+    bool dirOnly = false;
+    bool anchored = false;  // matched against the path, not the file name
+  };
+  std::vector<Rule> rules;
+
+public:
+  // Adds a pattern read from a file in `baseDir`, e.g., "src" for
+  // src/.gitignore.  Blank lines and comments are ignored.
+  void add(std::string_view pattern, std::string_view baseDir = "");
+  // Adds the patterns in the file at `path`, if it exists.
+  void addFile(const fs::path& path, std::string_view baseDir = "");
+
+  bool empty() const noexcept {
+    return rules.empty();
+  }
+  // Returns whether the last pattern matching `path` ignores it, or nullopt
+  // when no pattern matches.  Patterns added later take precedence, as
+  // those of deeper .gitignore files do.
+  std::optional<bool> match(std::string_view path, bool isDir) const;
+  bool isIgnored(std::string_view path, bool isDir) const {
+    return match(path, isDir).value_or(false);
+  }
+};
+
+// Matches `path` against a glob where `*` and `?` do not match '/', and `**`
+// matches any number of directories.
+bool globMatch(std::string_view glob, std::string_view path) noexcept;
+
+struct WalkEntry {
+  fs::path path;  // relative to the root
+  bool isDir = false;
+  // Set for directories, and for files with statFiles().
+  fs::file_time_type mtime{};
+};
+
+// Lists the files under a directory, descending into subdirectories in
+// parallel.  Directory listings can be kept in a snapshot, so that a repeat
+// walk only reads the directories whose mtime has changed since.
+class FileWalker {
+  fs::path root;
+  bool useGitignore = false;
+  bool withDirs = false;
+  bool withFileTimes = false;
+  IgnoreMatcher excludes;
+  std::optional<fs::path> snapshotPath;
+
+public:
+  explicit FileWalker(fs::path root);
+
+  // Skips what the .gitignore files of the enclosing Git repository ignore,
+  // including those above the root, and .git/info/exclude.
+  FileWalker& respectGitignore(bool enable = true);
+  // Skips the paths matching `pattern`, anchored at the root.
+  FileWalker& exclude(std::string_view pattern);
+  // Also returns the directories under the root.
+  FileWalker& includeDirs(bool enable = true);
+  // Fills in the mtime of the files.
+  FileWalker& statFiles(bool enable = true);
+  // Reads and updates the snapshot of directory listings at `path`.
+  FileWalker& setSnapshotPath(fs::path path);
+  // The snapshot path for `root` under `outDir`, e.g., poac-out.
+  static fs::path snapshotPathFor(const fs::path& outDir, const fs::path& root);
+
+  // Returns the entries sorted by path.  A missing root yields nothing.
+  std::vector<WalkEntry> walk() const;
+};
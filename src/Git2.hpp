@@ -3,10 +3,12 @@
 #include "Git2/Commit.hpp"
 #include "Git2/Config.hpp"
 #include "Git2/Describe.hpp"
+#include "Git2/Diff.hpp"
 #include "Git2/Exception.hpp"
 #include "Git2/Global.hpp"
 #include "Git2/Object.hpp"
 #include "Git2/Oid.hpp"
+#include "Git2/Remote.hpp"
 #include "Git2/Repository.hpp"
 #include "Git2/Revparse.hpp"
 #include "Git2/Revwalk.hpp"
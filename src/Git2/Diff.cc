@@ -0,0 +1,72 @@
+#include "Diff.hpp"
+
+#include "Exception.hpp"
+#include "Object.hpp"
+#include "Repository.hpp"
+
+#include <cstddef>
+#include <git2/diff.h>
+#include <git2/object.h>
+#include <git2/tree.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+Tree::~Tree() {
+  git_tree_free(this->raw);
+}
+
+Tree&
+Tree::peel(const Object& obj) {
+  git_object* tree = nullptr;
+  git2Throw(git_object_peel(&tree, obj.raw, GIT_OBJECT_TREE));
+  this->raw = reinterpret_cast<git_tree*>(tree);  // NOLINT
+  return *this;
+}
+
+DiffOptions::DiffOptions() {
+  git2Throw(git_diff_options_init(&this->raw, GIT_DIFF_OPTIONS_VERSION));
+}
+
+DiffOptions&
+DiffOptions::includeUntracked(const bool include) {
+  constexpr unsigned int flags =
+      GIT_DIFF_INCLUDE_UNTRACKED | GIT_DIFF_RECURSE_UNTRACKED_DIRS;
+  if (include) {
+    this->raw.flags |= flags;
+  } else {
+    this->raw.flags &= ~flags;
+  }
+  return *this;
+}
+
+Diff::~Diff() {
+  git_diff_free(this->raw);
+}
+
+Diff&
+Diff::treeToWorkdirWithIndex(
+    const Repository& repo, const Tree& tree, const DiffOptions& opts
+) {
+  git2Throw(git_diff_tree_to_workdir_with_index(
+      &this->raw, repo.raw, tree.raw, &opts.raw
+  ));
+  return *this;
+}
+
+std::vector<std::string>
+Diff::paths() const {
+  std::vector<std::string> paths;
+  const size_t numDeltas = git_diff_num_deltas(this->raw);
+  for (size_t i = 0; i < numDeltas; ++i) {
+    const git_diff_delta* delta = git_diff_get_delta(this->raw, i);
+    paths.emplace_back(delta->new_file.path);
+    if (std::string(delta->old_file.path) != delta->new_file.path) {
+      paths.emplace_back(delta->old_file.path);
+    }
+  }
+  return paths;
+}
+
+}  // namespace git2
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Global.hpp"
+#include "Object.hpp"
+#include "Repository.hpp"
+
+#include <git2/diff.h>
+#include <git2/tree.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+struct Tree : public GlobalState {
+  git_tree* raw = nullptr;
+
+  Tree() = default;
+  ~Tree();
+
+  Tree(const Tree&) = delete;
+  Tree(Tree&&) noexcept = default;
+  Tree& operator=(const Tree&) = delete;
+  Tree& operator=(Tree&&) noexcept = default;
+
+  /// Get the tree an object, e.g., a commit, points to.
+  Tree& peel(const Object& obj);
+};
+
+struct DiffOptions : public GlobalState {
+  git_diff_options raw{};
+
+  DiffOptions();
+  ~DiffOptions() noexcept = default;
+
+  DiffOptions(const DiffOptions&) = default;
+  DiffOptions& operator=(const DiffOptions&) = default;
+  DiffOptions(DiffOptions&&) = default;
+  DiffOptions& operator=(DiffOptions&&) = default;
+
+  /// Include untracked files, recursing into untracked directories.
+  DiffOptions& includeUntracked(bool include);
+};
+
+struct Diff : public GlobalState {
+  git_diff* raw = nullptr;
+
+  Diff() = default;
+  ~Diff();
+
+  Diff(const Diff&) = delete;
+  Diff(Diff&&) noexcept = default;
+  Diff& operator=(const Diff&) = delete;
+  Diff& operator=(Diff&&) noexcept = default;
+
+  /// Create a diff between a tree and the working directory using index data
+  /// to account for staged deletes, tracked files, etc.
+  ///
+  /// This emulates `git diff <tree>`.
+  Diff& treeToWorkdirWithIndex(
+      const Repository& repo, const Tree& tree, const DiffOptions& opts
+  );
+
+  /// Get the paths, relative to the working directory, of the files the
+  /// deltas touch.  Both sides of renames are included.
+  std::vector<std::string> paths() const;
+};
+
+}  // namespace git2
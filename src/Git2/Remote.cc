@@ -0,0 +1,71 @@
+#include "Remote.hpp"
+
+#include "Exception.hpp"
+#include "Repository.hpp"
+
+#include <git2/remote.h>
+#include <git2/version.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+FetchOptions::FetchOptions() {
+  git2Throw(git_fetch_options_init(&this->raw, GIT_FETCH_OPTIONS_VERSION));
+}
+
+FetchOptions&
+FetchOptions::depth([[maybe_unused]] const int depth) {
+#if (LIBGIT2_VER_MAJOR >= 1) && (LIBGIT2_VER_MINOR >= 7)
+  this->raw.depth = depth;
+#endif
+  return *this;
+}
+
+FetchOptions&
+FetchOptions::downloadTags(const bool download) {
+  this->raw.download_tags = download ? GIT_REMOTE_DOWNLOAD_TAGS_AUTO
+                                     : GIT_REMOTE_DOWNLOAD_TAGS_NONE;
+  return *this;
+}
+
+Remote::~Remote() noexcept {
+  git_remote_free(this->raw);
+}
+
+Remote&
+Remote::create(
+    const Repository& repo, const std::string& name, const std::string& url
+) {
+  git2Throw(git_remote_create(&this->raw, repo.raw, name.c_str(), url.c_str())
+  );
+  return *this;
+}
+
+Remote&
+Remote::lookup(const Repository& repo, const std::string& name) {
+  git2Throw(git_remote_lookup(&this->raw, repo.raw, name.c_str()));
+  return *this;
+}
+
+Remote&
+Remote::fetch(
+    const std::vector<std::string>& refspecs, const FetchOptions& opts,
+    const std::string& reflogMsg
+) {
+  std::vector<char*> strings;
+  strings.reserve(refspecs.size());
+  for (const std::string& refspec : refspecs) {
+    // libgit2 does not modify them.
+    strings.push_back(const_cast<char*>(refspec.c_str()));  // NOLINT
+  }
+  const git_strarray arr{ .strings = strings.data(), .count = strings.size() };
+
+  git2Throw(git_remote_fetch(
+      this->raw, refspecs.empty() ? nullptr : &arr, &opts.raw,
+      reflogMsg.empty() ? nullptr : reflogMsg.c_str()
+  ));
+  return *this;
+}
+
+}  // end namespace git2
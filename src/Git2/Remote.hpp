@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Global.hpp"
+#include "Repository.hpp"
+
+#include <git2/remote.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+struct FetchOptions : public GlobalState {
+  git_fetch_options raw{};
+
+  FetchOptions();
+  ~FetchOptions() noexcept = default;
+
+  FetchOptions(const FetchOptions&) = default;
+  FetchOptions& operator=(const FetchOptions&) = default;
+  FetchOptions(FetchOptions&&) = default;
+  FetchOptions& operator=(FetchOptions&&) = default;
+
+  /// Set the number of commits to fetch from the tip of each ref.
+  ///
+  /// Zero fetches the full history.  Shallow fetches require libgit2 1.7 or
+  /// later; with older versions, this is a no-op.
+  FetchOptions& depth(int depth);
+
+  /// Set whether tags pointing into the fetched history are also fetched.
+  FetchOptions& downloadTags(bool download);
+};
+
+struct Remote : public GlobalState {
+  git_remote* raw = nullptr;
+
+  Remote() = default;
+  ~Remote() noexcept;
+
+  Remote(const Remote&) = delete;
+  Remote(Remote&&) noexcept = default;
+  Remote& operator=(const Remote&) = delete;
+  Remote& operator=(Remote&&) noexcept = default;
+
+  /// Add a remote with the default fetch refspec to the repository's
+  /// configuration.
+  Remote& create(
+      const Repository& repo, const std::string& name, const std::string& url
+  );
+
+  /// Get the information for a particular remote.
+  Remote& lookup(const Repository& repo, const std::string& name);
+
+  /// Download new data and update tips.
+  ///
+  /// `refspecs` overrides the configured fetch refspecs when not empty.
+  Remote& fetch(
+      const std::vector<std::string>& refspecs, const FetchOptions& opts,
+      const std::string& reflogMsg = ""
+  );
+};
+
+}  // end namespace git2
@@ -8,6 +8,7 @@
 #include <git2/repository.h>
 #include <git2/revparse.h>
 #include <string>
+#include <vector>
 
 namespace git2 {
 
@@ -21,6 +22,11 @@ Repository::open(const std::string& path) {
   return *this;
 }
 Repository&
+Repository::discover(const std::string& path) {
+  git2Throw(git_repository_open_ext(&this->raw, path.c_str(), 0, nullptr));
+  return *this;
+}
+Repository&
 Repository::openBare(const std::string& path) {
   git2Throw(git_repository_open_bare(&this->raw, path.c_str()));
   return *this;
@@ -37,6 +43,12 @@ Repository::initBare(const std::string& path) {
   return *this;
 }
 
+std::string
+Repository::workdir() const {
+  const char* workdir = git_repository_workdir(this->raw);
+  return workdir != nullptr ? workdir : "";
+}
+
 bool
 Repository::isIgnored(const std::string& path) const {
   int ignored = 0;
@@ -67,10 +79,19 @@ Repository::setHeadDetached(const Oid& oid) {
 }
 
 Repository&
-Repository::checkoutHead(bool force) {
+Repository::checkoutHead(bool force, const std::vector<std::string>& paths) {
   git_checkout_options opts;
   git2Throw(git_checkout_options_init(&opts, GIT_CHECKOUT_OPTIONS_VERSION));
   opts.checkout_strategy = force ? GIT_CHECKOUT_FORCE : GIT_CHECKOUT_SAFE;
+
+  std::vector<char*> strings;
+  strings.reserve(paths.size());
+  for (const std::string& path : paths) {
+    // libgit2 does not modify them.
+    strings.push_back(const_cast<char*>(path.c_str()));  // NOLINT
+  }
+  opts.paths = { .strings = strings.data(), .count = strings.size() };
+
   git2Throw(git_checkout_head(this->raw, &opts));
   return *this;
 }
@@ -8,6 +8,7 @@
 #include <git2/clone.h>
 #include <git2/repository.h>
 #include <string>
+#include <vector>
 
 namespace git2 {
 
@@ -26,6 +27,9 @@ struct Repository : public GlobalState {
   ///
   /// The path can point to either a normal or bare repository.
   Repository& open(const std::string& path);
+  /// Find and open the repository containing `path`, searching the parent
+  /// directories as git does.
+  Repository& discover(const std::string& path);
   /// Attempt to open an already-existing bare repository at `path`.
   ///
   /// The path can point to only a bare repository.
@@ -42,6 +46,11 @@ struct Repository : public GlobalState {
   /// The folder must exist prior to invoking this function.
   Repository& initBare(const std::string& path);
 
+  /// Get the path of the working directory, with a trailing slash.
+  ///
+  /// Returns an empty string for a bare repository.
+  std::string workdir() const;
+
   /// Check if path is ignored by the ignore rules.
   bool isIgnored(const std::string& path) const;
 
@@ -58,7 +67,12 @@ struct Repository : public GlobalState {
   Repository& setHeadDetached(const Oid& oid);
 
   /// Checkout current HEAD
-  Repository& checkoutHead(bool force = false);
+  ///
+  /// If `paths` is not empty, only the files matching these pathspecs are
+  /// checked out.
+  Repository& checkoutHead(
+      bool force = false, const std::vector<std::string>& paths = {}
+  );
 
   /// Lookup a reference by name and resolve immediately to OID.
   Oid refNameToId(const std::string& refname) const;
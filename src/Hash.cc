@@ -0,0 +1,108 @@
+#include "Hash.hpp"
+
+#include <cstdint>
+#include <fmt/core.h>
+#include <string>
+#include <string_view>
+
+Hasher&
+Hasher::update(const std::string_view data) noexcept {
+  constexpr uint64_t prime = 0x100000001b3;
+  for (const char c : data) {
+    state ^= static_cast<unsigned char>(c);
+    state *= prime;
+  }
+  return *this;
+}
+
+Hasher&
+Hasher::updateField(const std::string_view data) noexcept {
+  update(data);
+  return update(std::string_view("\0", 1));
+}
+
+std::string
+Hasher::hexDigest() const {
+  return fmt::format("{:016x}", state);
+}
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+static void
+testUpdate() {
+  // Test vectors from the reference implementation.
+  assertEq(Hasher().digest(), 0xcbf29ce484222325);
+  assertEq(Hasher().update("a").digest(), 0xaf63dc4c8601ec8c);
+  assertEq(Hasher().update("foobar").digest(), 0x85944171f73967e8);
+
+  // Streaming is equivalent to hashing at once.
+  assertEq(
+      Hasher().update("foo").update("bar").digest(),
+      Hasher().update("foobar").digest()
+  );
+
+  pass();
+}
+
+static void
+testUpdateField() {
+  assertTrue(
+      Hasher().updateField("ab").updateField("c").digest()
+      != Hasher().updateField("a").updateField("bc").digest()
+  );
+
+  pass();
+}
+
+static void
+testHexDigest() {
+  assertEq(Hasher().hexDigest(), "cbf29ce484222325");
+  assertEq(Hasher().update("a").hexDigest(), "af63dc4c8601ec8c");
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testUpdate();
+  tests::testUpdateField();
+  tests::testHexDigest();
+}
+
+#endif
+
+#ifdef POAC_BENCH
+
+#  include "Rustify/Bench.hpp"
+
+#  include <string>
+
+namespace benches {
+
+static void
+benchUpdateSmall() {
+  const std::string data = "https://github.com/ToruNiina/toml11.git";
+  run([&] { doNotOptimize(Hasher().update(data).digest()); });
+}
+
+static void
+benchUpdateLarge() {
+  const std::string data(64 * 1024, 'x');
+  run([&] { doNotOptimize(Hasher().update(data).digest()); });
+}
+
+}  // namespace benches
+
+int
+main() {
+  benches::benchUpdateSmall();
+  benches::benchUpdateLarge();
+}
+
+#endif
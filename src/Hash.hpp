@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Streaming 64-bit FNV-1a.  This is not a cryptographic hash; it is meant for
+// cache keys and change detection.
+class Hasher {
+  uint64_t state = 0xcbf29ce484222325;
+
+public:
+  Hasher& update(std::string_view data) noexcept;
+  // Separates fields so that, e.g., ("ab", "c") and ("a", "bc") differ.
+  Hasher& updateField(std::string_view data) noexcept;
+
+  uint64_t digest() const noexcept {
+    return state;
+  }
+  // Returns the digest as 16 lowercase hex digits.
+  std::string hexDigest() const;
+};
@@ -0,0 +1,481 @@
+#include "Http.hpp"
+
+#include "Algos.hpp"
+#include "Exception.hpp"
+#include "Hash.hpp"
+#include "Logger.hpp"
+#include "Rustify.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <curl/curl.h>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace http {
+
+// Like browsers, when a host does not support HTTP/2.
+static constexpr long MAX_HOST_CONNECTIONS = 6;  // NOLINT(google-runtime-int)
+static constexpr int POLL_TIMEOUT_MS = 1000;
+
+struct CacheEntry {
+  std::string etag;
+  std::string body;
+};
+
+struct Transfer {
+  CURL* handle = nullptr;
+  curl_slist* headers = nullptr;
+  std::string body;
+  // The ETag of the response.
+  std::string etag;
+  std::optional<CURLcode> result;
+  // Where the response is cached, for GET requests with a cache directory.
+  std::optional<fs::path> cachePath;
+  // What the request was made conditional on.
+  std::optional<CacheEntry> cached;
+};
+
+static size_t
+writeCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+  static_cast<std::string*>(userdata)->append(ptr, size * nmemb);
+  return size * nmemb;
+}
+
+static size_t
+headerCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+  std::string_view line(ptr, size * nmemb);
+  std::string& etag = *static_cast<std::string*>(userdata);
+
+  constexpr std::string_view etagField = "etag:";
+  if (line.starts_with("HTTP/")) {
+    // The headers of another response, e.g., after a redirect.
+    etag.clear();
+  } else if (line.size() > etagField.size()
+             && std::ranges::equal(
+                 line.substr(0, etagField.size()), etagField,
+                 [](const char lhs, const char rhs) {
+                   return std::tolower(lhs) == rhs;
+                 }
+             )) {
+    line.remove_prefix(etagField.size());
+    const size_t begin = line.find_first_not_of(" \t");
+    const size_t end = line.find_last_not_of(" \t\r\n");
+    if (begin != std::string_view::npos) {
+      etag = line.substr(begin, end - begin + 1);
+    }
+  }
+  return size * nmemb;
+}
+
+// Cache entries are the ETag on the first line and the body after it.
+static std::optional<CacheEntry>
+readCacheEntry(const fs::path& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  CacheEntry entry;
+  if (!ifs || !std::getline(ifs, entry.etag) || entry.etag.empty()) {
+    return std::nullopt;
+  }
+  entry.body.assign(
+      std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()
+  );
+  return entry;
+}
+
+static void
+writeCacheEntry(
+    const fs::path& path, const std::string_view etag,
+    const std::string_view body
+) {
+  try {
+    fs::create_directories(path.parent_path());
+    std::string content(etag);
+    content += '\n';
+    content += body;
+    writeFileAtomically(path, content);
+  } catch (const fs::filesystem_error& e) {
+    logger::debug("failed to cache the response: {}", e.what());
+  }
+}
+
+Client::Client() : multi(curl_multi_init()) {
+  if (multi == nullptr) {
+    throw PoacError("curl_multi_init() failed");
+  }
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, MAX_HOST_CONNECTIONS);
+}
+
+Client::~Client() {
+  for (CURL* handle : idleHandles) {
+    curl_easy_cleanup(handle);
+  }
+  curl_multi_cleanup(multi);
+}
+
+Client&
+Client::setCacheDir(fs::path dir) {
+  cacheDir = std::move(dir);
+  return *this;
+}
+
+Response
+Client::send(const Request& request) {
+  return std::move(sendAll(std::span(&request, 1))[0]);
+}
+
+std::vector<Response>
+Client::sendAll(const std::span<const Request> requests) {
+  std::vector<Transfer> transfers(requests.size());
+  const auto release = [&] {
+    for (Transfer& transfer : transfers) {
+      if (transfer.handle == nullptr) {
+        continue;
+      }
+      curl_multi_remove_handle(multi, transfer.handle);
+      curl_slist_free_all(transfer.headers);
+      idleHandles.push_back(std::exchange(transfer.handle, nullptr));
+    }
+  };
+
+  try {
+    for (size_t i = 0; i < requests.size(); ++i) {
+      const Request& request = requests[i];
+      Transfer& transfer = transfers[i];
+
+      CURL* handle = nullptr;
+      if (idleHandles.empty()) {
+        handle = curl_easy_init();
+        if (handle == nullptr) {
+          throw PoacError("curl_easy_init() failed");
+        }
+      } else {
+        // Resetting keeps the connections and the DNS cache.
+        handle = idleHandles.back();
+        idleHandles.pop_back();
+        curl_easy_reset(handle);
+      }
+      transfer.handle = handle;
+
+      curl_easy_setopt(handle, CURLOPT_URL, request.url.c_str());
+      curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+      curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeCallback);
+      curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer.body);
+      curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, headerCallback);
+      curl_easy_setopt(handle, CURLOPT_HEADERDATA, &transfer.etag);
+      // Every encoding libcurl was built with, e.g., gzip and br.
+      curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+      curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+      // Wait for a connection to multiplex on rather than opening another.
+      curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+
+      if (request.body.has_value()) {
+        curl_easy_setopt(
+            handle, CURLOPT_POSTFIELDSIZE_LARGE,
+            static_cast<curl_off_t>(request.body->size())
+        );
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request.body->c_str());
+      } else if (cacheDir.has_value()) {
+        transfer.cachePath =
+            cacheDir.value() / Hasher().updateField(request.url).hexDigest();
+        transfer.cached = readCacheEntry(transfer.cachePath.value());
+        if (transfer.cached.has_value()) {
+          transfer.headers = curl_slist_append(
+              transfer.headers,
+              ("If-None-Match: " + transfer.cached->etag).c_str()
+          );
+        }
+      }
+      for (const std::string& header : request.headers) {
+        transfer.headers = curl_slist_append(transfer.headers, header.c_str());
+      }
+      curl_easy_setopt(handle, CURLOPT_HTTPHEADER, transfer.headers);
+
+      if (const CURLMcode code = curl_multi_add_handle(multi, handle);
+          code != CURLM_OK) {
+        throw PoacError(
+            "curl_multi_add_handle() failed: ", curl_multi_strerror(code)
+        );
+      }
+    }
+
+    int running = 0;
+    do {
+      CURLMcode code = curl_multi_perform(multi, &running);
+      if (code == CURLM_OK && running > 0) {
+        code = curl_multi_poll(multi, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+      }
+      if (code != CURLM_OK) {
+        throw PoacError(
+            "curl_multi_perform() failed: ", curl_multi_strerror(code)
+        );
+      }
+
+      int numMsgs = 0;
+      while (const CURLMsg* msg = curl_multi_info_read(multi, &numMsgs)) {
+        if (msg->msg != CURLMSG_DONE) {
+          continue;
+        }
+        const auto transfer = std::ranges::find(
+            transfers, msg->easy_handle, &Transfer::handle
+        );
+        if (transfer != transfers.end()) {
+          transfer->result = msg->data.result;
+        }
+      }
+    } while (running > 0);
+  } catch (...) {
+    release();
+    throw;
+  }
+
+  std::vector<Response> responses(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    Transfer& transfer = transfers[i];
+    Response& response = responses[i];
+    if (!transfer.result.has_value()) {
+      response.error = "the transfer did not finish";
+      continue;
+    }
+    if (transfer.result.value() != CURLE_OK) {
+      response.error = curl_easy_strerror(transfer.result.value());
+      continue;
+    }
+
+    curl_easy_getinfo(
+        transfer.handle, CURLINFO_RESPONSE_CODE, &response.status
+    );
+    constexpr long notModified = 304;  // NOLINT(google-runtime-int)
+    if (response.status == notModified && transfer.cached.has_value()) {
+      constexpr long ok = 200;  // NOLINT(google-runtime-int)
+      response.status = ok;
+      response.body = std::move(transfer.cached->body);
+      response.fromCache = true;
+      continue;
+    }
+    response.body = std::move(transfer.body);
+    if (response.ok() && transfer.cachePath.has_value()
+        && !transfer.etag.empty()) {
+      writeCacheEntry(
+          transfer.cachePath.value(), transfer.etag, response.body
+      );
+    }
+  }
+  release();
+  return responses;
+}
+
+}  // namespace http
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <arpa/inet.h>
+#  include <array>
+#  include <atomic>
+#  include <cstdint>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <thread>
+#  include <unistd.h>
+
+namespace tests {
+
+// A stand-in HTTP server on localhost serving one request per connection:
+//   GET /etag   -> "cached content" with an ETag, or 304 if it matches
+//   POST /echo  -> the request body
+//   otherwise   -> 404
+class StandIn {
+  int listenFd = -1;
+  uint16_t port = 0;
+  std::thread thread;
+
+public:
+  std::atomic<size_t> numRequests = 0;
+  std::atomic<size_t> numNotModified = 0;
+
+  StandIn() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), len) != 0
+        || listen(listenFd, SOMAXCONN) != 0
+        || getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &len)
+               != 0) {
+      throw PoacError("failed to start the stand-in server");
+    }
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+    port = ntohs(addr.sin_port);
+    thread = std::thread([this] { serve(); });
+  }
+  StandIn(const StandIn&) = delete;
+  StandIn(StandIn&&) = delete;
+  StandIn& operator=(const StandIn&) = delete;
+  StandIn& operator=(StandIn&&) = delete;
+  ~StandIn() {
+    // Makes accept() fail.
+    shutdown(listenFd, SHUT_RDWR);
+    thread.join();
+    close(listenFd);
+  }
+
+  std::string url(const std::string_view path) const {
+    return "http://127.0.0.1:" + std::to_string(port) + std::string(path);
+  }
+
+private:
+  void serve() {
+    while (true) {
+      const int fd = accept(listenFd, nullptr, nullptr);
+      if (fd < 0) {
+        return;
+      }
+      respond(fd);
+      close(fd);
+    }
+  }
+
+  void respond(const int fd) {
+    std::string req;
+    std::array<char, 4096> buf{};  // NOLINT(*-magic-numbers)
+    size_t headerEnd = std::string::npos;
+    size_t contentLength = 0;
+    while (headerEnd == std::string::npos
+           || req.size() < headerEnd + 4 + contentLength) {
+      const ssize_t n = read(fd, buf.data(), buf.size());
+      if (n <= 0) {
+        return;
+      }
+      req.append(buf.data(), static_cast<size_t>(n));
+      if (headerEnd == std::string::npos) {
+        headerEnd = req.find("\r\n\r\n");
+        if (const size_t pos = req.find("Content-Length: ");
+            pos != std::string::npos && pos < headerEnd) {
+          contentLength = std::stoul(req.substr(pos + 16));
+        }
+      }
+    }
+    ++numRequests;
+
+    std::string status = "404 Not Found";
+    std::string body = "not found";
+    std::string extraHeaders;
+    if (req.starts_with("GET /etag ")) {
+      extraHeaders = "ETag: \"v1\"\r\n";
+      if (req.find("If-None-Match: \"v1\"\r\n") < headerEnd) {
+        ++numNotModified;
+        status = "304 Not Modified";
+        body.clear();
+      } else {
+        status = "200 OK";
+        body = "cached content";
+      }
+    } else if (req.starts_with("POST /echo ")) {
+      status = "200 OK";
+      body = req.substr(headerEnd + 4);
+    }
+
+    const std::string res =
+        "HTTP/1.1 " + status + "\r\nContent-Length: "
+        + std::to_string(body.size()) + "\r\nConnection: close\r\n"
+        + extraHeaders + "\r\n" + body;
+    if (write(fd, res.data(), res.size()) < 0) {
+      return;
+    }
+  }
+};
+
+static void
+testSendAll() {
+  StandIn standIn;
+  http::Client client;
+
+  const std::vector<http::Request> requests = {
+    { .url = standIn.url("/etag"), .body = std::nullopt, .headers = {} },
+    { .url = standIn.url("/echo"),
+      .body = "hello",
+      .headers = { "Content-Type: text/plain" } },
+    { .url = standIn.url("/missing"), .body = std::nullopt, .headers = {} },
+  };
+  // Handles are reused by the second batch.
+  for (int round = 0; round < 2; ++round) {
+    const std::vector<http::Response> responses = client.sendAll(requests);
+    assertEq(responses.size(), static_cast<size_t>(3));
+    assertTrue(responses[0].ok());
+    assertEq(responses[0].body, "cached content");
+    assertFalse(responses[0].fromCache);
+    assertTrue(responses[1].ok());
+    assertEq(responses[1].body, "hello");
+    assertFalse(responses[2].ok());
+    assertEq(responses[2].status, 404L);
+  }
+  assertEq(standIn.numRequests.load(), static_cast<size_t>(6));
+
+  pass();
+}
+
+static void
+testETagCache() {
+  const TempDir tmpDir("poac-test-http");
+  const fs::path& cacheDir = tmpDir.path();
+  StandIn standIn;
+  http::Client client;
+  client.setCacheDir(cacheDir);
+
+  const http::Request request{ .url = standIn.url("/etag"),
+                               .body = std::nullopt,
+                               .headers = {} };
+  const http::Response first = client.send(request);
+  assertTrue(first.ok());
+  assertFalse(first.fromCache);
+
+  const http::Response second = client.send(request);
+  assertTrue(second.ok());
+  assertTrue(second.fromCache);
+  assertEq(second.body, "cached content");
+  assertEq(standIn.numNotModified.load(), static_cast<size_t>(1));
+
+  // POST requests are not cached.
+  const http::Response echo = client.send(
+      { .url = standIn.url("/echo"), .body = "x", .headers = {} }
+  );
+  assertEq(echo.body, "x");
+  assertFalse(echo.fromCache);
+
+  pass();
+}
+
+static void
+testTransferError() {
+  http::Client client;
+  const http::Response response = client.send(
+      { .url = "http://127.0.0.1:1/", .body = std::nullopt, .headers = {} }
+  );
+  assertFalse(response.ok());
+  assertFalse(response.error.empty());
+  assertEq(response.status, 0L);
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testSendAll();
+  tests::testETagCache();
+  tests::testTransferError();
+}
+
+#endif
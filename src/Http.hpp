@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Rustify.hpp"
+
+#include <curl/curl.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace http {
+
+struct Request {
+  std::string url;
+  // Sent with POST if set; otherwise, GET is used.
+  std::optional<std::string> body;
+  // e.g., "Content-Type: application/json"
+  std::vector<std::string> headers;
+};
+
+struct Response {
+  // Set if the transfer failed, in which case `status` is 0.
+  std::string error;
+  long status = 0;  // NOLINT(google-runtime-int)
+  std::string body;
+  // Whether `body` was read from the cache because the server responded
+  // with 304 Not Modified.
+  bool fromCache = false;
+
+  bool ok() const noexcept {
+    // NOLINTNEXTLINE(*-magic-numbers)
+    return error.empty() && 200 <= status && status < 300;
+  }
+};
+
+// An HTTP client on the libcurl multi interface.  Transfers of a batch run
+// concurrently from the calling thread, and a client keeps its connections
+// open across batches, multiplexing requests to a host over HTTP/2 when the
+// server supports it.  Responses are decompressed transparently.
+//
+// With a cache directory, GET responses carrying an ETag are stored there,
+// and later requests of the same URL are made conditional, so unchanged
+// resources are not transferred again.
+class Client {
+  CURLM* multi;
+  // Finished handles kept for reuse; their connections stay in the pool of
+  // `multi`.
+  std::vector<CURL*> idleHandles;
+  std::optional<fs::path> cacheDir;
+
+public:
+  Client();
+  Client(const Client&) = delete;
+  Client(Client&&) = delete;
+  Client& operator=(const Client&) = delete;
+  Client& operator=(Client&&) = delete;
+  ~Client();
+
+  Client& setCacheDir(fs::path dir);
+
+  Response send(const Request& request);
+  // Sends `requests` concurrently and returns the responses in their order.
+  // Throws PoacError only if libcurl itself fails; failed transfers are
+  // reported in their responses.
+  std::vector<Response> sendAll(std::span<const Request> requests);
+};
+
+}  // namespace http
@@ -1,24 +1,42 @@
 #include "Manifest.hpp"
 
 #include "Algos.hpp"
+#include "BuildEvents.hpp"
 #include "Exception.hpp"
 #include "Git2.hpp"
+#include "Hash.hpp"
 #include "Logger.hpp"
+#include "Parallelism.hpp"
 #include "Rustify.hpp"
 #include "Semver.hpp"
 #include "TermColor.hpp"
 #include "VersionReq.hpp"
 
+#include <algorithm>
 #include <cctype>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <exception>
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
 #include <optional>
+#include <semaphore>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <toml.hpp>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -122,14 +140,28 @@ struct GitDependency {
   std::string name;
   std::string url;
   std::optional<std::string> target;
+  // Check out only the include directory.
+  bool headerOnly = false;
 
+  // Identifies the installation across workspace members.
+  std::string installKey() const {
+    return fmt::format(
+        "git:{}#{}{}", url, target.value_or(""), headerOnly ? ":include" : ""
+    );
+  }
   DepMetadata install() const;
+  // Installs into `srcDir` through the mirror of `url` under `dbDir`.
+  DepMetadata install(const fs::path& srcDir, const fs::path& dbDir) const;
 };
 
 struct SystemDependency {
   std::string name;
   VersionReq versionReq;
 
+  // Identifies the installation across workspace members.
+  std::string installKey() const {
+    return fmt::format("system:{} {}", name, versionReq.toString());
+  }
   DepMetadata install() const;
 };
 
@@ -147,8 +179,14 @@ Profile::merge(const Profile& other) {
   }
 }
 
+// The manifest of the workspace member currently being configured, if any.
+// See ManifestScope.  It is only written outside of parallel regions, but
+// the member manifests are reached from the parallel installation of
+// dependencies, so they are loaded under a lock.
+static std::optional<fs::path> scopedManifestPath = std::nullopt;
+
 struct Manifest {
-  // Manifest is a singleton
+  // Manifest is a singleton per manifest path
   Manifest(const Manifest&) = delete;
   Manifest(Manifest&&) noexcept = delete;
   Manifest& operator=(const Manifest&) = delete;
@@ -156,11 +194,31 @@ struct Manifest {
   ~Manifest() noexcept = default;
 
   static Manifest& instance() {
+    if (scopedManifestPath.has_value()) {
+      return member(scopedManifestPath.value());
+    }
+    return root();
+  }
+
+  static Manifest& root() {
     static Manifest instance;
     instance.load();
     return instance;
   }
 
+  static Manifest& member(const fs::path& path) {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::unique_ptr<Manifest>> members;
+    const std::lock_guard lock(mutex);
+    std::unique_ptr<Manifest>& instance = members[path.string()];
+    if (!instance) {
+      instance.reset(new Manifest());
+      instance->manifestPath = path;
+    }
+    instance->load();
+    return *instance;
+  }
+
   std::optional<fs::path> manifestPath = std::nullopt;
 
   std::optional<toml::value> data = std::nullopt;
@@ -177,6 +235,8 @@ struct Manifest {
 
   std::optional<std::vector<std::string>> cpplintFilters = std::nullopt;
 
+  std::optional<std::vector<fs::path>> workspaceMembers = std::nullopt;
+
 private:
   Manifest() noexcept = default;
 
@@ -191,7 +251,9 @@ private:
       toml::color::disable();
     }
 
-    manifestPath = findManifest();
+    if (!manifestPath.has_value()) {
+      manifestPath = findManifest();
+    }
     data = toml::parse(manifestPath.value());
   }
 };
@@ -206,6 +268,109 @@ getProjectBasePath() {
   return fs::absolute(getManifestPath().parent_path());
 }
 
+ManifestScope::ManifestScope(const fs::path& projectDir)
+    : prevManifestPath(scopedManifestPath) {
+  scopedManifestPath = fs::absolute(projectDir / "poac.toml");
+  if (!fs::exists(scopedManifestPath.value())) {
+    const fs::path manifestPath = scopedManifestPath.value();
+    scopedManifestPath = prevManifestPath;
+    throw PoacError("could not find `", manifestPath.string(), "`");
+  }
+}
+
+ManifestScope::~ManifestScope() noexcept {
+  scopedManifestPath = prevManifestPath;
+}
+
+static void
+addWorkspaceMember(
+    std::vector<fs::path>& members, const fs::path& memberDir,
+    const std::string_view member
+) {
+  if (!fs::exists(memberDir / "poac.toml")) {
+    throw PoacError(
+        "workspace member `", member, "` does not contain `poac.toml`"
+    );
+  }
+  if (std::ranges::find(members, memberDir) == members.end()) {
+    members.push_back(memberDir);
+  }
+}
+
+static std::vector<fs::path>
+parseWorkspaceMembers(const toml::value& data, const fs::path& rootDir) {
+  std::vector<fs::path> members;
+  const auto& table = toml::get<toml::table>(data);
+  if (!table.contains("workspace")) {
+    return members;
+  }
+  if (!table.at("workspace").is_table()) {
+    throw PoacError("[workspace] must be a table");
+  }
+
+  if (table.contains("package")) {
+    // The root package is built along with the members.
+    members.push_back(rootDir);
+  }
+
+  const auto memberNames = toml::find_or<std::vector<std::string>>(
+      data, "workspace", "members", std::vector<std::string>{}
+  );
+  for (const std::string& member : memberNames) {
+    if (member.ends_with("/*")) {
+      // `dir/*` adds every direct subdirectory having a manifest.
+      const fs::path parentDir =
+          rootDir / member.substr(0, member.size() - "/*"sv.size());
+      if (!fs::is_directory(parentDir)) {
+        throw PoacError("workspace member `", member, "` was not found");
+      }
+
+      std::vector<fs::path> memberDirs;
+      for (const auto& entry : fs::directory_iterator(parentDir)) {
+        if (entry.is_directory() && fs::exists(entry.path() / "poac.toml")) {
+          memberDirs.push_back(entry.path().lexically_normal());
+        }
+      }
+      // directory_iterator has no specified order.
+      std::ranges::sort(memberDirs);
+      for (const fs::path& memberDir : memberDirs) {
+        addWorkspaceMember(members, memberDir, member);
+      }
+    } else {
+      addWorkspaceMember(
+          members, (rootDir / member).lexically_normal(), member
+      );
+    }
+  }
+
+  if (members.empty()) {
+    throw PoacError("[workspace] must have at least one member");
+  }
+  return members;
+}
+
+const std::vector<fs::path>&
+getWorkspaceMembers() {
+  Manifest& manifest = Manifest::instance();
+  if (!manifest.workspaceMembers.has_value()) {
+    manifest.workspaceMembers = parseWorkspaceMembers(
+        manifest.data.value(),
+        fs::absolute(manifest.manifestPath.value().parent_path())
+    );
+  }
+  return manifest.workspaceMembers.value();
+}
+
+void
+rejectWorkspaceRoot(const std::string_view command) {
+  if (!getWorkspaceMembers().empty()) {
+    throw PoacError(
+        "`poac ", command,
+        "` does not support workspaces yet; run it in a member directory"
+    );
+  }
+}
+
 // Returns an error message if the package name is invalid.
 std::optional<std::string>  // TODO: result-like types make more sense.
 validatePackageName(const std::string_view name) noexcept {
@@ -441,6 +606,12 @@ getXdgCacheHome() {
 static const fs::path CACHE_DIR(getXdgCacheHome() / "poac");
 static const fs::path GIT_DIR(CACHE_DIR / "git");
 static const fs::path GIT_SRC_DIR(GIT_DIR / "src");
+static const fs::path GIT_DB_DIR(GIT_DIR / "db");
+
+const fs::path&
+getCacheDir() {
+  return CACHE_DIR;
+}
 
 static const std::unordered_set<char> ALLOWED_CHARS = {
   '-', '_', '/', '.', '+'  // allowed in the dependency name
@@ -533,7 +704,17 @@ parseGitDep(const std::string& name, const toml::table& info) {
       }
     }
   }
-  return { .name = name, .url = gitUrlStr, .target = target };
+  bool headerOnly = false;
+  if (info.contains("header_only")) {
+    if (!info.at("header_only").is_boolean()) {
+      throw PoacError("header_only must be a boolean");
+    }
+    headerOnly = info.at("header_only").as_boolean();
+  }
+  return { .name = name,
+           .url = gitUrlStr,
+           .target = target,
+           .headerOnly = headerOnly };
 }
 
 static SystemDependency
@@ -579,25 +760,186 @@ parseDependencies(const char* key) {
   return deps;
 }
 
+// Caps concurrent fetches so that projects with many dependencies do not
+// flood the network or hit rate limits of Git hosts.
+static constexpr std::ptrdiff_t MAX_CONCURRENT_FETCHES = 8;
+static std::counting_semaphore<MAX_CONCURRENT_FETCHES>
+    fetchSlots(MAX_CONCURRENT_FETCHES);
+
+// Holds one of the fetch slots during its lifetime.
+struct FetchSlot {
+  FetchSlot() {
+    fetchSlots.acquire();
+  }
+  ~FetchSlot() noexcept {
+    fetchSlots.release();
+  }
+
+  FetchSlot(const FetchSlot&) = delete;
+  FetchSlot(FetchSlot&&) noexcept = delete;
+  FetchSlot& operator=(const FetchSlot&) = delete;
+  FetchSlot& operator=(FetchSlot&&) noexcept = delete;
+};
+
+static bool
+isFullCommitHash(const std::string_view rev) {
+  return (rev.size() == 40 || rev.size() == 64)
+         && std::ranges::all_of(rev, [](const char c) {
+              return std::isxdigit(static_cast<unsigned char>(c));
+            });
+}
+
+// Returns a plain git_oid; git2::Oid may point into the freed object.
+static std::optional<git_oid>
+resolveCommit(
+    const git2::Repository& repo, const std::vector<std::string>& candidates
+) {
+  for (const std::string& candidate : candidates) {
+    try {
+      return repo.revparseSingle(candidate + "^{commit}").id().oid;
+    } catch (const git2::Exception&) {
+      continue;
+    }
+  }
+  return std::nullopt;
+}
+
+// Brings the commit at `target`, or at the default branch, into the mirror.
+// Commits and tags already in the mirror are not fetched again; otherwise,
+// only that commit is fetched with depth 1, on top of the objects the mirror
+// already has.  If the remote or libgit2 cannot serve it, e.g., for an
+// abbreviated revision, this falls back to fetching everything as `git clone`
+// does.
+static git_oid
+fetchTarget(
+    git2::Repository& mirror, const std::string& url,
+    const std::optional<std::string>& target
+) {
+  std::vector<std::string> refspecs;
+  std::vector<std::string> candidates;
+  bool isImmutable = false;
+  if (!target.has_value()) {
+    refspecs = { "+HEAD:refs/remotes/origin/HEAD" };
+    candidates = { "refs/remotes/origin/HEAD" };
+  } else if (isFullCommitHash(target.value())) {
+    refspecs = { target.value() };
+    candidates = { target.value() };
+    isImmutable = true;
+  } else {
+    // We do not know whether the target is a tag or a branch.
+    refspecs = {
+      fmt::format("+refs/tags/{0}:refs/tags/{0}", target.value()),
+      fmt::format("+refs/heads/{0}:refs/remotes/origin/{0}", target.value()),
+    };
+    candidates = { "refs/tags/" + target.value(),
+                   "refs/remotes/origin/" + target.value() };
+    // Tags are not expected to move, unlike branches.
+    isImmutable = resolveCommit(mirror, { candidates[0] }).has_value();
+  }
+  if (isImmutable) {
+    if (const auto oid = resolveCommit(mirror, candidates)) {
+      logger::debug("{} is already in the mirror", target.value());
+      return oid.value();
+    }
+  }
+
+  const FetchSlot slot;
+  git2::Remote remote;
+  remote.lookup(mirror, "origin");
+  try {
+    remote.fetch(refspecs, git2::FetchOptions().depth(1).downloadTags(false));
+    if (const auto oid = resolveCommit(mirror, candidates)) {
+      return oid.value();
+    }
+  } catch (const git2::Exception& e) {
+    logger::debug("shallow fetch of {} failed: {}", url, e.what());
+  }
+
+  logger::debug("fetching the full history of {}", url);
+  remote.fetch(
+      { "+HEAD:refs/remotes/origin/HEAD", "+refs/heads/*:refs/remotes/origin/*",
+        "+refs/tags/*:refs/tags/*" },
+      git2::FetchOptions()
+  );
+  if (target.has_value()) {
+    candidates.push_back(target.value());
+    candidates.push_back("origin/" + target.value());
+  }
+  if (const auto oid = resolveCommit(mirror, candidates)) {
+    return oid.value();
+  }
+  throw PoacError("revision `", target.value_or("HEAD"), "` was not found");
+}
+
+// Updates the bare mirror of `url`, creating it if needed, so that it
+// contains `target`.  All the checkouts of the repository share its objects.
+static git_oid
+updateMirror(
+    const fs::path& mirrorDir, const std::string& url,
+    const std::optional<std::string>& target
+) {
+  // Revisions of the same repository may be installed concurrently, by this
+  // process or by others.
+  fs::create_directories(mirrorDir.parent_path());
+  const FileLock lock(mirrorDir.string() + ".lock");
+
+  git2::Repository mirror;
+  if (fs::exists(mirrorDir / "HEAD")) {
+    mirror.openBare(mirrorDir.string());
+  } else {
+    fs::create_directories(mirrorDir);
+    mirror.initBare(mirrorDir.string());
+    git2::Remote().create(mirror, "origin", url);
+  }
+
+  return fetchTarget(mirror, url, target);
+}
+
 DepMetadata
 GitDependency::install() const {
-  fs::path installDir = GIT_SRC_DIR / name;
+  return install(GIT_SRC_DIR, GIT_DB_DIR);
+}
+
+DepMetadata
+GitDependency::install(const fs::path& srcDir, const fs::path& dbDir) const {
+  fs::path installDir = srcDir / name;
   if (target.has_value()) {
     installDir += '-' + target.value();
   }
+  if (headerOnly) {
+    installDir += "-include";
+  }
 
   if (fs::exists(installDir) && !fs::is_empty(installDir)) {
     logger::debug("{} is already installed", name);
+    emitEvent("cache-hit", { { "kind", "git" }, { "name", name } });
   } else {
-    git2::Repository repo;
-    repo.clone(url, installDir.string());
-
-    if (target.has_value()) {
-      // Checkout to target.
-      const std::string target = this->target.value();
-      const git2::Object obj = repo.revparseSingle(target);
-      repo.setHeadDetached(obj.id());
-      repo.checkoutHead(true);
+    // One mirror per URL, whatever the dependency is named.
+    const fs::path mirrorDir = dbDir / Hasher().update(url).hexDigest();
+    const git_oid oid = updateMirror(mirrorDir, url, target);
+
+    try {
+      git2::Repository repo;
+      repo.init(installDir.string());
+
+      // Borrow the objects of the mirror instead of copying them.
+      std::ofstream(installDir / ".git" / "objects" / "info" / "alternates")
+          << fs::absolute(mirrorDir / "objects").string() << '\n';
+
+      // Reopen to load the alternates.
+      git2::Repository checkout;
+      checkout.open(installDir.string());
+      checkout.setHeadDetached(git2::Oid(oid));
+      if (headerOnly) {
+        checkout.checkoutHead(true, { "include" });
+      }
+      if (!headerOnly || !fs::exists(installDir / "include")) {
+        checkout.checkoutHead(true);
+      }
+    } catch (...) {
+      // Do not leave a partial installation behind.
+      fs::remove_all(installDir);
+      throw;
     }
 
     logger::info(
@@ -615,13 +957,163 @@ GitDependency::install() const {
     includes += installDir.string();
   }
 
-  // Currently, no libs are supported.
+  if (fs::is_directory(installDir / "src")
+      && fs::exists(installDir / "poac.toml")) {
+    // A poac package with sources; BuildConfig builds and links its library.
+    return { .includes = includes, .libs = "", .packageDir = installDir };
+  }
   return { .includes = includes, .libs = "" };
 }
 
+// pkg-config results are cached here across runs.  An entry is valid while
+// the .pc files it was resolved from are unchanged.
+static const fs::path PKG_CONFIG_CACHE_PATH(CACHE_DIR / "pkg-config.json");
+
+// Guards pkgConfigCache, as dependencies are installed concurrently.
+static std::mutex pkgConfigCacheMtx;
+static std::optional<nlohmann::json> pkgConfigCache = std::nullopt;
+
+static nlohmann::json&
+loadPkgConfigCache() {
+  if (pkgConfigCache.has_value()) {
+    return pkgConfigCache.value();
+  }
+
+  pkgConfigCache = nlohmann::json::object();
+  if (std::ifstream ifs(PKG_CONFIG_CACHE_PATH); ifs) {
+    try {
+      nlohmann::json cache = nlohmann::json::parse(ifs);
+      if (cache.is_object()) {
+        pkgConfigCache = std::move(cache);
+      }
+    } catch (const nlohmann::json::exception& e) {
+      logger::debug("ignoring broken pkg-config cache: {}", e.what());
+    }
+  }
+  return pkgConfigCache.value();
+}
+
+static void
+savePkgConfigCache() {
+  try {
+    fs::create_directories(CACHE_DIR);
+    writeFileAtomically(PKG_CONFIG_CACHE_PATH, pkgConfigCache->dump());
+  } catch (const fs::filesystem_error& e) {
+    logger::debug("failed to save pkg-config cache: {}", e.what());
+  }
+}
+
+static int64_t
+getMtime(const fs::path& path, std::error_code& ec) {
+  return fs::last_write_time(path, ec).time_since_epoch().count();
+}
+
+static std::string
+chomp(std::string str) {
+  if (!str.empty() && str.back() == '\n') {
+    str.pop_back();
+  }
+  return str;
+}
+
+// Lists the .pc files `pkgName` is resolved from, including those of the
+// packages it requires.
+static std::vector<fs::path>
+findPcFiles(const std::string& pkgName) {
+  std::vector<fs::path> pcFiles;
+  std::unordered_set<std::string> visited;
+  std::vector<std::string> stack = { pkgName };
+  while (!stack.empty()) {
+    const std::string name = stack.back();
+    stack.pop_back();
+    if (!visited.insert(name).second) {
+      continue;
+    }
+
+    const std::string pcFileDir = chomp(getCmdOutput(
+        Command("pkg-config").addArg("--variable=pcfiledir").addArg(name)
+    ));
+    pcFiles.push_back(fs::path(pcFileDir) / (name + ".pc"));
+
+    // Each line is a package name optionally followed by a version.
+    std::istringstream iss(getCmdOutput(Command("pkg-config")
+                                            .addArg("--print-requires")
+                                            .addArg("--print-requires-private")
+                                            .addArg(name)));
+    std::string line;
+    while (std::getline(iss, line)) {
+      std::istringstream lineStream(line);
+      std::string required;
+      if (lineStream >> required) {
+        stack.push_back(required);
+      }
+    }
+  }
+  return pcFiles;
+}
+
+// Returns the mtimes of the .pc files `pkgName` is resolved from, keyed by
+// path, or std::nullopt if one of them cannot be found.
+static std::optional<nlohmann::json>
+getPcFileMtimes(const std::string& pkgName) {
+  nlohmann::json pcFiles = nlohmann::json::object();
+  for (const fs::path& pcFile : findPcFiles(pkgName)) {
+    std::error_code ec;
+    const int64_t mtime = getMtime(pcFile, ec);
+    if (ec) {
+      logger::debug("{} was not found", pcFile.string());
+      return std::nullopt;
+    }
+    pcFiles[pcFile.string()] = mtime;
+  }
+  return pcFiles;
+}
+
+static std::optional<DepMetadata>
+lookupPkgConfigCache(const std::string& key) {
+  const nlohmann::json& cache = loadPkgConfigCache();
+  const auto entry = cache.find(key);
+  if (entry == cache.end()) {
+    return std::nullopt;
+  }
+
+  try {
+    for (const auto& [pcFile, mtime] : entry->at("pcFiles").items()) {
+      std::error_code ec;
+      if (getMtime(pcFile, ec) != mtime.get<int64_t>() || ec) {
+        logger::debug("{} has changed", pcFile);
+        return std::nullopt;
+      }
+    }
+    return DepMetadata{ .includes = entry->at("cflags").get<std::string>(),
+                        .libs = entry->at("libs").get<std::string>() };
+  } catch (const nlohmann::json::exception& e) {
+    logger::debug("ignoring broken pkg-config cache entry: {}", e.what());
+    return std::nullopt;
+  }
+}
+
 DepMetadata
 SystemDependency::install() const {
   const std::string pkgConfigVer = versionReq.toPkgConfigString(name);
+
+  // The result also depends on where pkg-config looks for .pc files.
+  std::string key = pkgConfigVer;
+  for (const char* env :
+       { "PKG_CONFIG_PATH", "PKG_CONFIG_LIBDIR", "PKG_CONFIG_SYSROOT_DIR" }) {
+    const char* val = std::getenv(env);
+    key += fmt::format("\n{}={}", env, val != nullptr ? val : "");
+  }
+
+  {
+    const std::lock_guard lock(pkgConfigCacheMtx);
+    if (std::optional<DepMetadata> cached = lookupPkgConfigCache(key)) {
+      logger::debug("{} is cached", pkgConfigVer);
+      emitEvent("cache-hit", { { "kind", "pkg-config" }, { "name", name } });
+      return std::move(cached.value());
+    }
+  }
+
   const Command cflagsCmd =
       Command("pkg-config").addArg("--cflags").addArg(pkgConfigVer);
   const Command libsCmd =
@@ -632,11 +1124,71 @@ SystemDependency::install() const {
   std::string libs = getCmdOutput(libsCmd);
   libs.pop_back();  // remove '\n'
 
+  const std::optional<nlohmann::json> pcFiles = getPcFileMtimes(name);
+  if (!pcFiles.has_value()) {
+    // Never hit the cache if we cannot tell whether it is stale.
+    logger::debug("not caching {}", name);
+    return { .includes = cflags, .libs = libs };
+  }
+
+  {
+    const std::lock_guard lock(pkgConfigCacheMtx);
+    loadPkgConfigCache()[key] = {
+      { "cflags", cflags }, { "libs", libs }, { "pcFiles", pcFiles.value() }
+    };
+    savePkgConfigCache();
+  }
   return { .includes = cflags, .libs = libs };
 }
 
-std::vector<DepMetadata>
-installDependencies(const bool includeDevDeps) {
+// Clones and pkg-config runs are mostly waiting, so the `count`
+// installations run concurrently.  A failure does not stop the others;
+// every failure is reported, named by `nameOf` and in index order, in one
+// PoacError once all of them have finished.
+static void
+installConcurrently(
+    const size_t count, const std::function<std::string(size_t)>& nameOf,
+    const std::function<void(size_t)>& install
+) {
+  std::vector<std::string> errors(count);
+  const auto tryInstall = [&](const size_t j) {
+    try {
+      install(j);
+    } catch (const std::exception& e) {
+      errors[j] = fmt::format("{}: {}", nameOf(j), e.what());
+    }
+  };
+  if (isParallel() && count > 1) {
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, count),
+        [&](const tbb::blocked_range<size_t>& rng) {
+          for (size_t j = rng.begin(); j != rng.end(); ++j) {
+            tryInstall(j);
+          }
+        }
+    );
+  } else {
+    for (size_t j = 0; j < count; ++j) {
+      tryInstall(j);
+    }
+  }
+
+  std::vector<std::string> failures;
+  for (const std::string& error : errors) {
+    if (!error.empty()) {
+      failures.push_back(error);
+    }
+  }
+  if (!failures.empty()) {
+    throw PoacError(fmt::format(
+        "failed to install {} dependencies:\n{}", failures.size(),
+        fmt::join(failures, "\n")
+    ));
+  }
+}
+
+static std::vector<std::variant<GitDependency, SystemDependency>>
+getDependencies(const bool includeDevDeps) {
   Manifest& manifest = Manifest::instance();
   if (!manifest.dependencies.has_value()) {
     manifest.dependencies = parseDependencies("dependencies");
@@ -645,28 +1197,94 @@ installDependencies(const bool includeDevDeps) {
     manifest.devDependencies = parseDependencies("dev-dependencies");
   }
 
-  std::vector<DepMetadata> installed;
+  std::vector<std::variant<GitDependency, SystemDependency>> deps;
   if (manifest.dependencies.has_value()) {
-    for (const auto& dep : manifest.dependencies.value()) {
-      std::visit(
-          [&installed](auto&& arg) { installed.emplace_back(arg.install()); },
-          dep
-      );
-    }
+    deps = manifest.dependencies.value();
   }
   if (includeDevDeps && manifest.devDependencies.has_value()) {
-    for (const auto& dep : manifest.devDependencies.value()) {
-      std::visit(
-          [&installed](auto&& arg) { installed.emplace_back(arg.install()); },
-          dep
-      );
+    deps.insert(
+        deps.end(), manifest.devDependencies->begin(),
+        manifest.devDependencies->end()
+    );
+  }
+  return deps;
+}
+
+std::vector<std::string>
+getDependencyNames(const bool includeDevDeps) {
+  std::vector<std::string> names;
+  for (const auto& entry : getDependencies(includeDevDeps)) {
+    names.emplace_back(
+        std::visit([](const auto& dep) { return dep.name; }, entry)
+    );
+  }
+  return names;
+}
+
+std::vector<DepMetadata>
+installDependencies(
+    const bool includeDevDeps,
+    const std::unordered_set<std::string>& excludedNames
+) {
+  std::vector<std::variant<GitDependency, SystemDependency>> deps;
+  for (auto& entry : getDependencies(includeDevDeps)) {
+    const bool excluded = std::visit(
+        [&](const auto& dep) { return excludedNames.contains(dep.name); },
+        entry
+    );
+    if (!excluded) {
+      deps.emplace_back(std::move(entry));
     }
   }
+
+  // Workspace members often share dependencies, so each dependency is
+  // installed only once per process and the result is reused.
+  static std::unordered_map<std::string, DepMetadata> installCache;
+  std::vector<std::string> keys;
+  std::vector<size_t> pending;
+  std::unordered_set<std::string> pendingKeys;
+  for (size_t i = 0; i < deps.size(); ++i) {
+    keys.emplace_back(std::visit(
+        [](const auto& dep) { return dep.installKey(); }, deps[i]
+    ));
+    if (!installCache.contains(keys[i]) && pendingKeys.insert(keys[i]).second) {
+      pending.push_back(i);
+    }
+  }
+
+  // Results are stored by index to keep the order deterministic.
+  std::vector<std::optional<DepMetadata>> results(pending.size());
+  installConcurrently(
+      pending.size(),
+      [&](const size_t j) {
+        return std::visit(
+            [](const auto& dep) { return dep.name; }, deps[pending[j]]
+        );
+      },
+      [&](const size_t j) {
+        results[j] = std::visit(
+            [](const auto& dep) { return dep.install(); }, deps[pending[j]]
+        );
+      }
+  );
+
+  for (size_t j = 0; j < pending.size(); ++j) {
+    installCache.emplace(keys[pending[j]], results[j].value());
+  }
+
+  std::vector<DepMetadata> installed;
+  for (const std::string& key : keys) {
+    installed.emplace_back(installCache.at(key));
+  }
   return installed;
 }
 
 #ifdef POAC_TEST
 
+#  include <atomic>
+#  include <chrono>
+#  include <thread>
+
 namespace tests {
 
 static void
@@ -733,11 +1351,277 @@ testValidateDepName() {
   pass();
 }
 
+static void
+testInstallConcurrently() {
+  const std::vector<std::string> names = { "a", "b", "c", "d" };
+  const auto nameOf = [&names](const size_t j) { return names[j]; };
+
+  // Every installation runs even if others fail, and the failures are
+  // reported together in order.
+  const size_t prevParallelism = getParallelism();
+  for (const size_t parallelism : { 1, 4 }) {
+    setParallelism(parallelism);
+    std::vector<std::atomic_bool> installed(names.size());
+    assertException<PoacError>(
+        [&]() {
+          installConcurrently(names.size(), nameOf, [&](const size_t j) {
+            if (j % 2 == 1) {
+              throw PoacError("could not clone ", names[j]);
+            }
+            installed[j] = true;
+          });
+        },
+        "failed to install 2 dependencies:\n"
+        "b: could not clone b\n"
+        "d: could not clone d"
+    );
+    assertTrue(installed[0] && installed[2]);
+
+    assertNoException([&]() {
+      installConcurrently(names.size(), nameOf, [](size_t) {});
+    });
+  }
+  setParallelism(prevParallelism);
+
+  pass();
+}
+
+static void
+testPkgConfigCache() {
+  const TempDir tmpDir("poac-pkg-config");
+  const fs::path& dir = tmpDir.path();
+  const auto writePc = [&dir](const std::string& name,
+                              const std::string& deps) {
+    std::ofstream(dir / (name + ".pc"))
+        << "Name: " << name << "\nDescription: " << name
+        << "\nVersion: 1.0.0\n" << deps << "\nCflags: -I/" << name
+        << "\n";
+  };
+  // a requires b, which privately requires c.
+  writePc("a", "Requires: b >= 1.0");
+  writePc("b", "Requires.private: c");
+  writePc("c", "");
+
+  const char* prevPath = std::getenv("PKG_CONFIG_PATH");
+  const std::string savedPath = prevPath != nullptr ? prevPath : "";
+  setenv("PKG_CONFIG_PATH", dir.c_str(), 1);
+
+  std::vector<fs::path> pcFiles = findPcFiles("a");
+  std::ranges::sort(pcFiles);
+  assertTrue(
+      pcFiles
+      == std::vector<fs::path>{ dir / "a.pc", dir / "b.pc", dir / "c.pc" }
+  );
+
+  // Work on an in-memory cache rather than the user's.
+  const std::lock_guard lock(pkgConfigCacheMtx);
+  const std::optional<nlohmann::json> prevCache = pkgConfigCache;
+  pkgConfigCache = nlohmann::json::object();
+  const auto record = []() {
+    pkgConfigCache.value()["a"] = {
+      { "cflags", "-I/a" },
+      { "libs", "" },
+      { "pcFiles", getPcFileMtimes("a").value() },
+    };
+  };
+
+  record();
+  assertTrue(lookupPkgConfigCache("a").has_value());
+  assertEq(lookupPkgConfigCache("a")->includes, "-I/a");
+  assertFalse(lookupPkgConfigCache("b").has_value());
+
+  // A change to a transitively required .pc file invalidates the entry.
+  fs::last_write_time(
+      dir / "c.pc", fs::last_write_time(dir / "c.pc") + std::chrono::hours(1)
+  );
+  assertFalse(lookupPkgConfigCache("a").has_value());
+
+  record();
+  assertTrue(lookupPkgConfigCache("a").has_value());
+  fs::remove(dir / "b.pc");
+  assertFalse(lookupPkgConfigCache("a").has_value());
+
+  pkgConfigCache = prevCache;
+  if (prevPath != nullptr) {
+    setenv("PKG_CONFIG_PATH", savedPath.c_str(), 1);
+  } else {
+    unsetenv("PKG_CONFIG_PATH");
+  }
+
+  pass();
+}
+
+static void
+testGitMirror() {
+  const TempDir tmpDir("poac-git-mirror");
+  const fs::path& tmp = tmpDir.path();
+  const fs::path origin = tmp / "origin";
+  fs::create_directories(origin / "include");
+  const auto git = [&origin](const std::vector<std::string>& args) {
+    getCmdOutput(
+        Command("git").addArg("-C").addArg(origin.string()).addArgs(args)
+    );
+  };
+  git({ "init", "-q" });
+  git({ "config", "user.name", "poac" });
+  git({ "config", "user.email", "poac@example.com" });
+  std::ofstream(origin / "include" / "foo.hpp") << "// v1\n";
+  git({ "add", "." });
+  git({ "commit", "-q", "-m", "v1" });
+  git({ "tag", "v1" });
+  std::ofstream(origin / "include" / "foo.hpp") << "// v2\n";
+  git({ "commit", "-q", "-am", "v2" });
+  git({ "tag", "v2" });
+
+  const std::string url = "file://" + origin.string();
+  const fs::path srcDir = tmp / "src";
+  const fs::path dbDir = tmp / "db";
+  // Revisions are installed concurrently, as by installDependencies.  The
+  // mirror lock serializes their fetches.
+  std::vector<std::thread> installs;
+  for (const std::string rev : { "v1", "v2" }) {
+    installs.emplace_back([&, rev]() {
+      GitDependency{ .name = "foo", .url = url, .target = rev }.install(
+          srcDir, dbDir
+      );
+    });
+  }
+  for (std::thread& install : installs) {
+    install.join();
+  }
+  GitDependency{ .name = "bar", .url = url, .target = "v1" }.install(
+      srcDir, dbDir
+  );
+
+  // All of them come from the one mirror of the URL, whatever the
+  // dependency is named.
+  std::vector<fs::path> mirrors;
+  for (const auto& entry : fs::directory_iterator(dbDir)) {
+    if (entry.is_directory()) {
+      mirrors.push_back(entry.path());
+    }
+  }
+  assertEq(mirrors.size(), 1UL);
+  assertEq(
+      mirrors[0].filename().string(), Hasher().update(url).hexDigest()
+  );
+  assertTrue(fs::exists(mirrors[0].string() + ".lock"));
+  const fs::path mirrorObjects = fs::absolute(mirrors[0] / "objects");
+
+  for (const std::string dir : { "foo-v1", "foo-v2", "bar-v1" }) {
+    const fs::path installDir = srcDir / dir;
+    const std::string rev = dir.substr(dir.find('-') + 1);
+    std::string line;
+    std::getline(std::ifstream(installDir / "include" / "foo.hpp"), line);
+    assertEq(line, "// " + rev);
+
+    // The checkout borrows the objects of the mirror instead of copying.
+    const fs::path objects = installDir / ".git" / "objects";
+    std::getline(std::ifstream(objects / "info" / "alternates"), line);
+    assertEq(line, mirrorObjects.string());
+    assertTrue(fs::is_empty(objects / "pack"));
+  }
+
+  pass();
+}
+
+static void
+testWorkspace() {
+  const TempDir tmpDir("poac-workspace");
+  const fs::path& root = tmpDir.path();
+  const auto writeManifest = [&root](const fs::path& dir,
+                                     const std::string& content) {
+    fs::create_directories(root / dir);
+    std::ofstream(root / dir / "poac.toml") << content;
+  };
+  const auto package = [](const std::string& name) {
+    return "[package]\nname = \"" + name
+           + "\"\nedition = \"20\"\nversion = \"0.1.0\"\n";
+  };
+  const auto parse = [&root](const std::string& content) {
+    std::ofstream(root / "poac.toml") << content;
+    return parseWorkspaceMembers(toml::parse(root / "poac.toml"), root);
+  };
+  writeManifest("tools/cli", package("cli"));
+  writeManifest("libs/b", package("beta"));
+  writeManifest("libs/a", package("alpha"));
+  fs::create_directories(root / "libs" / "docs");
+
+  assertTrue(parse(package("root")).empty());
+
+  // `libs/*` adds the subdirectories having a manifest in order, and
+  // members listed twice are added once.
+  const std::vector<fs::path> expected = {
+    root / "tools/cli", root / "libs/a", root / "libs/b"
+  };
+  assertTrue(
+      parse("[workspace]\nmembers = [\"tools/cli\", \"libs/*\", "
+            "\"libs/a\"]\n")
+      == expected
+  );
+  assertTrue(
+      parse(package("root") + "[workspace]\nmembers = [\"libs/a\"]\n")
+      == std::vector<fs::path>{ root, root / "libs/a" }
+  );
+
+  assertException<PoacError>(
+      [&]() { parse("[workspace]\nmembers = []\n"); },
+      "[workspace] must have at least one member"
+  );
+  assertException<PoacError>(
+      [&]() { parse("[workspace]\nmembers = [\"libs/docs\"]\n"); },
+      "workspace member `libs/docs` does not contain `poac.toml`"
+  );
+  assertException<PoacError>(
+      [&]() { parse("[workspace]\nmembers = [\"apps/*\"]\n"); },
+      "workspace member `apps/*` was not found"
+  );
+
+  // The root manifest is now the workspace without a package.
+  parse("[workspace]\nmembers = [\"tools/cli\", \"libs/*\"]\n");
+  const fs::path prevDir = fs::current_path();
+  fs::current_path(root);
+  assertTrue(getWorkspaceMembers() == expected);
+  assertException<PoacError>(
+      []() { rejectWorkspaceRoot("test"); },
+      "`poac test` does not support workspaces yet; run it in a member "
+      "directory"
+  );
+
+  // Scopes nest and restore the previous manifest when destroyed.
+  {
+    const ManifestScope scopeA(root / "libs/a");
+    assertEq(getPackageName(), "alpha");
+    {
+      const ManifestScope scopeCli(root / "tools/cli");
+      assertEq(getPackageName(), "cli");
+      assertEq(getProjectBasePath(), root / "tools/cli");
+    }
+    assertEq(getPackageName(), "alpha");
+
+    // A failed scope leaves the current one in effect.
+    assertException<PoacError>(
+        [&root]() { const ManifestScope scope(root / "libs/docs"); },
+        "could not find `" + (root / "libs/docs/poac.toml").string() + "`"
+    );
+    assertEq(getPackageName(), "alpha");
+  }
+  assertEq(getManifestPath(), root / "poac.toml");
+
+  fs::current_path(prevDir);
+
+  pass();
+}
+
 }  // namespace tests
 
 int
 main() {
   tests::testValidateDepName();
+  tests::testInstallConcurrently();
+  tests::testPkgConfigCache();
+  tests::testGitMirror();
+  tests::testWorkspace();
 }
 
 #endif
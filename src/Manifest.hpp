@@ -15,6 +15,8 @@
 struct DepMetadata {
   std::string includes;  // -Isomething
   std::string libs;      // -Lsomething -lsomething
+  // A Git dependency with sources to be built into a static library.
+  std::optional<fs::path> packageDir = std::nullopt;
 };
 
 struct Profile {
@@ -60,8 +62,36 @@ public:
   }
 };
 
+const fs::path& getCacheDir();
 const fs::path& getManifestPath();
 fs::path getProjectBasePath();
+
+// Makes the functions below read the manifest in `projectDir` instead of the
+// one found from the current directory, until this object is destroyed.
+// This is how workspace members are configured.  Enter one member at a
+// time, outside of parallel regions; the functions below may then be called
+// from parallel regions.
+class ManifestScope {
+  std::optional<fs::path> prevManifestPath;
+
+public:
+  explicit ManifestScope(const fs::path& projectDir);
+  ~ManifestScope() noexcept;
+
+  ManifestScope(const ManifestScope&) = delete;
+  ManifestScope(ManifestScope&&) noexcept = delete;
+  ManifestScope& operator=(const ManifestScope&) = delete;
+  ManifestScope& operator=(ManifestScope&&) noexcept = delete;
+};
+
+// Returns the directories of the `[workspace]` members of the manifest, or
+// an empty vector if it does not define a workspace.  The root package,
+// if any, comes first.
+const std::vector<fs::path>& getWorkspaceMembers();
+// Throws PoacError if the root manifest defines a workspace.  `command`,
+// e.g., "test", only supports single packages.
+void rejectWorkspaceRoot(std::string_view command);
+
 std::optional<std::string> validatePackageName(std::string_view name) noexcept;
 const std::string& getPackageName();
 const Edition& getPackageEdition();
@@ -69,4 +99,10 @@ const Version& getPackageVersion();
 const Profile& getDevProfile();
 const Profile& getReleaseProfile();
 const std::vector<std::string>& getLintCpplintFilters();
-std::vector<DepMetadata> installDependencies(bool includeDevDeps);
+// Names of the dependencies of the package.
+std::vector<std::string> getDependencyNames(bool includeDevDeps);
+// Installs the dependencies of the package except those named in
+// `excludedNames`, e.g., workspace members built along with it.
+std::vector<DepMetadata> installDependencies(
+    bool includeDevDeps, const std::unordered_set<std::string>& excludedNames
+);
@@ -0,0 +1,483 @@
+#include "RegistryIndex.hpp"
+
+#include "Algos.hpp"
+#include "Exception.hpp"
+#include "Logger.hpp"
+#include "Rustify.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+static constexpr std::string_view INDEX_HEADER = "poac-registry-index 1";
+
+static std::string
+toLower(const std::string_view str) {
+  std::string lower(str);
+  std::ranges::transform(lower, lower.begin(), [](const unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return lower;
+}
+
+static uint32_t
+trigramAt(const std::string_view str, const size_t pos) noexcept {
+  // NOLINTBEGIN(*-magic-numbers)
+  return static_cast<uint32_t>(static_cast<unsigned char>(str[pos])) << 16
+         | static_cast<uint32_t>(static_cast<unsigned char>(str[pos + 1])) << 8
+         | static_cast<uint32_t>(static_cast<unsigned char>(str[pos + 2]));
+  // NOLINTEND(*-magic-numbers)
+}
+
+// Fields are separated by tabs and packages by newlines, so escape them.
+static std::string
+escapeField(const std::string_view field) {
+  std::string escaped;
+  escaped.reserve(field.size());
+  for (const char c : field) {
+    switch (c) {
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '\t':
+        escaped += "\\t";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      default:
+        escaped += c;
+        break;
+    }
+  }
+  return escaped;
+}
+
+static std::string
+unescapeField(const std::string_view field) {
+  std::string unescaped;
+  unescaped.reserve(field.size());
+  for (size_t i = 0; i < field.size(); ++i) {
+    if (field[i] != '\\' || i + 1 == field.size()) {
+      unescaped += field[i];
+      continue;
+    }
+    switch (field[++i]) {
+      case 't':
+        unescaped += '\t';
+        break;
+      case 'n':
+        unescaped += '\n';
+        break;
+      default:
+        unescaped += field[i];
+        break;
+    }
+  }
+  return unescaped;
+}
+
+RegistryIndex
+RegistryIndex::load(const fs::path& path) {
+  RegistryIndex index;
+  std::ifstream ifs(path);
+  if (!ifs) {
+    return index;
+  }
+
+  std::string line;
+  if (!std::getline(ifs, line) || line != INDEX_HEADER) {
+    logger::debug("ignoring registry index of another format: {}", line);
+    return index;
+  }
+  std::getline(ifs, index.cursor);
+  while (std::getline(ifs, line)) {
+    const size_t versionPos = line.find('\t');
+    const size_t descPos = line.find('\t', versionPos + 1);
+    if (versionPos == std::string::npos || descPos == std::string::npos) {
+      logger::debug("ignoring broken registry index: {}", path.string());
+      return {};
+    }
+    index.packages.push_back(IndexedPackage{
+        .name = unescapeField(line.substr(0, versionPos)),
+        .version = unescapeField(
+            line.substr(versionPos + 1, descPos - versionPos - 1)
+        ),
+        .description = unescapeField(line.substr(descPos + 1)),
+    });
+  }
+  index.buildTrigrams();
+  return index;
+}
+
+void
+RegistryIndex::save(const fs::path& path) const {
+  std::ostringstream oss;
+  oss << INDEX_HEADER << '\n' << cursor << '\n';
+  for (const IndexedPackage& package : packages) {
+    oss << escapeField(package.name) << '\t' << escapeField(package.version)
+        << '\t' << escapeField(package.description) << '\n';
+  }
+  fs::create_directories(path.parent_path());
+  writeFileAtomically(path, oss.str());
+}
+
+void
+RegistryIndex::update(const nlohmann::json& rows) {
+  if (rows.empty()) {
+    return;
+  }
+
+  std::map<std::string, IndexedPackage> added;
+  try {
+    for (const nlohmann::json& row : rows) {
+      // The registry has packages without a description.
+      const auto description = row.find("description");
+      IndexedPackage package{
+        .name = row.at("name").get<std::string>(),
+        .version = row.at("version").get<std::string>(),
+        .description = description != row.end() && description->is_string()
+                           ? description->get<std::string>()
+                           : "",
+      };
+      // Timestamps of the same format compare in chronological order.
+      cursor = std::max(cursor, row.at("published_at").get<std::string>());
+
+      const auto itr = std::ranges::lower_bound(
+          packages, package.name, {}, &IndexedPackage::name
+      );
+      if (itr != packages.end() && itr->name == package.name) {
+        *itr = std::move(package);
+      } else {
+        std::string name = package.name;
+        added.insert_or_assign(std::move(name), std::move(package));
+      }
+    }
+  } catch (const nlohmann::json::exception& e) {
+    throw PoacError("invalid package from the registry: ", e.what());
+  }
+
+  const auto middle = static_cast<std::ptrdiff_t>(packages.size());
+  for (auto& [name, package] : added) {
+    packages.push_back(std::move(package));
+  }
+  std::ranges::inplace_merge(
+      packages, packages.begin() + middle, {}, &IndexedPackage::name
+  );
+  buildTrigrams();
+}
+
+void
+RegistryIndex::buildTrigrams() {
+  trigrams.clear();
+  for (size_t i = 0; i < packages.size(); ++i) {
+    const std::string name = toLower(packages[i].name);
+    for (size_t pos = 0; pos + 3 <= name.size(); ++pos) {
+      std::vector<uint32_t>& ids = trigrams[trigramAt(name, pos)];
+      // A name may have the same trigram more than once.
+      if (ids.empty() || ids.back() != i) {
+        ids.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+}
+
+std::vector<const IndexedPackage*>
+RegistryIndex::search(const std::string_view query) const {
+  const std::string needle = toLower(query);
+
+  // A name containing `needle` has all of its trigrams, so only check the
+  // packages in every posting list of them.
+  std::vector<uint32_t> candidates;
+  if (needle.size() < 3) {
+    candidates.resize(packages.size());
+    for (size_t i = 0; i < packages.size(); ++i) {
+      candidates[i] = static_cast<uint32_t>(i);
+    }
+  }
+  for (size_t pos = 0; pos + 3 <= needle.size(); ++pos) {
+    const auto found = trigrams.find(trigramAt(needle, pos));
+    if (found == trigrams.end()) {
+      candidates.clear();
+      break;
+    }
+    if (pos == 0) {
+      candidates = found->second;
+      continue;
+    }
+    std::vector<uint32_t> common;
+    std::ranges::set_intersection(
+        candidates, found->second, std::back_inserter(common)
+    );
+    candidates = std::move(common);
+  }
+
+  using Ranked = std::pair<size_t, const IndexedPackage*>;
+  std::vector<Ranked> ranked;
+  for (const uint32_t id : candidates) {
+    const std::string name = toLower(packages[id].name);
+    const size_t pos = name.find(needle);
+    if (pos == std::string::npos) {
+      continue;
+    }
+    const size_t rank = name.size() == needle.size() ? 0 : pos == 0 ? 1 : 2;
+    ranked.emplace_back(rank, &packages[id]);
+  }
+
+  if (ranked.empty() && !needle.empty()) {
+    // Allow as many typos as findSimilarStr does.
+    const size_t maxDist =
+        needle.size() < 3 ? needle.size() - 1 : needle.size() / 3;
+    for (const IndexedPackage& package : packages) {
+      const size_t dist = levDistance(needle, toLower(package.name));
+      if (dist <= maxDist) {
+        ranked.emplace_back(dist, &package);
+      }
+    }
+  }
+
+  // Packages of the same rank stay in the order of names.
+  std::ranges::stable_sort(ranked, {}, &Ranked::first);
+  std::vector<const IndexedPackage*> results;
+  results.reserve(ranked.size());
+  for (const auto& [rank, package] : ranked) {
+    results.push_back(package);
+  }
+  return results;
+}
+
+size_t
+syncRegistryIndex(RegistryIndex& index, const RegistryClient& client) {
+  constexpr size_t pageSize = 1000;
+  const std::string since =
+      index.getCursor().empty() ? "1970-01-01T00:00:00Z" : index.getCursor();
+
+  size_t numReceived = 0;
+  for (size_t offset = 0;; offset += pageSize) {
+    nlohmann::json req;
+    req["query"] =
+#include "GraphQL/SyncPackages.gql"
+        ;
+    req["variables"]["since"] = since;
+    req["variables"]["limit"] = pageSize;
+    req["variables"]["offset"] = offset;
+
+    const nlohmann::json res = client(req);
+    if (res.contains("errors")) {
+      throw PoacError("the registry responded with errors: ", res["errors"]);
+    }
+    if (!res.contains("data") || !res["data"].contains("packages")
+        || !res["data"]["packages"].is_array()) {
+      throw PoacError("unexpected response from the registry: ", res);
+    }
+
+    const nlohmann::json& rows = res["data"]["packages"];
+    index.update(rows);
+    numReceived += rows.size();
+    if (rows.size() < pageSize) {
+      return numReceived;
+    }
+  }
+}
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+static nlohmann::json
+row(
+    const std::string_view name, const std::string_view version,
+    const std::string_view publishedAt,
+    const std::string_view description = "A package"
+) {
+  return {
+    { "name", name },
+    { "version", version },
+    { "description", description },
+    { "published_at", publishedAt },
+  };
+}
+
+static RegistryIndex
+makeIndex() {
+  RegistryIndex index;
+  index.update({
+      row("toml11", "3.7.1", "2023-01-02T00:00:00Z"),
+      row("fmt", "9.1.0", "2023-01-03T00:00:00Z"),
+      row("ut", "1.1.9", "2023-01-04T00:00:00Z"),
+      row("libfmt-extra", "0.1.0", "2023-01-05T00:00:00Z"),
+      row("fmtlog", "2.2.1", "2023-01-06T00:00:00Z"),
+  });
+  return index;
+}
+
+static std::vector<std::string>
+names(const std::vector<const IndexedPackage*>& packages) {
+  std::vector<std::string> result;
+  for (const IndexedPackage* package : packages) {
+    result.push_back(package->name);
+  }
+  return result;
+}
+
+static void
+testSearch() {
+  const RegistryIndex index = makeIndex();
+  assertEq(index.size(), static_cast<size_t>(5));
+
+  // An exact match, then prefix matches, then the others.
+  assertTrue(
+      names(index.search("fmt"))
+      == std::vector<std::string>{ "fmt", "fmtlog", "libfmt-extra" }
+  );
+  assertTrue(
+      names(index.search("TOML")) == std::vector<std::string>{ "toml11" }
+  );
+  assertTrue(names(index.search("l")).size() == 3);
+  assertTrue(names(index.search("")).size() == 5);
+
+  // Typos
+  assertTrue(
+      names(index.search("tomll11")) == std::vector<std::string>{ "toml11" }
+  );
+  assertTrue(
+      names(index.search("fmtlgo")) == std::vector<std::string>{ "fmtlog" }
+  );
+  assertTrue(index.search("boost").empty());
+
+  pass();
+}
+
+static void
+testUpdate() {
+  RegistryIndex index = makeIndex();
+  index.update({
+      row("toml11", "3.8.0", "2023-02-01T00:00:00Z"),
+      row("spdlog", "1.11.0", "2023-02-02T00:00:00Z", ""),
+      row("spdlog", "1.12.0", "2023-02-03T00:00:00Z"),
+  });
+  assertEq(index.size(), static_cast<size_t>(6));
+  assertEq(index.getCursor(), "2023-02-03T00:00:00Z");
+  assertEq(index.search("toml11")[0]->version, "3.8.0");
+  assertEq(index.search("spdlog")[0]->version, "1.12.0");
+
+  nlohmann::json noDesc = row("nodesc", "0.1.0", "2023-02-04T00:00:00Z");
+  noDesc["description"] = nullptr;
+  index.update(nlohmann::json::array({ noDesc }));
+  assertEq(index.search("nodesc")[0]->description, "");
+
+  assertException<PoacError>(
+      [&] {
+        index.update(nlohmann::json::array({ { { "name", "broken" } } }));
+      },
+      "invalid package from the registry: [json.exception.out_of_range.403] "
+      "key 'version' not found"
+  );
+
+  pass();
+}
+
+static void
+testSaveAndLoad() {
+  const TempDir tmpDir("poac-test-index");
+  const fs::path& dir = tmpDir.path();
+  const fs::path path = dir / "registry-index";
+
+  RegistryIndex index = makeIndex();
+  index.update(nlohmann::json::array(
+      { row("tricky", "1.0.0", "2023-03-01T00:00:00Z", "a\tb\nc\\d") }
+  ));
+  index.save(path);
+
+  const RegistryIndex loaded = RegistryIndex::load(path);
+  assertEq(loaded.size(), index.size());
+  assertEq(loaded.getCursor(), "2023-03-01T00:00:00Z");
+  assertEq(loaded.search("tricky")[0]->description, "a\tb\nc\\d");
+  assertTrue(
+      names(loaded.search("fmt"))
+      == std::vector<std::string>{ "fmt", "fmtlog", "libfmt-extra" }
+  );
+
+  std::ofstream(path) << "poac-registry-index 0\n";
+  assertTrue(RegistryIndex::load(path).empty());
+  assertTrue(RegistryIndex::load(dir / "missing").empty());
+
+  pass();
+}
+
+static void
+testSync() {
+  // A stand-in for the registry, serving pages like the GraphQL endpoint.
+  const std::vector<nlohmann::json> published = {
+    row("fmt", "9.0.0", "2023-01-01T00:00:00Z"),
+    row("toml11", "3.7.1", "2023-01-02T00:00:00Z"),
+    row("fmt", "9.1.0", "2023-01-03T00:00:00Z"),
+  };
+  size_t numPublished = 2;
+  size_t numRequests = 0;
+  const RegistryClient client = [&](const nlohmann::json& req) {
+    ++numRequests;
+    const std::string since = req["variables"]["since"];
+    const size_t limit = req["variables"]["limit"];
+    size_t offset = req["variables"]["offset"];
+
+    nlohmann::json rows = nlohmann::json::array();
+    for (size_t i = 0; i < numPublished; ++i) {
+      if (published[i]["published_at"].get<std::string>() <= since) {
+        continue;
+      }
+      if (offset > 0) {
+        --offset;
+      } else if (rows.size() < limit) {
+        rows.push_back(published[i]);
+      }
+    }
+    return nlohmann::json{ { "data", { { "packages", rows } } } };
+  };
+
+  RegistryIndex index;
+  assertEq(syncRegistryIndex(index, client), static_cast<size_t>(2));
+  assertEq(index.getCursor(), "2023-01-02T00:00:00Z");
+
+  // Only new packages are downloaded.
+  numPublished = 3;
+  assertEq(syncRegistryIndex(index, client), static_cast<size_t>(1));
+  assertEq(index.search("fmt")[0]->version, "9.1.0");
+  assertEq(syncRegistryIndex(index, client), static_cast<size_t>(0));
+  assertEq(numRequests, static_cast<size_t>(3));
+
+  assertException<PoacError>(
+      [&] {
+        syncRegistryIndex(index, [](const nlohmann::json&) {
+          return nlohmann::json{ { "errors", { { { "message", "oops" } } } } };
+        });
+      },
+      "the registry responded with errors: [{\"message\":\"oops\"}]"
+  );
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testSearch();
+  tests::testUpdate();
+  tests::testSaveAndLoad();
+  tests::testSync();
+}
+
+#endif
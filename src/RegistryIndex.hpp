@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Rustify.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The latest published version of a package in the registry.
+struct IndexedPackage {
+  std::string name;
+  std::string version;
+  std::string description;
+};
+
+// A local mirror of the package list of the registry, so that packages can
+// be searched offline.  It is updated incrementally: only the packages
+// published after the last sync are downloaded.
+class RegistryIndex {
+  // Sorted by name.
+  std::vector<IndexedPackage> packages;
+  // The publish time of the newest package in the index, in the format of
+  // the registry, from where the next sync starts.
+  std::string cursor;
+  // Trigrams of lowercased names to the indices of the packages containing
+  // them, in ascending order.
+  std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+
+public:
+  // Loads the index saved at `path`.  A missing or broken file yields an
+  // empty index.
+  static RegistryIndex load(const fs::path& path);
+  void save(const fs::path& path) const;
+
+  // Merges packages from the registry, each with `name`, `version`,
+  // `description`, and `published_at`.  Later ones replace earlier ones of
+  // the same name, so `rows` should be in the order of publication.
+  void update(const nlohmann::json& rows);
+
+  const std::string& getCursor() const noexcept {
+    return cursor;
+  }
+  size_t size() const noexcept {
+    return packages.size();
+  }
+  bool empty() const noexcept {
+    return packages.empty();
+  }
+
+  // Returns the packages whose names contain `query`, ignoring case: an
+  // exact match first, then those starting with `query`, then the rest, by
+  // name.  If none does, returns the packages with a name similar to
+  // `query`, e.g., with a typo, closest first.
+  std::vector<const IndexedPackage*> search(std::string_view query) const;
+
+private:
+  void buildTrigrams();
+};
+
+// Sends a GraphQL request to the registry and returns the response.
+using RegistryClient =
+    std::function<nlohmann::json(const nlohmann::json& request)>;
+
+// Downloads the packages published since the last sync into `index`, and
+// returns how many were received.  Throws PoacError if the registry
+// responds with errors.
+size_t syncRegistryIndex(RegistryIndex& index, const RegistryClient& client);
@@ -0,0 +1,451 @@
+#include "Replacements.hpp"
+
+#include "Exception.hpp"
+#include "Rustify.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+static bool
+isBlank(const char c) noexcept {
+  return c == ' ' || c == '\t';
+}
+
+static void
+appendUtf8(std::string& str, const uint32_t codePoint) {
+  // NOLINTBEGIN(*-magic-numbers)
+  if (codePoint < 0x80) {
+    str += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    str += static_cast<char>(0xC0 | (codePoint >> 6));
+    str += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else if (codePoint < 0x10000) {
+    str += static_cast<char>(0xE0 | (codePoint >> 12));
+    str += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    str += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    str += static_cast<char>(0xF0 | (codePoint >> 18));
+    str += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    str += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    str += static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+  // NOLINTEND(*-magic-numbers)
+}
+
+// Reads the escape sequence after a backslash in a double-quoted scalar.
+static void
+readEscape(const std::string_view yaml, size_t& pos, std::string& value) {
+  const char c = yaml[pos++];
+  size_t numHexDigits = 0;
+  switch (c) {
+    case '0':
+      value += '\0';
+      return;
+    case 't':
+      value += '\t';
+      return;
+    case 'n':
+      value += '\n';
+      return;
+    case 'r':
+      value += '\r';
+      return;
+    case 'x':
+      numHexDigits = 2;
+      break;
+    case 'u':
+      numHexDigits = 4;
+      break;
+    case 'U':
+      numHexDigits = 8;  // NOLINT(*-magic-numbers)
+      break;
+    case '\n':
+      // An escaped line break is removed with the indentation that follows.
+      while (pos < yaml.size() && isBlank(yaml[pos])) {
+        ++pos;
+      }
+      return;
+    default:
+      value += c;  // e.g., \\ and \"
+      return;
+  }
+
+  uint32_t codePoint = 0;
+  const std::string_view digits = yaml.substr(pos, numHexDigits);
+  const auto [ptr, ec] = std::from_chars(
+      digits.data(), digits.data() + digits.size(), codePoint, 16
+  );
+  if (ec != std::errc() || ptr != digits.data() + numHexDigits) {
+    throw PoacError("invalid escape sequence in YAML: \\", c, digits);
+  }
+  pos += numHexDigits;
+  appendUtf8(value, codePoint);
+}
+
+// Reads a single- or double-quoted scalar whose opening quote is at `pos`,
+// and advances `pos` past the closing quote.
+static std::string
+readQuoted(const std::string_view yaml, size_t& pos) {
+  const char quote = yaml[pos++];
+  std::string value;
+  while (pos < yaml.size()) {
+    const char c = yaml[pos];
+    if (c == quote) {
+      if (quote == '\'' && pos + 1 < yaml.size() && yaml[pos + 1] == '\'') {
+        value += '\'';
+        pos += 2;
+        continue;
+      }
+      ++pos;
+      return value;
+    }
+    if (quote == '"' && c == '\\' && pos + 1 < yaml.size()) {
+      ++pos;
+      readEscape(yaml, pos, value);
+      continue;
+    }
+    if (c == '\n') {
+      // Line folding: a line break becomes a space, unless it is followed by
+      // empty lines, each of which becomes a newline.
+      while (!value.empty() && isBlank(value.back())) {
+        value.pop_back();
+      }
+      ++pos;
+      size_t numEmptyLines = 0;
+      while (true) {
+        while (pos < yaml.size() && isBlank(yaml[pos])) {
+          ++pos;
+        }
+        if (pos < yaml.size() && yaml[pos] == '\n') {
+          ++numEmptyLines;
+          ++pos;
+          continue;
+        }
+        break;
+      }
+      value += numEmptyLines == 0 ? std::string(" ")
+                                  : std::string(numEmptyLines, '\n');
+      continue;
+    }
+    value += c;
+    ++pos;
+  }
+  throw PoacError("unterminated quoted scalar in YAML");
+}
+
+static size_t
+parseSize(const std::string_view value) {
+  size_t size = 0;
+  const auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), size);
+  if (ec != std::errc() || ptr != value.data() + value.size()) {
+    throw PoacError("invalid number in YAML: ", value);
+  }
+  return size;
+}
+
+std::vector<Replacement>
+parseExportedFixes(const std::string_view yaml) {
+  std::vector<Replacement> replacements;
+  std::optional<Replacement> current;
+  // Indentation of the keys of the enclosing `Replacements` or `Notes`.
+  std::optional<size_t> replacementsIndent;
+  std::optional<size_t> notesIndent;
+  const auto flush = [&] {
+    if (current.has_value()) {
+      replacements.push_back(std::move(current.value()));
+      current.reset();
+    }
+  };
+
+  size_t pos = 0;
+  while (pos < yaml.size()) {
+    size_t lineEnd = yaml.find('\n', pos);
+    if (lineEnd == std::string_view::npos) {
+      lineEnd = yaml.size();
+    }
+    const std::string_view line = yaml.substr(pos, lineEnd - pos);
+    const size_t lineStart = pos;
+    pos = lineEnd + 1;
+
+    size_t keyIndent = line.find_first_not_of(' ');
+    if (keyIndent == std::string_view::npos || line[keyIndent] == '#'
+        || line.starts_with("---") || line.starts_with("...")) {
+      continue;
+    }
+    const bool isItem = line[keyIndent] == '-';
+    if (isItem) {
+      keyIndent = line.find_first_not_of(' ', keyIndent + 1);
+      if (keyIndent == std::string_view::npos) {
+        continue;
+      }
+    }
+    const size_t colon = line.find(':', keyIndent);
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    const std::string_view key = line.substr(keyIndent, colon - keyIndent);
+
+    // Read the value, which may span lines if quoted.
+    size_t valuePos = lineStart + colon + 1;
+    while (valuePos < lineEnd && isBlank(yaml[valuePos])) {
+      ++valuePos;
+    }
+    std::string value;
+    bool isEmpty = false;
+    const bool isQuoted =
+        valuePos < lineEnd && (yaml[valuePos] == '\'' || yaml[valuePos] == '"');
+    if (isQuoted) {
+      value = readQuoted(yaml, valuePos);
+      pos = yaml.find('\n', valuePos);
+      pos = pos == std::string_view::npos ? yaml.size() : pos + 1;
+    } else {
+      value = yaml.substr(valuePos, lineEnd - valuePos);
+      while (!value.empty() && isBlank(value.back())) {
+        value.pop_back();
+      }
+      isEmpty = value.empty();
+    }
+
+    if (notesIndent.has_value()) {
+      if (keyIndent > notesIndent.value()) {
+        continue;
+      }
+      notesIndent.reset();
+    }
+    if (replacementsIndent.has_value()
+        && keyIndent <= replacementsIndent.value()) {
+      flush();
+      replacementsIndent.reset();
+    }
+
+    if (key == "Notes") {
+      notesIndent = keyIndent;
+    } else if (key == "Replacements") {
+      if (isEmpty) {
+        replacementsIndent = keyIndent;
+      }
+    } else if (replacementsIndent.has_value()) {
+      if (isItem) {
+        flush();
+        current = Replacement{};
+      }
+      if (!current.has_value()) {
+        continue;
+      }
+      if (key == "FilePath") {
+        current->filePath = std::move(value);
+      } else if (key == "Offset") {
+        current->offset = parseSize(value);
+      } else if (key == "Length") {
+        current->length = parseSize(value);
+      } else if (key == "ReplacementText") {
+        current->text = std::move(value);
+      }
+    }
+  }
+  flush();
+  return replacements;
+}
+
+MergedReplacements
+mergeReplacements(std::vector<Replacement> replacements) {
+  // Sorts by file, then by offset.
+  std::ranges::sort(replacements);
+  const auto [first, last] = std::ranges::unique(replacements);
+  replacements.erase(first, last);
+
+  MergedReplacements merged;
+  for (auto begin = replacements.begin(); begin != replacements.end();) {
+    const auto end =
+        std::find_if(begin, replacements.end(), [&](const Replacement& r) {
+          return r.filePath != begin->filePath;
+        });
+
+    bool hasConflict = false;
+    for (auto itr = begin; itr + 1 < end; ++itr) {
+      const Replacement& prev = *itr;
+      const Replacement& next = *(itr + 1);
+      // Insertions at the same offset have no defined order.
+      if (next.offset < prev.offset + prev.length
+          || (next.offset == prev.offset && prev.length == 0
+              && next.length == 0)) {
+        hasConflict = true;
+        break;
+      }
+    }
+    if (hasConflict) {
+      merged.conflicts.push_back(begin->filePath);
+    } else {
+      merged.files.emplace(begin->filePath, std::vector(begin, end));
+    }
+    begin = end;
+  }
+  return merged;
+}
+
+std::string
+applyReplacements(
+    const std::string_view content,
+    const std::vector<Replacement>& replacements
+) {
+  std::string result;
+  result.reserve(content.size());
+  size_t cursor = 0;
+  for (const Replacement& replacement : replacements) {
+    if (replacement.offset < cursor
+        || replacement.offset + replacement.length > content.size()) {
+      throw PoacError(
+          "replacement at offset ", replacement.offset, " is out of range in ",
+          replacement.filePath
+      );
+    }
+    result.append(content.substr(cursor, replacement.offset - cursor));
+    result.append(replacement.text);
+    cursor = replacement.offset + replacement.length;
+  }
+  result.append(content.substr(cursor));
+  return result;
+}
+
+#ifdef POAC_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+// Mirrors the output of clang-tidy, including a fix of a shared header and a
+// note with an alternative fix.
+static constexpr std::string_view FIXES_A = R"(---
+MainSourceFile:  '/p/src/a.cc'
+Diagnostics:
+  - DiagnosticName:  modernize-use-nullptr
+    DiagnosticMessage:
+      Message:         use nullptr
+      FilePath:        '/p/src/a.cc'
+      FileOffset:      20
+      Replacements:
+        - FilePath:        '/p/src/a.cc'
+          Offset:          20
+          Length:          1
+          ReplacementText: nullptr
+    Level:           Warning
+    BuildDirectory:  '/p/poac-out/debug'
+  - DiagnosticName:  readability-braces-around-statements
+    DiagnosticMessage:
+      Message:         'statement should be inside braces'
+      FilePath:        '/p/src/a.hpp'
+      FileOffset:      4
+      Replacements:
+        - FilePath:        '/p/src/a.hpp'
+          Offset:          4
+          Length:          0
+          ReplacementText: ' {'
+        - FilePath:        '/p/src/a.hpp'
+          Offset:          10
+          Length:          0
+          ReplacementText: '
+
+}'
+    Notes:
+      - Message:         'did you mean this?'
+        FilePath:        '/p/src/a.hpp'
+        FileOffset:      4
+        Replacements:
+          - FilePath:        '/p/src/a.hpp'
+            Offset:          0
+            Length:          10
+            ReplacementText: 'x'
+    Level:           Warning
+...
+)";
+
+static void
+testParseExportedFixes() {
+  const std::vector<Replacement> replacements = parseExportedFixes(FIXES_A);
+  assertEq(replacements.size(), static_cast<size_t>(3));
+  assertTrue(
+      replacements[0]
+      == Replacement{ .filePath = "/p/src/a.cc",
+                      .offset = 20,
+                      .length = 1,
+                      .text = "nullptr" }
+  );
+  assertEq(replacements[1].filePath, "/p/src/a.hpp");
+  assertEq(replacements[1].text, " {");
+  assertEq(replacements[2].offset, static_cast<size_t>(10));
+  assertEq(replacements[2].text, "\n}");
+
+  const std::string_view doubleQuoted = R"(Replacements:
+  - FilePath: "/p/b.cc"
+    Offset: 0
+    Length: 0
+    ReplacementText: "it's\t\"x\"é \
+      y"
+)";
+  const std::vector<Replacement> escaped = parseExportedFixes(doubleQuoted);
+  assertEq(escaped.size(), static_cast<size_t>(1));
+  assertEq(escaped[0].text, "it's\t\"x\"\xc3\xa9 y");
+
+  assertTrue(parseExportedFixes("Replacements: []\n").empty());
+
+  pass();
+}
+
+static void
+testMergeReplacements() {
+  std::vector<Replacement> replacements = parseExportedFixes(FIXES_A);
+  // The same header fix from another translation unit.
+  replacements.push_back(replacements[1]);
+  replacements.push_back({ .filePath = "/p/src/c.cc",
+                           .offset = 0,
+                           .length = 4,
+                           .text = "x" });
+  replacements.push_back({ .filePath = "/p/src/c.cc",
+                           .offset = 2,
+                           .length = 1,
+                           .text = "y" });
+
+  const MergedReplacements merged = mergeReplacements(replacements);
+  assertEq(merged.files.size(), static_cast<size_t>(2));
+  assertEq(merged.files.at("/p/src/a.hpp").size(), static_cast<size_t>(2));
+  assertEq(merged.conflicts.size(), static_cast<size_t>(1));
+  assertEq(merged.conflicts[0], "/p/src/c.cc");
+
+  pass();
+}
+
+static void
+testApplyReplacements() {
+  const std::vector<Replacement> replacements = {
+    { .filePath = "f", .offset = 0, .length = 0, .text = "// " },
+    { .filePath = "f", .offset = 4, .length = 1, .text = "nullptr" },
+    { .filePath = "f", .offset = 6, .length = 0, .text = ";" },
+  };
+  assertEq(applyReplacements("int 0 x", replacements), "// int nullptr ;x");
+  assertException<PoacError>(
+      [&] { applyReplacements("int", replacements); },
+      "replacement at offset 4 is out of range in f"
+  );
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testParseExportedFixes();
+  tests::testMergeReplacements();
+  tests::testApplyReplacements();
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Rustify.hpp"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A text replacement in a file, as exported by `clang-tidy -export-fixes`.
+struct Replacement {
+  std::string filePath;
+  size_t offset = 0;
+  size_t length = 0;
+  std::string text;
+
+  bool operator==(const Replacement&) const = default;
+  auto operator<=>(const Replacement&) const = default;
+};
+
+// Parses the replacements of the diagnostics in an -export-fixes YAML file.
+// Replacements of notes are alternatives and are skipped.
+std::vector<Replacement> parseExportedFixes(std::string_view yaml);
+
+struct MergedReplacements {
+  // Replacements to apply to each file, sorted by offset.
+  std::map<std::string, std::vector<Replacement>> files;
+  // Files left untouched because some of their replacements overlap.
+  std::vector<std::string> conflicts;
+};
+
+// Merges the replacements exported by many translation units, where shared
+// headers get the same fix more than once, like clang-apply-replacements.
+// Duplicates are removed, and files with overlapping replacements are
+// reported instead of being changed.
+MergedReplacements mergeReplacements(std::vector<Replacement> replacements);
+
+// Applies `replacements` of a file, sorted by offset, to its `content`.
+// Throws PoacError if one is out of range.
+std::string applyReplacements(
+    std::string_view content, const std::vector<Replacement>& replacements
+);
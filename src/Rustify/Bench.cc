@@ -0,0 +1,61 @@
+#include "Bench.hpp"
+
+#ifdef POAC_TEST
+
+#  include "Tests.hpp"
+
+#  include <chrono>
+#  include <cstdint>
+#  include <vector>
+
+namespace tests {
+
+static void
+testMedian() {
+  assertEq(benches::median({}), 0.0);
+  assertEq(benches::median({ 3.0 }), 3.0);
+  assertEq(benches::median({ 3.0, 1.0, 2.0 }), 2.0);
+  assertEq(benches::median({ 4.0, 1.0, 3.0, 2.0 }), 2.5);
+  assertEq(benches::median({ 5.0, 5.0, 1.0, 1.0 }), 3.0);
+
+  pass();
+}
+
+static void
+testMedianAbsDeviation() {
+  // Deviations from 3 are 2, 1, 0, 1, and 97; the outlier barely counts.
+  const std::vector<double> values = { 1.0, 2.0, 3.0, 4.0, 100.0 };
+  assertEq(benches::median(values), 3.0);
+  assertEq(benches::medianAbsDeviation(values, 3.0), 1.0);
+  // Deviations from 2.5 are 1.5, 0.5, 0.5, and 1.5.
+  assertEq(benches::medianAbsDeviation({ 1.0, 2.0, 3.0, 4.0 }, 2.5), 1.0);
+
+  pass();
+}
+
+static void
+testMeasureSaturates() {
+  // No sample can take an hour, so calibration stops at the cap.
+  const benches::Options opts{ .warmUpTime = std::chrono::milliseconds(0),
+                               .minSampleTime = std::chrono::hours(1),
+                               .maxItersPerSample = 1000,
+                               .numSamples = 3 };
+  uint64_t count = 0;
+  const benches::Stats stats = benches::measure([&] { ++count; }, opts);
+  assertEq(stats.itersPerSample, uint64_t{ 1000 });
+  assertEq(stats.numSamples, 3UL);
+  assertTrue(count >= 3 * 1000);
+
+  pass();
+}
+
+}  // namespace tests
+
+int
+main() {
+  tests::testMedian();
+  tests::testMedianAbsDeviation();
+  tests::testMeasureSaturates();
+}
+
+#endif
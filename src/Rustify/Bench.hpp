@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Tests.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <source_location>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A micro-benchmark harness for `#ifdef POAC_BENCH` blocks, run by
+// `poac bench`:
+//
+//   static void benchUpdate() {
+//     Hasher hasher;
+//     benches::run([&] { benches::doNotOptimize(hasher.update("abc")); });
+//   }
+//
+// Each benchmark is warmed up, its iteration count per sample is calibrated
+// so that a sample takes long enough to time reliably, and the median and
+// the median absolute deviation (MAD) of the samples are reported.
+namespace benches {
+
+using Clock = std::chrono::steady_clock;
+
+// Prevents the compiler from optimizing out the computation of `value`.
+template <typename T>
+inline void
+doNotOptimize(const T& value) noexcept {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+template <typename T>
+inline void
+doNotOptimize(T& value) noexcept {
+  asm volatile("" : "+r,m"(value) : : "memory");
+}
+
+// Forces pending writes to memory to be considered observable.
+inline void
+clobberMemory() noexcept {
+  asm volatile("" : : : "memory");
+}
+
+struct Options {
+  Clock::duration warmUpTime = std::chrono::milliseconds(100);
+  // Iterations are doubled until a sample takes at least this long.
+  Clock::duration minSampleTime = std::chrono::milliseconds(10);
+  // ... or until there are this many, e.g., if `func` is optimized out and
+  // a sample takes no time at all.
+  uint64_t maxItersPerSample = uint64_t{ 1 } << 30;
+  size_t numSamples = 30;
+};
+
+struct Stats {
+  double median;  // ns/iter
+  double mad;     // ns/iter
+  uint64_t itersPerSample;
+  size_t numSamples;
+};
+
+inline double
+median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  const size_t mid = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + mid, values.end());
+  const double upper = values[mid];
+  if (values.size() % 2 != 0) {
+    return upper;
+  }
+  const double lower = *std::max_element(values.begin(), values.begin() + mid);
+  return (lower + upper) / 2;
+}
+
+// The median absolute deviation of `values` from their median `med`.
+inline double
+medianAbsDeviation(const std::vector<double>& values, const double med) {
+  std::vector<double> deviations;
+  deviations.reserve(values.size());
+  for (const double value : values) {
+    deviations.push_back(value < med ? med - value : value - med);
+  }
+  return median(std::move(deviations));
+}
+
+template <typename Fn>
+inline Clock::duration
+timeIters(Fn& func, const uint64_t iters) {
+  const Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < iters; ++i) {
+    func();
+  }
+  return Clock::now() - start;
+}
+
+template <typename Fn>
+  requires(std::is_invocable_v<Fn&>)
+inline Stats
+measure(Fn&& func, const Options& opts = {}) {
+  // Warm up caches, branch predictors, and the CPU frequency while
+  // calibrating.
+  uint64_t iters = 1;
+  const Clock::time_point warmUpEnd = Clock::now() + opts.warmUpTime;
+  while (true) {
+    const Clock::duration elapsed = timeIters(func, iters);
+    const bool isLongEnough =
+        elapsed >= opts.minSampleTime || iters >= opts.maxItersPerSample;
+    if (isLongEnough && Clock::now() >= warmUpEnd) {
+      break;
+    }
+    if (!isLongEnough) {
+      iters = std::min(iters * 2, opts.maxItersPerSample);
+    }
+  }
+
+  std::vector<double> samples;
+  samples.reserve(opts.numSamples);
+  for (size_t i = 0; i < opts.numSamples; ++i) {
+    const std::chrono::duration<double, std::nano> elapsed =
+        timeIters(func, iters);
+    samples.push_back(elapsed.count() / static_cast<double>(iters));
+  }
+
+  const double med = median(samples);
+  return { .median = med,
+           .mad = medianAbsDeviation(samples, med),
+           .itersPerSample = iters,
+           .numSamples = samples.size() };
+}
+
+// Measures `func` and reports the result under the name of the calling
+// function, like tests::pass().
+template <typename Fn>
+  requires(std::is_invocable_v<Fn&>)
+inline Stats
+run(Fn&& func, const Options& opts = {},
+    const std::source_location& loc = std::source_location::current()) {
+  const Stats stats = measure(std::forward<Fn>(func), opts);
+  std::cout << "      bench " << tests::getModName(loc.file_name())
+            << "::" << tests::prettifyFuncName(loc.function_name()) << " ... "
+            << tests::GREEN << std::fixed << std::setprecision(2)
+            << stats.median << " ns/iter" << tests::RESET << " (+/- "
+            << stats.mad << ", " << stats.itersPerSample << " iters x "
+            << stats.numSamples << ")\n"
+            << std::defaultfloat << std::flush;
+  return stats;
+}
+
+}  // namespace benches
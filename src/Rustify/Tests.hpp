@@ -5,14 +5,17 @@
 #include <cstddef>
 #include <cstdlib>
 #include <exception>
+#include <filesystem>
 #include <iostream>
 #include <source_location>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <type_traits>
 #include <typeinfo>
+#include <unistd.h>
 #include <utility>
 
 namespace tests {
@@ -190,6 +193,33 @@ assertLt(
   }
 }
 
+// A fresh directory under the system temp directory, removed again when the
+// fixture goes out of scope -- including when an assertion throws.
+class TempDir {
+  std::filesystem::path dir;
+
+public:
+  explicit TempDir(const std::string_view prefix)
+      : dir(std::filesystem::temp_directory_path()
+            / (std::string(prefix) + '-' + std::to_string(getpid()))) {
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+  }
+
+  TempDir(const TempDir&) = delete;
+  TempDir& operator=(const TempDir&) = delete;
+  TempDir(TempDir&&) = delete;
+  TempDir& operator=(TempDir&&) = delete;
+
+  const std::filesystem::path& path() const noexcept {
+    return dir;
+  }
+};
+
 template <typename E, typename Fn>
   requires(std::is_invocable_v<Fn>)
 inline void
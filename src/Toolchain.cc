@@ -0,0 +1,326 @@
+#include "Toolchain.hpp"
+
+#include "Algos.hpp"
+#include "Command.hpp"
+#include "Exception.hpp"
+#include "Logger.hpp"
+#include "Manifest.hpp"
+#include "Rustify.hpp"
+
+#include <cstdlib>
+#include <fmt/core.h>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+static fs::path
+getToolchainCachePath() {
+  return getCacheDir() / "toolchain.json";
+}
+
+static std::string
+getStamp(const std::optional<fs::path>& path) {
+  if (!path.has_value()) {
+    return "";
+  }
+  return getFileStamp(path.value());
+}
+
+// Resolves the executables in CXX.  It may have a launcher, e.g., `ccache
+// g++`, in which case the compiler comes last.
+static std::vector<fs::path>
+findCompiler(const std::string_view cxx) {
+  std::vector<fs::path> paths;
+  for (const auto part : std::views::split(cxx, ' ')) {
+    const std::string_view word(part.begin(), part.end());
+    if (word.empty() || word.starts_with('-')) {
+      continue;
+    }
+    if (std::optional<fs::path> path = findExecutable(word)) {
+      paths.push_back(std::move(path.value()));
+    }
+  }
+  return paths;
+}
+
+// Stamps every executable in CXX, so that upgrading the compiler behind a
+// launcher invalidates the cache too.
+static std::string
+getCompilerStamp(const std::string_view cxx) {
+  std::string stamp;
+  for (const fs::path& path : findCompiler(cxx)) {
+    stamp += getFileStamp(path) + '\n';
+  }
+  return stamp;
+}
+
+// Everything the probe depends on, except the compiler binary itself, which
+// is resolved from the cached command and checked separately.
+static std::string
+getCacheKey() {
+  const char* path = std::getenv("PATH");
+  const char* cxx = std::getenv("CXX");
+  std::string key = fmt::format(
+      "PATH={}\nCXX={}", path != nullptr ? path : "", cxx != nullptr ? cxx : ""
+  );
+  if (cxx == nullptr) {
+    // The default CXX depends on make.
+    key += "\nmake=" + getStamp(findExecutable("make"));
+  }
+  return key;
+}
+
+static std::string
+getMakeDefaultCxx() {
+  const std::string output = Command("make")
+                                 .addArg("--print-data-base")
+                                 .addArg("--question")
+                                 .addArg("-f")
+                                 .addArg("/dev/null")
+                                 .setStderrConfig(Command::IOConfig::Null)
+                                 .output()
+                                 .stdout;
+  std::istringstream iss(output);
+  std::string line;
+
+  while (std::getline(iss, line)) {
+    if (line.starts_with("CXX = ")) {
+      return line.substr("CXX = "sv.size());
+    }
+  }
+  throw PoacError("failed to get CXX from make");
+}
+
+// Returns the output, or an empty string on failure.
+static std::string
+getOutput(const Command& cmd) {
+  CommandOutput output;
+  try {
+    output = Command(cmd).setStderrConfig(Command::IOConfig::Null).output();
+  } catch (const PoacError& e) {
+    logger::debug("{}", e.what());
+    return "";
+  }
+  if (output.exitCode != EXIT_SUCCESS) {
+    return "";
+  }
+  return output.stdout;
+}
+
+static std::string
+getFirstLine(const Command& cmd) {
+  const std::string output = getOutput(cmd);
+  return output.substr(0, output.find('\n'));
+}
+
+static Toolchain
+probeToolchain() {
+  Toolchain toolchain;
+  if (const char* cxx = std::getenv("CXX")) {
+    toolchain.cxx = cxx;
+  } else {
+    toolchain.cxx = getMakeDefaultCxx();
+  }
+  if (const std::vector<fs::path> paths = findCompiler(toolchain.cxx);
+      !paths.empty()) {
+    toolchain.cxxPath = paths.back();
+  }
+  toolchain.cxxVersion =
+      getFirstLine(Command(toolchain.cxx).addArg("--version"));
+  toolchain.targetTriple =
+      getFirstLine(Command(toolchain.cxx).addArg("-dumpmachine"));
+  return toolchain;
+}
+
+// Guards the cache below; flags may be checked from multiple threads.
+static std::mutex cacheMtx;
+// The contents of toolchain.json.  Tools are kept apart from the toolchain
+// as each entry is validated on its own.
+static std::optional<nlohmann::json> cacheJson = std::nullopt;
+static std::optional<Toolchain> cachedToolchain = std::nullopt;
+static std::unordered_map<std::string, bool> cachedFlags;
+
+static nlohmann::json&
+loadCacheJson() {
+  if (cacheJson.has_value()) {
+    return cacheJson.value();
+  }
+
+  cacheJson = nlohmann::json::object();
+  if (std::ifstream ifs(getToolchainCachePath()); ifs) {
+    try {
+      nlohmann::json cache = nlohmann::json::parse(ifs);
+      if (cache.is_object()) {
+        cacheJson = std::move(cache);
+      }
+    } catch (const nlohmann::json::exception& e) {
+      logger::debug("ignoring broken toolchain cache: {}", e.what());
+    }
+  }
+  return cacheJson.value();
+}
+
+static void
+saveCacheJson() {
+  try {
+    fs::create_directories(getCacheDir());
+    writeFileAtomically(getToolchainCachePath(), cacheJson->dump(2));
+  } catch (const fs::filesystem_error& e) {
+    logger::debug("failed to save toolchain cache: {}", e.what());
+  }
+}
+
+static void
+saveCache() {
+  nlohmann::json flags = nlohmann::json::object();
+  for (const auto& [flag, supported] : cachedFlags) {
+    flags[flag] = supported;
+  }
+  const Toolchain& toolchain = cachedToolchain.value();
+  nlohmann::json& cache = loadCacheJson();
+  cache["key"] = getCacheKey();
+  cache["cxx"] = toolchain.cxx;
+  cache["cxxPath"] = toolchain.cxxPath.string();
+  cache["cxxStamp"] = getCompilerStamp(toolchain.cxx);
+  cache["cxxVersion"] = toolchain.cxxVersion;
+  cache["targetTriple"] = toolchain.targetTriple;
+  cache["flags"] = flags;
+  saveCacheJson();
+}
+
+static bool
+loadCache() {
+  const nlohmann::json& cache = loadCacheJson();
+  if (!cache.contains("key")) {
+    return false;
+  }
+
+  try {
+    if (cache.at("key").get<std::string>() != getCacheKey()) {
+      logger::debug("toolchain environment has changed");
+      return false;
+    }
+
+    Toolchain toolchain;
+    toolchain.cxx = cache.at("cxx").get<std::string>();
+    if (cache.at("cxxStamp").get<std::string>()
+        != getCompilerStamp(toolchain.cxx)) {
+      logger::debug("{} has changed", toolchain.cxx);
+      return false;
+    }
+    toolchain.cxxPath = cache.at("cxxPath").get<std::string>();
+    toolchain.cxxVersion = cache.at("cxxVersion").get<std::string>();
+    toolchain.targetTriple = cache.at("targetTriple").get<std::string>();
+
+    cachedToolchain = std::move(toolchain);
+    cachedFlags =
+        cache.at("flags").get<std::unordered_map<std::string, bool>>();
+    return true;
+  } catch (const nlohmann::json::exception& e) {
+    logger::debug("ignoring broken toolchain cache: {}", e.what());
+    return false;
+  }
+}
+
+static const Toolchain&
+getToolchainLocked() {
+  if (cachedToolchain.has_value()) {
+    return cachedToolchain.value();
+  }
+  if (!loadCache()) {
+    cachedToolchain = probeToolchain();
+    cachedFlags.clear();
+    saveCache();
+  }
+  logger::debug(
+      "Toolchain: {} ({}, {})", cachedToolchain->cxx,
+      cachedToolchain->cxxVersion, cachedToolchain->targetTriple
+  );
+  return cachedToolchain.value();
+}
+
+const Toolchain&
+getToolchain() {
+  const std::lock_guard lock(cacheMtx);
+  return getToolchainLocked();
+}
+
+bool
+isFlagSupported(const std::string_view flag) {
+  const std::lock_guard lock(cacheMtx);
+  const Toolchain& toolchain = getToolchainLocked();
+  if (const auto found = cachedFlags.find(std::string(flag));
+      found != cachedFlags.end()) {
+    return found->second;
+  }
+
+  // -Werror makes compilers reject unknown warning options.
+  const Command cmd = Command(toolchain.cxx)
+                          .addArg("-Werror")
+                          .addArg(flag)
+                          .addArg("-x")
+                          .addArg("c++")
+                          .addArg("-fsyntax-only")
+                          .addArg("/dev/null")
+                          .setStdoutConfig(Command::IOConfig::Null)
+                          .setStderrConfig(Command::IOConfig::Null);
+  bool supported = false;
+  try {
+    supported = cmd.spawn().wait() == EXIT_SUCCESS;
+  } catch (const PoacError& e) {
+    // The build itself reports a missing compiler.
+    logger::debug("{}", e.what());
+  }
+  cachedFlags.emplace(flag, supported);
+  saveCache();
+  return supported;
+}
+
+std::optional<Tool>
+findTool(const std::string_view name) {
+  // Not-found results are not cached so that installing the tool takes
+  // effect immediately.
+  const std::optional<fs::path> path = findExecutable(name);
+  if (!path.has_value()) {
+    return std::nullopt;
+  }
+  const std::string stamp = getFileStamp(path.value());
+
+  const std::lock_guard lock(cacheMtx);
+  nlohmann::json& tools = loadCacheJson()["tools"];
+  if (!tools.is_object()) {
+    tools = nlohmann::json::object();
+  }
+  try {
+    if (const auto found = tools.find(std::string(name)); found != tools.end()
+        && found->at("path").get<std::string>() == path->string()
+        && found->at("stamp").get<std::string>() == stamp) {
+      return Tool{ .path = path.value(),
+                   .stamp = stamp,
+                   .version = found->at("version").get<std::string>() };
+    }
+  } catch (const nlohmann::json::exception& e) {
+    logger::debug("ignoring broken cache entry of {}: {}", name, e.what());
+  }
+
+  const Tool tool{
+    .path = path.value(),
+    .stamp = stamp,
+    .version = getOutput(Command(path->string()).addArg("--version")),
+  };
+  tools[std::string(name)] = {
+    { "path", tool.path.string() },
+    { "stamp", tool.stamp },
+    { "version", tool.version },
+  };
+  saveCacheJson();
+  return tool;
+}
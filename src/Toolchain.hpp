@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Rustify.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+// The C++ toolchain poac builds with.  Probing it spawns the compiler (and
+// make, for its default CXX), so the results are cached in
+// ~/.cache/poac/toolchain.json until PATH, CXX, or the binaries change.
+// poac links with $(CXX) as well, so the linker is whichever one the
+// compiler driver picks.
+struct Toolchain {
+  // The compiler command: $CXX, or the default CXX of make.
+  std::string cxx;
+  // The resolved compiler executable; empty if it was not found in PATH.
+  fs::path cxxPath;
+  // The first line of `$(CXX) --version`.
+  std::string cxxVersion;
+  // The output of `$(CXX) -dumpmachine`, e.g., x86_64-pc-linux-gnu.
+  std::string targetTriple;
+};
+
+const Toolchain& getToolchain();
+
+// Returns whether the compiler accepts `flag`.  The result is cached along
+// with the toolchain.
+bool isFlagSupported(std::string_view flag);
+
+// An auxiliary tool, e.g., clang-format.
+struct Tool {
+  // The resolved executable.
+  fs::path path;
+  // Identifies the binary; see getFileStamp().
+  std::string stamp;
+  // The output of `<tool> --version`.
+  std::string version;
+};
+
+// Looks up `name` in PATH.  Its version is cached in toolchain.json until the
+// binary changes.
+std::optional<Tool> findTool(std::string_view name);
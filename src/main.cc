@@ -44,6 +44,7 @@ getCli() noexcept {
                       .setGlobal(false)
                       .setHidden(true))
           .addSubcmd(ADD_CMD)
+          .addSubcmd(BENCH_CMD)
           .addSubcmd(BUILD_CMD)
           .addSubcmd(CLEAN_CMD)
           .addSubcmd(FMT_CMD)
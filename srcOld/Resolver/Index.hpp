@@ -0,0 +1,529 @@
+module;
+
+// std
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// external
+#include <fcntl.h> // NOLINT(build/include_order)
+#include <sys/mman.h> // NOLINT(build/include_order)
+#include <sys/stat.h> // NOLINT(build/include_order)
+#include <unistd.h> // NOLINT(build/include_order)
+
+export module poac.core.resolver.index;
+
+import poac.util.format;
+import poac.util.result;
+import poac.util.rustify;
+import poac.core.resolver.types;
+import semver;
+
+// A registry index that the resolver reads without network round-trips.  It
+// is a single file mapped into memory as is, so opening it costs nothing
+// regardless of its size, and lookups only touch the pages they need.
+//
+// All integers are u32 in native byte order, and every section is an array
+// of them, so the file needs no parsing:
+//
+// Header
+// u32    buckets[bucket_count]     package number + 1, or 0 if empty
+// Entry  packages[package_count]   { name, first version, version count }
+// Entry  versions[version_count]   { version, first dep, dep count }
+// Dep    deps[dep_count]           { name, version_rq, index, type }
+// char   strings[strings_size]
+//
+// Packages are found by the FNV-1a hash of their name with linear probing.
+// The versions of a package are contiguous and sorted by semver, then by
+// string, and so are the deps of a version by name.  Strings are
+// deduplicated.
+export namespace poac::core::resolver::index {
+
+using resolve::DependencyInfo;
+using resolve::UniqDeps;
+using resolve::WithoutDeps;
+
+inline constexpr std::array<char, 8> MAGIC = { 'P', 'O', 'A', 'C',
+                                               'I', 'D', 'X', '\0' };
+inline constexpr u32 FORMAT_VERSION = 1;
+
+// The versions of a package and the dependencies of each version
+struct IndexedVersion {
+  std::string version;
+  UniqDeps<WithoutDeps> deps;
+};
+
+using Packages = std::unordered_map<std::string, std::vector<IndexedVersion>>;
+
+} // namespace poac::core::resolver::index
+
+namespace poac::core::resolver::index {
+
+struct Str {
+  u32 offset;
+  u32 size;
+};
+
+struct Header {
+  std::array<char, 8> magic;
+  u32 format_version;
+  u32 bucket_count;
+  u32 package_count;
+  u32 version_count;
+  u32 dep_count;
+  u32 strings_size;
+};
+
+struct Entry {
+  Str name;
+  u32 first;
+  u32 count;
+};
+
+struct Dep {
+  Str name;
+  Str version_rq;
+  Str index;
+  Str type;
+};
+
+inline auto
+fnv1a(std::string_view s) noexcept -> u32 {
+  u32 hash = 2166136261U; // NOLINT(readability-magic-numbers)
+  for (const char c : s) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619U; // NOLINT(readability-magic-numbers)
+  }
+  return hash;
+}
+
+// A power of two with at most half of the buckets used
+inline auto
+bucket_count_for(const usize package_count) noexcept -> u32 {
+  u32 count = 1;
+  while (count < package_count * 2) {
+    count <<= 1;
+  }
+  return count;
+}
+
+// Versions equal in semver, e.g., differing only in build metadata, are
+// ordered by their strings so that each has a distinct place in the index.
+inline auto
+version_less(
+    const semver::Version& lhs, std::string_view lhs_str,
+    const semver::Version& rhs, std::string_view rhs_str
+) -> bool {
+  if (lhs < rhs) {
+    return true;
+  }
+  if (rhs < lhs) {
+    return false;
+  }
+  return lhs_str < rhs_str;
+}
+
+class StringPool {
+  std::string data;
+  std::map<std::string, u32, std::less<>> offsets;
+
+public:
+  auto
+  add(std::string_view s) -> Str {
+    const auto found = offsets.find(s);
+    if (found != offsets.end()) {
+      return { found->second, static_cast<u32>(s.size()) };
+    }
+    const auto offset = static_cast<u32>(data.size());
+    data += s;
+    offsets.emplace(std::string(s), offset);
+    return { offset, static_cast<u32>(s.size()) };
+  }
+
+  auto
+  str() const noexcept -> const std::string& {
+    return data;
+  }
+};
+
+template <typename T>
+inline void
+write_array(std::ofstream& ofs, const std::vector<T>& v) {
+  ofs.write(
+      reinterpret_cast<const char*>(v.data()), // NOLINT
+      static_cast<std::streamsize>(v.size() * sizeof(T))
+  );
+}
+
+} // namespace poac::core::resolver::index
+
+export namespace poac::core::resolver::index {
+
+// Writes `packages` to `path`, replacing it atomically so that a resolver
+// never maps a half-written index.
+[[nodiscard]] auto
+write(const fs::path& path, const Packages& packages)
+    -> Result<void, std::string> {
+  std::vector<std::string_view> names;
+  names.reserve(packages.size());
+  for (const auto& [name, versions] : packages) {
+    names.emplace_back(name);
+  }
+  std::sort(names.begin(), names.end());
+
+  StringPool strings;
+  std::vector<Entry> package_entries;
+  std::vector<Entry> version_entries;
+  std::vector<Dep> deps;
+  for (const std::string_view name : names) {
+    // Parsed once here, so that an invalid version is rejected rather than
+    // thrown at a resolver looking it up.
+    std::vector<std::pair<semver::Version, const IndexedVersion*>> versions;
+    for (const IndexedVersion& v : packages.find(std::string(name))->second) {
+      try {
+        versions.emplace_back(semver::Version(v.version), &v);
+      } catch (const std::exception& e) {
+        return Err(format(
+            "invalid version `{}` of `{}`: {}", v.version, name, e.what()
+        ));
+      }
+    }
+    std::sort(
+        versions.begin(), versions.end(),
+        [](const auto& lhs, const auto& rhs) {
+          return version_less(
+              lhs.first, lhs.second->version, rhs.first, rhs.second->version
+          );
+        }
+    );
+    const auto dup = std::adjacent_find(
+        versions.begin(), versions.end(),
+        [](const auto& lhs, const auto& rhs) {
+          return lhs.second->version == rhs.second->version;
+        }
+    );
+    if (dup != versions.end()) {
+      return Err(format(
+          "duplicate version `{}` of `{}`", dup->second->version, name
+      ));
+    }
+
+    package_entries.push_back(
+        { strings.add(name), static_cast<u32>(version_entries.size()),
+          static_cast<u32>(versions.size()) }
+    );
+    for (const auto& entry : versions) {
+      const IndexedVersion* v = entry.second;
+      std::vector<std::string_view> dep_names;
+      for (const auto& [dep_name, dep_info] : v->deps) {
+        dep_names.emplace_back(dep_name);
+      }
+      std::sort(dep_names.begin(), dep_names.end());
+
+      version_entries.push_back(
+          { strings.add(v->version), static_cast<u32>(deps.size()),
+            static_cast<u32>(dep_names.size()) }
+      );
+      for (const std::string_view dep_name : dep_names) {
+        const DependencyInfo& info =
+            v->deps.find(std::string(dep_name))->second;
+        deps.push_back(
+            { strings.add(dep_name), strings.add(info.version_rq),
+              strings.add(info.index), strings.add(info.type) }
+        );
+      }
+    }
+  }
+
+  std::vector<u32> buckets(bucket_count_for(package_entries.size()), 0);
+  const u32 mask = static_cast<u32>(buckets.size()) - 1;
+  for (usize i = 0; i < package_entries.size(); ++i) {
+    u32 b = fnv1a(names[i]) & mask;
+    while (buckets[b] != 0) {
+      b = (b + 1) & mask;
+    }
+    buckets[b] = static_cast<u32>(i) + 1;
+  }
+
+  const Header header{
+    .magic = MAGIC,
+    .format_version = FORMAT_VERSION,
+    .bucket_count = static_cast<u32>(buckets.size()),
+    .package_count = static_cast<u32>(package_entries.size()),
+    .version_count = static_cast<u32>(version_entries.size()),
+    .dep_count = static_cast<u32>(deps.size()),
+    .strings_size = static_cast<u32>(strings.str().size()),
+  };
+
+  fs::path tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    ofs.write(
+        reinterpret_cast<const char*>(&header), // NOLINT
+        sizeof(header)
+    );
+    write_array(ofs, buckets);
+    write_array(ofs, package_entries);
+    write_array(ofs, version_entries);
+    write_array(ofs, deps);
+    ofs << strings.str();
+    if (!ofs) {
+      return Err(format("failed to write `{}`", tmp.string()));
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    return Err(format("failed to write `{}`: {}", path.string(), ec.message()));
+  }
+  return Ok();
+}
+
+// A read-only view of an index file mapped into memory
+class Index {
+  const char* data = nullptr;
+  usize size = 0;
+
+  const Header* header = nullptr;
+  std::span<const u32> buckets;
+  std::span<const Entry> packages;
+  std::span<const Entry> versions;
+  std::span<const Dep> deps;
+  std::string_view strings;
+
+  Index(const char* d, const usize s) : data(d), size(s) {}
+
+  template <typename T>
+  auto
+  section(usize& offset, const u32 count) const
+      -> std::optional<std::span<const T>> {
+    if (count > (size - offset) / sizeof(T)) {
+      return std::nullopt;
+    }
+    const std::span<const T> s(
+        reinterpret_cast<const T*>(data + offset), count // NOLINT
+    );
+    offset += count * sizeof(T);
+    return s;
+  }
+
+  // Checks every offset once so that lookups need not.
+  auto
+  is_valid() const noexcept -> bool {
+    const auto valid_str = [this](const Str& s) {
+      return s.offset <= strings.size() && s.size <= strings.size() - s.offset;
+    };
+    const auto valid_range = [](const Entry& e, const usize n) {
+      return e.first <= n && e.count <= n - e.first;
+    };
+    // An empty bucket ends every probe.
+    return std::find(buckets.begin(), buckets.end(), 0) != buckets.end()
+           && std::all_of(
+               buckets.begin(), buckets.end(),
+               [this](const u32 b) { return b <= packages.size(); }
+           )
+           && std::all_of(
+               packages.begin(), packages.end(),
+               [&](const Entry& e) {
+                 return valid_str(e.name) && valid_range(e, versions.size());
+               }
+           )
+           && std::all_of(
+               versions.begin(), versions.end(),
+               [&](const Entry& e) {
+                 return valid_str(e.name) && valid_range(e, deps.size());
+               }
+           )
+           && std::all_of(deps.begin(), deps.end(), [&](const Dep& d) {
+                return valid_str(d.name) && valid_str(d.version_rq)
+                       && valid_str(d.index) && valid_str(d.type);
+              });
+  }
+
+  auto
+  str(const Str& s) const noexcept -> std::string_view {
+    return strings.substr(s.offset, s.size);
+  }
+
+  auto
+  find(std::string_view name) const noexcept -> const Entry* {
+    if (buckets.empty()) {
+      return nullptr;
+    }
+    const u32 mask = static_cast<u32>(buckets.size()) - 1;
+    for (u32 b = fnv1a(name) & mask; buckets[b] != 0; b = (b + 1) & mask) {
+      const Entry& entry = packages[buckets[b] - 1];
+      if (str(entry.name) == name) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  auto
+  version_entries(const Entry& package) const noexcept
+      -> std::span<const Entry> {
+    return versions.subspan(package.first, package.count);
+  }
+
+public:
+  Index(const Index&) = delete;
+  auto operator=(const Index&) -> Index& = delete;
+
+  Index(Index&& other) noexcept
+      : data(std::exchange(other.data, nullptr)),
+        size(std::exchange(other.size, 0)), header(other.header),
+        buckets(other.buckets), packages(other.packages),
+        versions(other.versions), deps(other.deps), strings(other.strings) {}
+
+  auto
+  operator=(Index&& other) noexcept -> Index& {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    std::swap(header, other.header);
+    std::swap(buckets, other.buckets);
+    std::swap(packages, other.packages);
+    std::swap(versions, other.versions);
+    std::swap(deps, other.deps);
+    std::swap(strings, other.strings);
+    return *this;
+  }
+
+  ~Index() {
+    if (data != nullptr) {
+      munmap(const_cast<char*>(data), size); // NOLINT
+    }
+  }
+
+  [[nodiscard]] static auto
+  open(const fs::path& path) -> Result<Index, std::string> {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      return Err(format("failed to open `{}`", path.string()));
+    }
+    struct stat st {};
+    if (fstat(fd, &st) == -1 || st.st_size < 0
+        || static_cast<usize>(st.st_size) < sizeof(Header)) {
+      close(fd);
+      return Err(format("`{}` is not a registry index", path.string()));
+    }
+    const auto file_size = static_cast<usize>(st.st_size);
+    void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) { // NOLINT
+      return Err(format("failed to map `{}`", path.string()));
+    }
+
+    Index index(static_cast<const char*>(mapped), file_size);
+    index.header = reinterpret_cast<const Header*>(index.data); // NOLINT
+    if (index.header->magic != MAGIC) {
+      return Err(format("`{}` is not a registry index", path.string()));
+    }
+    if (index.header->format_version != FORMAT_VERSION) {
+      return Err(format(
+          "`{}` has unsupported format version {}", path.string(),
+          index.header->format_version
+      ));
+    }
+
+    usize offset = sizeof(Header);
+    const auto buckets = index.section<u32>(offset, index.header->bucket_count);
+    const auto packages =
+        index.section<Entry>(offset, index.header->package_count);
+    const auto versions =
+        index.section<Entry>(offset, index.header->version_count);
+    const auto deps = index.section<Dep>(offset, index.header->dep_count);
+    const auto strings =
+        index.section<char>(offset, index.header->strings_size);
+    if (!buckets || !packages || !versions || !deps || !strings
+        || (buckets->size() & (buckets->size() - 1)) != 0) {
+      return Err(format("`{}` is truncated", path.string()));
+    }
+    index.buckets = *buckets;
+    index.packages = *packages;
+    index.versions = *versions;
+    index.deps = *deps;
+    index.strings = std::string_view(strings->data(), strings->size());
+    if (!index.is_valid()) {
+      return Err(format("`{}` is corrupted", path.string()));
+    }
+    return Ok(std::move(index));
+  }
+
+  auto
+  package_count() const noexcept -> usize {
+    return packages.size();
+  }
+
+  // All versions of a package in ascending order, or std::nullopt if the
+  // package is not in the index.  They point into the mapping.
+  auto
+  versions_of(std::string_view name) const
+      -> std::optional<std::vector<std::string_view>> {
+    const Entry* package = find(name);
+    if (package == nullptr) {
+      return std::nullopt;
+    }
+    std::vector<std::string_view> result;
+    result.reserve(package->count);
+    for (const Entry& version : version_entries(*package)) {
+      result.emplace_back(str(version.name));
+    }
+    return result;
+  }
+
+  // The dependencies of a version of a package, or std::nullopt if either is
+  // not in the index
+  auto
+  deps_of(std::string_view name, std::string_view version) const
+      -> std::optional<UniqDeps<WithoutDeps>> {
+    const Entry* package = find(name);
+    if (package == nullptr) {
+      return std::nullopt;
+    }
+    const std::span<const Entry> vs = version_entries(*package);
+    const Entry* found = nullptr;
+    try {
+      const semver::Version target(version);
+      const auto itr =
+          std::partition_point(vs.begin(), vs.end(), [&](const Entry& v) {
+            return version_less(
+                semver::Version(str(v.name)), str(v.name), target, version
+            );
+          });
+      // Compare the exact strings; build metadata does not count in semver.
+      if (itr != vs.end() && str(itr->name) == version) {
+        found = &*itr;
+      }
+    } catch (const std::exception&) {
+      // Not a valid version, or a corrupted index.
+    }
+    if (found == nullptr) {
+      return std::nullopt;
+    }
+
+    UniqDeps<WithoutDeps> result;
+    for (const Dep& dep : deps.subspan(found->first, found->count)) {
+      result.emplace(
+          std::string(str(dep.name)),
+          DependencyInfo{ .version_rq = std::string(str(dep.version_rq)),
+                          .index = std::string(str(dep.index)),
+                          .type = std::string(str(dep.type)) }
+      );
+    }
+    return result;
+  }
+};
+
+} // namespace poac::core::resolver::index
@@ -2,17 +2,21 @@ module;
 
 // std
 #include <algorithm>
+#include <cstdlib>
+#include <functional>
 #include <iterator>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 // external
-#include <boost/dynamic_bitset.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/algorithm.hpp>
 #include <boost/range/algorithm_ext/push_back.hpp>
-#include <boost/range/irange.hpp>
 
 // internal
 #include "../../util/result-macros.hpp"
@@ -24,6 +28,7 @@ import poac.util.log;
 import poac.util.meta;
 import poac.util.result;
 import poac.util.rustify;
+import poac.core.resolver.index;
 import poac.core.resolver.sat;
 import poac.core.resolver.types;
 import poac.util.net;
@@ -39,113 +44,116 @@ get_package(const UniqDeps<WithDeps>::value_type& deps
   return deps.first;
 }
 
+// Without this overload, an element of DupDeps would be converted, i.e.,
+// copied with all its dependencies, to the value type of UniqDeps above.
 inline auto
-to_binary_numbers(const i32& x, const usize& digit) -> std::string {
-  return format("{:0{}b}", x, digit);
+get_package(const DupDeps<WithDeps>::value_type& deps
+) noexcept -> const Package& {
+  return deps.first;
 }
 
-// A ∨ B ∨ C
-// A ∨ ¬B ∨ ¬C
-// ¬A ∨ B ∨ ¬C
-// ¬A ∨ ¬B ∨ C
-// ¬A ∨ ¬B ∨ ¬C
+// Exactly one of the literals in `clause` is true: at least one, by `clause`
+// itself, and at most one.  The latter uses the sequential counter of Sinz
+// (2005), whose auxiliary variable s_i means that one of the first i + 1
+// literals is true, so the CNF grows linearly with the number of versions:
+//
+// ¬x_0 ∨ s_0
+// ¬x_i ∨ s_i,  ¬s_{i-1} ∨ s_i,  ¬x_i ∨ ¬s_{i-1}  (0 < i < n - 1)
+// ¬x_{n-1} ∨ ¬s_{n-2}
+//
+// Auxiliary variables are numbered from `next_var`, which is advanced past
+// them.
 auto
-multiple_versions_cnf(const std::vector<i32>& clause
-) -> std::vector<std::vector<i32>> {
-  return boost::irange(0, 1 << clause.size()) // number of combinations
-         | boost::adaptors::transformed([&clause](const i32 i) {
-             return boost::dynamic_bitset<>(to_binary_numbers(i, clause.size())
-             );
-           })
-         | boost::adaptors::filtered([](const boost::dynamic_bitset<>& bs) {
-             return bs.count() != 1;
-           })
-         | boost::adaptors::transformed(
-             [&clause](const boost::dynamic_bitset<>& bs) -> std::vector<i32> {
-               return boost::irange(usize{ 0 }, bs.size())
-                      | boost::adaptors::transformed([&clause,
-                                                      &bs](const i32 i) {
-                          return bs[i] ? clause[i] * -1 : clause[i];
-                        })
-                      | util::meta::CONTAINERIZED;
-             }
-         )
-         | util::meta::CONTAINERIZED;
+multiple_versions_cnf(const std::vector<i32>& clause, i32& next_var)
+    -> std::vector<std::vector<i32>> {
+  // Pairwise clauses are as few for a handful of versions and need no
+  // auxiliary variables.
+  constexpr usize pairwise_limit = 5;
+
+  std::vector<std::vector<i32>> clauses;
+  clauses.emplace_back(clause);
+  const usize n = clause.size();
+  if (n <= pairwise_limit) {
+    for (usize i = 0; i < n; ++i) {
+      for (usize j = i + 1; j < n; ++j) {
+        clauses.push_back({ -clause[i], -clause[j] });
+      }
+    }
+    return clauses;
+  }
+
+  const i32 first_aux = next_var;
+  next_var += static_cast<i32>(n - 1);
+  const auto s = [first_aux](const usize i) {
+    return first_aux + static_cast<i32>(i);
+  };
+
+  clauses.reserve(3 * n - 3);
+  clauses.push_back({ -clause[0], s(0) });
+  for (usize i = 1; i + 1 < n; ++i) {
+    clauses.push_back({ -clause[i], s(i) });
+    clauses.push_back({ -s(i - 1), s(i) });
+    clauses.push_back({ -clause[i], -s(i - 1) });
+  }
+  clauses.push_back({ -clause[n - 1], -s(n - 2) });
+  return clauses;
 }
 
+// Every gathered package is installed in exactly one of its versions, and
+// a version implies, for each of its dependencies, one of the versions
+// satisfying the requirement.
 auto
 create_cnf(const DupDeps<WithDeps>& activated
 ) -> std::vector<std::vector<i32>> {
   std::vector<std::vector<i32>> clauses;
-  std::vector<i32> already_added;
+  // Auxiliary variables of the encoding follow those of the packages.
+  i32 next_var = static_cast<i32>(activated.size()) + 1;
+
+  // Looked up by hash, as scanning `activated` for every dependency is
+  // quadratic in the number of gathered packages.
+  std::unordered_map<Package, i32, boost::hash<Package>> vars;
+  // All versions of each package, in the order they were gathered
+  std::unordered_map<std::string_view, std::vector<i32>> versions_of;
+  for (usize i = 0; i < activated.size(); ++i) {
+    const Package& package = get_package(activated[i]);
+    const i32 var = static_cast<i32>(i) + 1;
+    vars.emplace(package, var);
+    versions_of[package.name].emplace_back(var);
+  }
+  const auto to_var = [&vars](const Package& package) -> i32 {
+    // It is guaranteed to exist
+    return vars.at(package);
+  };
 
-  auto first = std::cbegin(activated);
-  auto last = std::cend(activated);
   for (usize i = 0; i < activated.size(); ++i) {
-    if (util::meta::find(already_added, i)) {
+    const std::vector<i32>& versions =
+        versions_of.at(get_package(activated[i]).name);
+    // Each package once, at its first version
+    if (versions.front() != static_cast<i32>(i) + 1) {
       continue;
     }
 
-    const auto name_lambda = [&](const auto& x) {
-      return get_package(x) == get_package(activated[i]);
-    };
-    // No other packages with the same name as the package currently pointed to
-    // exist
-    if (const i64 count = std::count_if(first, last, name_lambda); count == 1) {
-      std::vector<i32> clause;
-      clause.emplace_back(i + 1);
-      clauses.emplace_back(clause);
-
-      // index ⇒ deps
-      if (!activated[i].second.has_value()) {
-        clause[0] *= -1;
-        for (const auto& [name, dep_info] : activated[i].second.value()) {
-          // It is guaranteed to exist
-          clause.emplace_back(
-              util::meta::index_of_if(
-                  first, last,
-                  [&n = name, &di = dep_info](const auto& d) {
-                    return get_package(d).name == n
-                           && get_package(d).dep_info == di;
-                  }
-              )
-              + 1
-          );
-        }
-        clauses.emplace_back(clause);
+    for (const i32 version : versions) {
+      const Deps& deps = activated[version - 1].second;
+      if (!deps.has_value()) {
+        continue;
       }
-    } else if (count > 1) {
-      std::vector<i32> clause;
-
-      for (auto found = first; found != last;
-           found = std::find_if(found, last, name_lambda)) {
-        const i64 index = std::distance(first, found);
-        clause.emplace_back(index + 1);
-        already_added.emplace_back(index + 1);
-
-        // index ⇒ deps
-        if (!found->second.has_value()) {
-          std::vector<i32> new_clause;
-          new_clause.emplace_back(index);
-          for (const Package& package : found->second.value()) {
-            // It is guaranteed to exist
-            new_clause.emplace_back(
-                util::meta::index_of_if(
-                    first, last,
-                    [&package](const auto& p) {
-                      return get_package(p).name == package.name
-                             && get_package(p).dep_info == package.dep_info;
-                    }
-                )
-                + 1
-            );
-          }
-          clauses.emplace_back(new_clause);
+      // version ⇒ (one of the versions of each dependency)
+      // Versions of a dependency are gathered next to each other.
+      for (auto dep = deps->cbegin(); dep != deps->cend();) {
+        std::vector<i32> clause{ -version };
+        const auto next = std::find_if(dep, deps->cend(), [&](const auto& p) {
+          return p.name != dep->name;
+        });
+        for (; dep != next; ++dep) {
+          clause.emplace_back(to_var(*dep));
         }
-        ++found;
+        clauses.emplace_back(std::move(clause));
       }
-      boost::range::push_back(clauses, multiple_versions_cnf(clause));
     }
+    boost::range::push_back(
+        clauses, multiple_versions_cnf(versions, next_var)
+    );
   }
   return clauses;
 }
@@ -155,14 +163,19 @@ solve_sat(
     const DupDeps<WithDeps>& activated,
     const std::vector<std::vector<i32>>& clauses
 ) -> Result<UniqDeps<WithDeps>, std::string> {
-  // deps.activated.size() == variables
-  const std::vector<i32> assignments =
-      Try(sat::solve(clauses, activated.size()));
+  // Variables of the packages, followed by auxiliary ones of the encoding
+  auto variables = static_cast<u32>(activated.size());
+  for (const std::vector<i32>& clause : clauses) {
+    for (const i32 literal : clause) {
+      variables = std::max(variables, static_cast<u32>(std::abs(literal)));
+    }
+  }
+  const std::vector<i32> assignments = Try(sat::solve(clauses, variables));
   UniqDeps<WithDeps> resolved_deps{};
   log::debug("SAT");
   for (i32 a : assignments) {
     log::debug("{} ", a);
-    if (a > 0) {
+    if (a > 0 && static_cast<usize>(a) <= activated.size()) {
       const auto& [package, deps] = activated[a - 1];
       resolved_deps.emplace(package, deps);
     }
@@ -208,17 +221,73 @@ duplicate_loose(const SinglePassRange& rng) -> bool {
          != last;
 }
 
+// Where the resolver reads packages from: the registry API by default, or a
+// stand-in such as an in-memory registry for benchmarks.
+struct PackageSource {
+  // All versions of a package
+  std::function<Result<std::vector<std::string>, std::string>(
+      const std::string& name
+  )>
+      versions;
+  // The dependencies of a version of a package
+  std::function<Result<UniqDeps<WithoutDeps>, std::string>(
+      const std::string& name, const std::string& version
+  )>
+      deps;
+};
+
+inline auto
+registry_api() -> PackageSource {
+  return {
+    .versions = [](const std::string& name
+                ) -> Result<std::vector<std::string>, std::string> {
+      return Ok(Try(util::net::api::versions(name)));
+    },
+    .deps = [](const std::string& name, const std::string& version
+            ) -> Result<UniqDeps<WithoutDeps>, std::string> {
+      return Ok(util::net::api::deps(name, version).unwrap());
+    },
+  };
+}
+
+// Reads packages from a registry index mapped into memory, so that
+// resolution makes no network round-trips.  `idx` must outlive the source.
+inline auto
+index_source(const index::Index& idx) -> PackageSource {
+  return {
+    .versions = [&idx](const std::string& name
+                ) -> Result<std::vector<std::string>, std::string> {
+      const auto versions = idx.versions_of(name);
+      if (!versions.has_value()) {
+        return Err(format("`{}` not found in the registry index", name));
+      }
+      return Ok(std::vector<std::string>(versions->begin(), versions->end()));
+    },
+    .deps = [&idx](const std::string& name, const std::string& version
+            ) -> Result<UniqDeps<WithoutDeps>, std::string> {
+      auto deps = idx.deps_of(name, version);
+      if (!deps.has_value()) {
+        return Err(format(
+            "`{}: {}` not found in the registry index", name, version
+        ));
+      }
+      return Ok(std::move(deps.value()));
+    },
+  };
+}
+
 // Interval to multiple versions
 // `>=0.1.2 and <3.4.0` -> { 2.4.0, 2.5.0 }
 // name is boost/config, no boost-config
 [[nodiscard]] auto
-get_versions_satisfy_interval(const Package& package
+get_versions_satisfy_interval(
+    const Package& package, const PackageSource& source
 ) -> Result<std::vector<std::string>, std::string> {
   // TODO(ken-matsui): (`>1.2 and <=1.3.2` -> NG，`>1.2.0-alpha and <=1.3.2` ->
   // OK) `2.0.0` specific version or `>=0.1.2 and <3.4.0` version interval
   const semver::Interval i(package.dep_info.version_rq);
   const std::vector<std::string> satisfied_versions =
-      Try(util::net::api::versions(package.name))
+      Try(source.versions(package.name))
       | boost::adaptors::filtered([&i](std::string_view s) {
           return i.satisfies(s);
         })
@@ -233,66 +302,40 @@ get_versions_satisfy_interval(const Package& package
   return Ok(satisfied_versions);
 }
 
-// NOLINTNEXTLINE(bugprone-exception-escape)
-struct Cache {
-  Package package;
-
-  /// versions in the interval
-  std::vector<std::string> versions;
-};
-
-inline auto
-operator==(const Cache& lhs, const Cache& rhs) -> bool {
-  return lhs.package == rhs.package && lhs.versions == rhs.versions;
-}
-
-inline auto
-hash_value(const Cache& i) -> usize {
-  usize seed = 0;
-  boost::hash_combine(seed, i.package);
-  boost::hash_range(seed, i.versions.begin(), i.versions.end());
-  return seed;
-}
-
-using IntervalCache = std::unordered_set<Cache>;
+// Interval to the versions in it
+using IntervalCache =
+    std::unordered_map<Package, std::vector<std::string>, boost::hash<Package>>;
 
 inline auto
 cache_exists(const IntervalCache& cache, const Package& package) -> bool {
-  return util::meta::find_if(cache, [&package](const Cache& c) {
-    return c.package == package;
-  });
+  return cache.contains(package);
 }
 
-inline auto
-cache_exists(const DupDeps<WithDeps>& deps, const Package& package) -> bool {
-  return util::meta::find_if(deps, [&package](const auto& c) {
-    return get_package(c) == package;
-  });
-}
+// Packages already in the DupDeps being gathered
+using GatheredSet = std::unordered_set<Package, boost::hash<Package>>;
 
 auto
 gather_deps_of_deps(
-    const UniqDeps<WithoutDeps>& deps_api_res, IntervalCache& interval_cache
+    const UniqDeps<WithoutDeps>& deps_api_res, IntervalCache& interval_cache,
+    const PackageSource& source
 ) -> DupDeps<WithoutDeps> {
   DupDeps<WithoutDeps> cur_deps_deps;
   for (const auto& [name, dep_info] : deps_api_res) {
     const Package package{ name, dep_info };
 
     // Check if node package is resolved dependency (by interval)
-    const auto found_cache =
-        boost::range::find_if(interval_cache, [&package](const Cache& cache) {
-          return package == cache.package;
-        });
-
-    const std::vector<std::string> dep_versions =
-        found_cache != interval_cache.cend()
-            ? found_cache->versions
-            : get_versions_satisfy_interval(package).unwrap();
-    if (found_cache == interval_cache.cend()) {
+    auto found_cache = interval_cache.find(package);
+    if (found_cache == interval_cache.end()) {
       // Cache interval and versions pair
-      interval_cache.emplace(Cache{ package, dep_versions });
+      found_cache =
+          interval_cache
+              .emplace(
+                  package,
+                  get_versions_satisfy_interval(package, source).unwrap()
+              )
+              .first;
     }
-    for (const std::string& dep_version : dep_versions) {
+    for (const std::string& dep_version : found_cache->second) {
       cur_deps_deps.emplace_back(Package{ package.name, dep_version });
     }
   }
@@ -302,37 +345,41 @@ gather_deps_of_deps(
 void
 gather_deps(
     const Package& package, DupDeps<WithDeps>& new_deps,
-    IntervalCache& interval_cache
+    GatheredSet& gathered, IntervalCache& interval_cache,
+    const PackageSource& source
 ) {
   // Check if root package resolved dependency (whether the specific version is
   // the same), and check circulating
-  if (cache_exists(new_deps, package)) {
+  if (!gathered.insert(package).second) {
     return;
   }
 
   // Get dependencies of dependencies
   const UniqDeps<WithoutDeps> deps_api_res =
-      util::net::api::deps(package.name, package.dep_info.version_rq).unwrap();
+      source.deps(package.name, package.dep_info.version_rq).unwrap();
   if (deps_api_res.empty()) {
     new_deps.emplace_back(package, std::nullopt);
   } else {
     const DupDeps<WithoutDeps> deps_of_deps =
-        gather_deps_of_deps(deps_api_res, interval_cache);
+        gather_deps_of_deps(deps_api_res, interval_cache, source);
 
     // Store dependency and the dependency's dependencies.
     new_deps.emplace_back(package, deps_of_deps);
 
     // Gather dependencies of dependencies of dependencies.
     for (const Package& dep_package : deps_of_deps) {
-      gather_deps(dep_package, new_deps, interval_cache);
+      gather_deps(dep_package, new_deps, gathered, interval_cache, source);
     }
   }
 }
 
 [[nodiscard]] auto
-gather_all_deps(const UniqDeps<WithoutDeps>& deps
+gather_all_deps(
+    const UniqDeps<WithoutDeps>& deps,
+    const PackageSource& source = registry_api()
 ) -> Result<DupDeps<WithDeps>, std::string> {
   DupDeps<WithDeps> duplicate_deps;
+  GatheredSet gathered;
   IntervalCache interval_cache;
 
   // Activate the root of dependencies
@@ -342,6 +389,7 @@ gather_all_deps(const UniqDeps<WithoutDeps>& deps
     // We don't resolve deps of conan packages, this is defer to conan itself
     if (poac::util::registry::conan::v1::resolver::is_conan(package)) {
       duplicate_deps.emplace_back(package, std::nullopt);
+      gathered.insert(package);
       continue;
     }
 
@@ -356,14 +404,14 @@ gather_all_deps(const UniqDeps<WithoutDeps>& deps
     // Get versions using interval
     // FIXME: versions API and deps API are received the almost same responses
     const std::vector<std::string> versions =
-        Try(get_versions_satisfy_interval(package));
+        Try(get_versions_satisfy_interval(package, source));
     // Cache interval and versions pair
-    interval_cache.emplace(Cache{ package, versions });
+    interval_cache.emplace(package, versions);
     for (const std::string& version : versions) {
       gather_deps(
           Package{ package.name,
                    { version, package.dep_info.index, package.dep_info.type } },
-          duplicate_deps, interval_cache
+          duplicate_deps, gathered, interval_cache, source
       );
     }
   }
@@ -2,14 +2,12 @@ module;
 
 // std
 #include <algorithm>
-#include <cmath>
-#include <iostream>
-#include <memory> // std::allocator
-#include <numeric>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <optional>
 #include <utility>
-
-// external
-#include <boost/range/adaptor/indexed.hpp>
+#include <vector>
 
 export module poac.core.resolver.sat;
 
@@ -18,200 +16,497 @@ import poac.util.log;
 import poac.util.result;
 import poac.util.rustify;
 
+// A CDCL (conflict-driven clause learning) SAT solver in the style of
+// MiniSat: two watched literals per clause for unit propagation, first-UIP
+// clause learning with non-chronological backjumping, VSIDS variable
+// activities, phase saving, and Luby restarts.
 export namespace poac::core::resolver::sat {
 
-enum class Status {
-  satisfied, // found a satisfying assignment
-  unsatisfied, // found no satisfying assignment
-  normal, // Successful completion OR unsolved
+// Literals are numbered internally as 2 * variable + (negated ? 1 : 0),
+// where variables start at 0, unlike the DIMACS-style literals of clauses.
+using Lit = u32;
+
+inline auto
+to_lit(const i32 literal) -> Lit {
+  return static_cast<Lit>((std::abs(literal) - 1) * 2 + (literal < 0 ? 1 : 0));
+}
+
+inline auto
+negate(const Lit lit) -> Lit {
+  return lit ^ 1U;
+}
+
+inline auto
+var_of(const Lit lit) -> u32 {
+  return lit >> 1U;
+}
+
+inline auto
+is_negated(const Lit lit) -> bool {
+  return (lit & 1U) != 0;
+}
+
+// The value of a variable or a literal.
+enum class Value : std::uint8_t {
+  undef,
+  truthy,
+  falsy,
 };
 
-auto
-to_assignments(const std::vector<i32>& literals) -> std::vector<i32> {
-  std::vector<i32> assignments;
-  for (auto&& l : literals | boost::adaptors::indexed()) {
-    const i32 literal = l.index() + 1;
-    if (l.value() != -1) {
-      assignments.emplace_back((l.value() % 2 == 0 ? 1 : -1) * literal);
-    } else { // for literals that can take either value, arbitrarily assign them
-             // to be true
-      assignments.emplace_back(literal);
+// A binary max-heap of variables ordered by their activity, from which the
+// next decision variable is taken.
+class VarOrder {
+  const std::vector<double>& activity;
+  std::vector<u32> heap;
+  // The position of each variable in `heap`, or -1 if it is not there.
+  std::vector<i32> positions;
+
+public:
+  explicit VarOrder(const std::vector<double>& activity)
+      : activity(activity), positions(activity.size(), -1) {}
+
+  auto
+  empty() const -> bool {
+    return heap.empty();
+  }
+
+  auto
+  contains(const u32 var) const -> bool {
+    return positions[var] >= 0;
+  }
+
+  void
+  insert(const u32 var) {
+    if (contains(var)) {
+      return;
+    }
+    positions[var] = static_cast<i32>(heap.size());
+    heap.push_back(var);
+    percolate_up(heap.size() - 1);
+  }
+
+  // Restores the order after the activity of `var` has increased.
+  void
+  update(const u32 var) {
+    if (contains(var)) {
+      percolate_up(static_cast<usize>(positions[var]));
     }
   }
-  return assignments;
-}
 
-// the difference in number of occurrences
-template <
-    template <class T, class = std::allocator<T>> typename TwoDim,
-    template <class T, class = std::allocator<T>> typename OneDim, typename T,
-    typename U>
-auto
-calc_literal_polarity(const TwoDim<OneDim<T>>& rng, const U& i) -> T {
-  T acc = 0;
-  for (const auto& rn : rng) {
-    for (const auto& r : rn) {
-      if (std::abs(r) == i) {
-        r > 0 ? ++acc : --acc;
+  auto
+  pop() -> u32 {
+    const u32 top = heap.front();
+    positions[top] = -1;
+    heap.front() = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+      positions[heap.front()] = 0;
+      percolate_down(0);
+    }
+    return top;
+  }
+
+private:
+  void
+  percolate_up(usize i) {
+    const u32 var = heap[i];
+    while (i > 0) {
+      const usize parent = (i - 1) / 2;
+      if (activity[heap[parent]] >= activity[var]) {
+        break;
       }
+      heap[i] = heap[parent];
+      positions[heap[i]] = static_cast<i32>(i);
+      i = parent;
     }
+    heap[i] = var;
+    positions[var] = static_cast<i32>(i);
   }
-  return acc;
-}
 
+  void
+  percolate_down(usize i) {
+    const u32 var = heap[i];
+    while (2 * i + 1 < heap.size()) {
+      usize child = 2 * i + 1;
+      if (child + 1 < heap.size()
+          && activity[heap[child + 1]] > activity[heap[child]]) {
+        ++child;
+      }
+      if (activity[heap[child]] <= activity[var]) {
+        break;
+      }
+      heap[i] = heap[child];
+      positions[heap[i]] = static_cast<i32>(i);
+      i = child;
+    }
+    heap[i] = var;
+    positions[var] = static_cast<i32>(i);
+  }
+};
+
+// The i-th element (starting at 0) of the Luby sequence: 1 1 2 1 1 2 4 ...
 inline auto
-literal_to_index(i32 l) -> i32 {
-  return std::abs(l) - 1;
+luby(u32 i) -> u32 {
+  u32 size = 1;
+  u32 seq = 0;
+  while (size < i + 1) {
+    ++seq;
+    size = 2 * size + 1;
+  }
+  while (size - 1 != i) {
+    size = (size - 1) >> 1U;
+    --seq;
+    i %= size;
+  }
+  return 1U << seq;
 }
 
-// Find `1` or `-1` from whole clauses. Variables that have already been
-// assigned have been deleted from the clauses by the `delete_applied_literal`
-// function, so the index of the variable with the highest number of variables
-// is returned from the variables in the current clauses.
-auto
-maximum_literal_number_index(const std::vector<std::vector<i32>>& clauses
-) -> i32 {
-  Map<i32, i32> frequency;
-  for (const auto& clause : clauses) {
-    for (const auto& literal : clause) {
-      auto result = frequency.insert({ literal_to_index(literal), 1 });
-      if (!result.second) {
-        result.first->second++;
-      }
-    }
-  }
-  auto x = std::max_element(
-      frequency.begin(), frequency.end(),
-      [](const auto& p1, const auto& p2) { return p1.second > p2.second; }
-  );
-  return x->first;
-}
+class Solver {
+  static constexpr usize NO_REASON = std::numeric_limits<usize>::max();
+  static constexpr double VAR_DECAY = 0.95;
+  static constexpr double RESCALE_LIMIT = 1e100;
+  static constexpr u32 RESTART_BASE = 100;
+
+  // Original clauses followed by learnt ones.  The first two literals of a
+  // clause are the watched ones.
+  std::vector<std::vector<Lit>> clauses;
+  // Indices of the clauses watching each literal, visited when the literal
+  // becomes false.
+  std::vector<std::vector<usize>> watches;
+
+  std::vector<Value> assigns;
+  std::vector<u32> levels;
+  // The clause that implied each variable, or NO_REASON for decisions.
+  std::vector<usize> reasons;
+  // The polarity each variable was last assigned, tried first on decisions.
+  std::vector<bool> phases;
+
+  std::vector<Lit> trail;
+  // The start of each decision level in `trail`.
+  std::vector<usize> trail_lims;
+  // The next literal of `trail` to propagate.
+  usize qhead = 0;
+
+  std::vector<double> activity;
+  double var_inc = 1.0;
+  VarOrder order;
+
+  // Scratch space of analyze().
+  std::vector<bool> seen;
+
+  // Whether a conflict was found at level 0 while adding clauses.
+  bool inconsistent = false;
+
+public:
+  explicit Solver(const u32 variables)
+      : watches(static_cast<usize>(variables) * 2),
+        assigns(variables, Value::undef), levels(variables, 0),
+        reasons(variables, NO_REASON), phases(variables, false),
+        activity(variables, 0.0), order(activity), seen(variables, false) {}
+
+  // Adds a clause of DIMACS-style literals.  Returns false if the formula
+  // has become unsatisfiable.
+  auto
+  add_clause(const std::vector<i32>& literals) -> bool {
+    if (inconsistent) {
+      return false;
+    }
+
+    std::vector<Lit> clause;
+    clause.reserve(literals.size());
+    for (const i32 literal : literals) {
+      clause.push_back(to_lit(literal));
+    }
+    std::sort(clause.begin(), clause.end());
+    clause.erase(std::unique(clause.begin(), clause.end()), clause.end());
+
+    // Drop literals falsified at level 0, and the clause itself if it is a
+    // tautology or already satisfied.
+    usize kept = 0;
+    for (usize i = 0; i < clause.size(); ++i) {
+      const Lit lit = clause[i];
+      if (value(lit) == Value::truthy
+          || (i + 1 < clause.size() && clause[i + 1] == negate(lit))) {
+        return true;
+      }
+      if (value(lit) == Value::undef) {
+        clause[kept++] = lit;
+      }
+    }
+    clause.resize(kept);
+
+    if (clause.empty()) {
+      inconsistent = true;
+      return false;
+    }
+    if (clause.size() == 1) {
+      enqueue(clause[0], NO_REASON);
+      inconsistent = propagate() != NO_REASON;
+      return !inconsistent;
+    }
+    attach(std::move(clause));
+    return true;
+  }
+
+  // Returns a model in DIMACS style, i.e., `v` or `-v` for each variable
+  // `v`, or nothing if the formula is unsatisfiable.
+  auto
+  solve() -> std::optional<std::vector<i32>> {
+    if (inconsistent) {
+      return std::nullopt;
+    }
 
-// Delete variables from the clauses for which variable assignment has been
-// determined.
-auto
-delete_set_literal(
-    std::vector<std::vector<i32>>& clauses, const i32& index, const i32& set_val
-) -> Status {
-  for (auto itr1 = clauses.begin(); itr1 != clauses.end(); ++itr1) {
-    for (auto itr2 = itr1->begin(); itr2 != itr1->end(); ++itr2) {
-      // set_val -> unassigned(-1) -> always false
-      // set_val -> true(0) -> value == index + 1
-      // set_val -> false(1) -> value == -(index + 1)
-      if (set_val >= 0
-          && (set_val == 0 ? index + 1 : -1 * (index + 1)) == *itr2) {
-        clauses.erase(itr1);
-        --itr1; // reset iterator
-        if (clauses.empty()) {
-          return Status::satisfied;
+    // Try first the polarity a variable occurs with more often, as the
+    // DPLL solver did.  Variables in no clause are set to true.
+    std::vector<i32> polarity(assigns.size(), 0);
+    std::vector<bool> occurs(assigns.size(), false);
+    for (const std::vector<Lit>& clause : clauses) {
+      for (const Lit lit : clause) {
+        polarity[var_of(lit)] += is_negated(lit) ? -1 : 1;
+        occurs[var_of(lit)] = true;
+      }
+    }
+    for (u32 var = 0; var < assigns.size(); ++var) {
+      phases[var] = !occurs[var] || polarity[var] > 0;
+      order.insert(var);
+    }
+
+    for (u32 restarts = 0;; ++restarts) {
+      const Value result = search(luby(restarts) * RESTART_BASE);
+      if (result == Value::truthy) {
+        std::vector<i32> model;
+        model.reserve(assigns.size());
+        for (u32 var = 0; var < assigns.size(); ++var) {
+          const i32 literal = static_cast<i32>(var) + 1;
+          model.push_back(assigns[var] == Value::falsy ? -literal : literal);
+        }
+        return model;
+      } else if (result == Value::falsy) {
+        return std::nullopt;
+      }
+      backtrack(0);
+    }
+  }
+
+private:
+  auto
+  value(const Lit lit) const -> Value {
+    const Value var_value = assigns[var_of(lit)];
+    if (var_value == Value::undef || !is_negated(lit)) {
+      return var_value;
+    }
+    return var_value == Value::truthy ? Value::falsy : Value::truthy;
+  }
+
+  auto
+  decision_level() const -> u32 {
+    return static_cast<u32>(trail_lims.size());
+  }
+
+  void
+  enqueue(const Lit lit, const usize reason) {
+    const u32 var = var_of(lit);
+    assigns[var] = is_negated(lit) ? Value::falsy : Value::truthy;
+    levels[var] = decision_level();
+    reasons[var] = reason;
+    trail.push_back(lit);
+  }
+
+  void
+  attach(std::vector<Lit> clause) {
+    watches[clause[0]].push_back(clauses.size());
+    watches[clause[1]].push_back(clauses.size());
+    clauses.push_back(std::move(clause));
+  }
+
+  // Propagates the assignments on the trail, and returns the index of a
+  // conflicting clause, or NO_REASON.
+  auto
+  propagate() -> usize {
+    while (qhead < trail.size()) {
+      const Lit false_lit = negate(trail[qhead++]);
+      std::vector<usize>& watchers = watches[false_lit];
+
+      usize kept = 0;
+      for (usize i = 0; i < watchers.size(); ++i) {
+        const usize cref = watchers[i];
+        std::vector<Lit>& clause = clauses[cref];
+        // Keep the false literal second, so that the first one is implied.
+        if (clause[0] == false_lit) {
+          std::swap(clause[0], clause[1]);
         }
-        break; // to the next clause
-      } else if (index == literal_to_index(*itr2)) { // the literal with
-                                                     // opposite polarity
-        itr1->erase(itr2); // remove the literal from the clause
-        --itr2; // reset iterator
-        if (itr1->empty()) {
-          // unsatisfiable currently
-          return Status::unsatisfied;
+        if (value(clause[0]) == Value::truthy) {
+          watchers[kept++] = cref;
+          continue;
         }
-        break; // to the next clause
+
+        bool moved = false;
+        for (usize k = 2; k < clause.size(); ++k) {
+          if (value(clause[k]) != Value::falsy) {
+            std::swap(clause[1], clause[k]);
+            watches[clause[1]].push_back(cref);
+            moved = true;
+            break;
+          }
+        }
+        if (moved) {
+          continue;
+        }
+
+        watchers[kept++] = cref;
+        if (value(clause[0]) == Value::falsy) {
+          for (++i; i < watchers.size(); ++i) {
+            watchers[kept++] = watchers[i];
+          }
+          watchers.resize(kept);
+          qhead = trail.size();
+          return cref;
+        }
+        enqueue(clause[0], cref);
       }
+      watchers.resize(kept);
     }
+    return NO_REASON;
   }
-  return Status::normal;
-}
 
-// unit resolution
-auto
-unit_propagate(
-    std::vector<std::vector<i32>>& clauses, std::vector<i32>& literals
-) -> Status {
-  bool unit_clause_found = true;
-  while (unit_clause_found) {
-    unit_clause_found = false;
-
-    for (auto itr = clauses.begin(); itr != clauses.end(); ++itr) {
-      if (itr->size() == 1) { // unit clause ({3}, {5}, ...)
-        unit_clause_found = true;
-
-        // 0 - if true, 1 - if false, set the literal
-        literals[literal_to_index(*itr->begin())] = *itr->begin() < 0;
-
-        const i32 index = literal_to_index(*itr->begin());
-        const Status result =
-            delete_set_literal(clauses, index, literals[index]);
-        if (result == Status::satisfied || result == Status::unsatisfied) {
-          return result;
+  void
+  bump(const u32 var) {
+    activity[var] += var_inc;
+    if (activity[var] > RESCALE_LIMIT) {
+      for (double& act : activity) {
+        act /= RESCALE_LIMIT;
+      }
+      var_inc /= RESCALE_LIMIT;
+    }
+    order.update(var);
+  }
+
+  // Derives a clause from the conflict by resolving it with the reasons of
+  // its literals up to the first unique implication point, and returns it
+  // with the asserting literal first and the level to backjump to.
+  auto
+  analyze(usize conflict) -> std::pair<std::vector<Lit>, u32> {
+    std::vector<Lit> learnt{ 0 };  // reserved for the asserting literal
+    u32 paths = 0;
+    std::optional<Lit> pivot;
+    usize index = trail.size();
+
+    do {
+      const std::vector<Lit>& clause = clauses[conflict];
+      // The first literal of a reason is the one it implied, i.e., `pivot`.
+      for (usize i = pivot.has_value() ? 1 : 0; i < clause.size(); ++i) {
+        const u32 var = var_of(clause[i]);
+        if (seen[var] || levels[var] == 0) {
+          continue;
         }
-        // Since another unit clause may have been created by this deletion,
-        // loop again from the beginning.
-        break;
-      } else if (itr->empty()) {
-        // the formula is unsatisfiable in this branch
-        return Status::unsatisfied;
+        seen[var] = true;
+        bump(var);
+        if (levels[var] >= decision_level()) {
+          ++paths;
+        } else {
+          learnt.push_back(clause[i]);
+        }
+      }
+
+      while (!seen[var_of(trail[--index])]) {
+      }
+      pivot = trail[index];
+      conflict = reasons[var_of(pivot.value())];
+      seen[var_of(pivot.value())] = false;
+      --paths;
+    } while (paths > 0);
+    learnt[0] = negate(pivot.value());
+
+    u32 backjump_level = 0;
+    for (usize i = 1; i < learnt.size(); ++i) {
+      seen[var_of(learnt[i])] = false;
+      if (levels[var_of(learnt[i])] > backjump_level) {
+        backjump_level = levels[var_of(learnt[i])];
+        // Watch a literal of the backjump level second.
+        std::swap(learnt[1], learnt[i]);
       }
     }
+    var_inc /= VAR_DECAY;
+    return { std::move(learnt), backjump_level };
   }
-  return Status::normal;
-}
 
-// recursive DPLL algorithm
-[[nodiscard]] auto
-dpll(std::vector<std::vector<i32>>& clauses, std::vector<i32>& literals)
+  void
+  backtrack(const u32 level) {
+    if (decision_level() <= level) {
+      return;
+    }
+    for (usize i = trail.size(); i > trail_lims[level]; --i) {
+      const u32 var = var_of(trail[i - 1]);
+      phases[var] = !is_negated(trail[i - 1]);
+      assigns[var] = Value::undef;
+      reasons[var] = NO_REASON;
+      order.insert(var);
+    }
+    trail.resize(trail_lims[level]);
+    trail_lims.resize(level);
+    qhead = trail.size();
+  }
+
+  // Searches until `max_conflicts` conflicts occur.  Returns truthy if a
+  // model was found, falsy if there is none, and undef on a restart.
+  auto
+  search(const u32 max_conflicts) -> Value {
+    for (u32 conflicts = 0;;) {
+      if (const usize conflict = propagate(); conflict != NO_REASON) {
+        if (decision_level() == 0) {
+          return Value::falsy;
+        }
+        ++conflicts;
+        auto [learnt, backjump_level] = analyze(conflict);
+        backtrack(backjump_level);
+        if (learnt.size() == 1) {
+          enqueue(learnt[0], NO_REASON);
+        } else {
+          const Lit asserting = learnt[0];
+          attach(std::move(learnt));
+          enqueue(asserting, clauses.size() - 1);
+        }
+        continue;
+      }
+
+      if (conflicts >= max_conflicts) {
+        return Value::undef;
+      }
+
+      std::optional<u32> next;
+      while (!order.empty()) {
+        const u32 var = order.pop();
+        if (assigns[var] == Value::undef) {
+          next = var;
+          break;
+        }
+      }
+      if (!next.has_value()) {
+        return Value::truthy;
+      }
+      trail_lims.push_back(trail.size());
+      const Lit decision = next.value() * 2 + (phases[next.value()] ? 0 : 1);
+      enqueue(decision, NO_REASON);
+    }
+  }
+};
+
+[[nodiscard]] inline auto
+solve(const std::vector<std::vector<i32>>& clauses, const u32& variables)
     -> Result<std::vector<i32>, std::string> {
-  // NOLINTNEXTLINE(bugprone-branch-clone)
-  if (clauses.empty()) {
-    return Ok(to_assignments(literals));
-  } else if (const Status result = unit_propagate(clauses, literals);
-             result == Status::satisfied) {
-    return Ok(to_assignments(literals));
-  } else if (result == Status::unsatisfied) {
-    return Err(
-        "could not solve dependencies.\n"
-        "detail: given SAT problem was unsatisfied."
-    );
-  }
-
-  // The variable with the greatest frequency will be the next value assigned.
-  const i32 i = maximum_literal_number_index(clauses);
-  // need to apply twice, once true, the other false
-  for (i32 j = 0; j < 2; ++j) {
-    // copy the formula before recursive circulation
-    std::vector<i32> new_literals = literals;
-
-    // if the number of literals with positive polarity are greater
-    // cond ? positive : negative
-    new_literals[i] =
-        calc_literal_polarity(clauses, i + 1) > 0 ? j : (j + 1) % 2;
-
-    // apply the change to all the clauses
-    if (const Status result = delete_set_literal(clauses, i, new_literals[i]);
-        result == Status::satisfied) {
-      return Ok(to_assignments(new_literals));
-    } else if (result == Status::unsatisfied) {
-      // in this branch, return normally
-      continue;
-    }
-
-    auto result = dpll(clauses, new_literals);
-    if (result.is_ok()) {
-      return result;
+  Solver solver(variables);
+  for (const std::vector<i32>& clause : clauses) {
+    if (!solver.add_clause(clause)) {
+      break;
     }
   }
+  if (std::optional<std::vector<i32>> model = solver.solve()) {
+    return Ok(std::move(model.value()));
+  }
   return Err(
       "could not solve dependencies.\n"
       "detail: given SAT problem was unsatisfied."
   );
 }
 
-[[nodiscard]] inline auto
-solve(std::vector<std::vector<i32>> clauses, const u32& variables)
-    -> Result<std::vector<i32>, std::string> {
-  // Express the assignment status of the literal value corresponding to index.
-  // a vector that stores the value assigned to each variable, where
-  // -1 - unassigned, 0 - true, 1 - false.
-  std::vector<i32> literals(variables, -1);
-  return dpll(clauses, literals);
-}
-
 } // namespace poac::core::resolver::sat
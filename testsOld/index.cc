@@ -0,0 +1,115 @@
+#include <boost/ut.hpp>
+#include <poac/core/resolver/index.hpp>
+
+#include <fstream>
+#include <iterator>
+
+auto
+main() -> int {
+  using namespace std::literals::string_literals;
+  using namespace boost::ut;
+  using namespace poac::core::resolver::index;
+  using poac::core::resolver::resolve::DependencyInfo;
+
+  const fs::path path = fs::temp_directory_path() / "poac-registry-index";
+
+  Packages packages;
+  packages["a"] = {
+    { "1.10.0", { { "b", DependencyInfo{ ">=1.0.0 and <2.0.0", "poac",
+                                         "poac" } } } },
+    { "1.2.0", {} },
+    { "1.9.0", { { "b", DependencyInfo{ "1.0.0", "poac", "poac" } },
+                 { "c", DependencyInfo{ "0.1.0", "poac", "poac" } } } },
+  };
+  packages["b"] = { { "1.0.0", {} } };
+  packages["c"] = { { "0.1.0", {} } };
+  expect(write(path, packages).is_ok());
+
+  "test versions_of"_test = [&] {
+    const auto opened = Index::open(path);
+    expect(opened.is_ok() >> fatal);
+    const Index& index = opened.unwrap();
+    expect(eq(index.package_count(), 3));
+
+    // Sorted by semver rather than lexicographically
+    const auto versions = index.versions_of("a");
+    expect(versions.has_value() >> fatal);
+    expect(eq(
+        std::vector<std::string>(versions->begin(), versions->end()),
+        std::vector{ "1.2.0"s, "1.9.0"s, "1.10.0"s }
+    ));
+    expect(!index.versions_of("d").has_value());
+  };
+
+  "test deps_of"_test = [&] {
+    const auto opened = Index::open(path);
+    expect(opened.is_ok() >> fatal);
+    const Index& index = opened.unwrap();
+
+    const auto deps = index.deps_of("a", "1.9.0");
+    expect(deps.has_value() >> fatal);
+    expect(eq(deps->size(), 2));
+    expect(eq(deps->at("b").version_rq, "1.0.0"s));
+    expect(eq(deps->at("c").index, "poac"s));
+
+    expect(index.deps_of("a", "1.2.0").value().empty());
+    expect(!index.deps_of("a", "1.3.0").has_value());
+    expect(!index.deps_of("d", "1.0.0").has_value());
+  };
+
+  "test build metadata"_test = [&] {
+    const fs::path meta = path.string() + ".meta";
+    Packages with_meta;
+    with_meta["a"] = {
+      { "1.0.0+b", { { "b", DependencyInfo{ "1.0.0", "poac", "poac" } } } },
+      { "1.0.0+a", { { "c", DependencyInfo{ "0.1.0", "poac", "poac" } } } },
+      { "1.0.0", {} },
+    };
+    expect(write(meta, with_meta).is_ok());
+    const auto opened = Index::open(meta);
+    expect(opened.is_ok() >> fatal);
+    const Index& index = opened.unwrap();
+
+    // Equal in semver, yet each version keeps its own deps.
+    expect(index.deps_of("a", "1.0.0").value().empty());
+    expect(index.deps_of("a", "1.0.0+a").value().contains("c"));
+    expect(index.deps_of("a", "1.0.0+b").value().contains("b"));
+    expect(!index.deps_of("a", "1.0.0+c").has_value());
+    fs::remove(meta);
+  };
+
+  "test invalid versions"_test = [&] {
+    const fs::path invalid = path.string() + ".invalid";
+    Packages not_semver;
+    not_semver["a"] = { { "latest", {} } };
+    expect(!write(invalid, not_semver).is_ok());
+
+    Packages duplicated;
+    duplicated["a"] = { { "1.0.0", {} }, { "1.0.0", {} } };
+    expect(!write(invalid, duplicated).is_ok());
+    expect(!fs::exists(invalid));
+
+    // Looking up a version that is not semver does not throw.
+    const auto opened = Index::open(path);
+    expect(opened.is_ok() >> fatal);
+    expect(!opened.unwrap().deps_of("a", "latest").has_value());
+  };
+
+  "test open broken index"_test = [&] {
+    expect(!Index::open(path.string() + ".missing").is_ok());
+
+    std::ifstream ifs(path, std::ios::binary);
+    const std::string content{ std::istreambuf_iterator<char>(ifs), {} };
+
+    const fs::path broken = path.string() + ".broken";
+    std::ofstream(broken, std::ios::binary) << content.substr(0, 40);
+    expect(!Index::open(broken).is_ok());
+
+    std::ofstream(broken, std::ios::binary) << "not a registry index"s
+                                                   + content;
+    expect(!Index::open(broken).is_ok());
+    fs::remove(broken);
+  };
+
+  fs::remove(path);
+}
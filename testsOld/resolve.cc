@@ -6,43 +6,123 @@ main() -> int {
   using namespace std::literals::string_literals;
   using namespace boost::ut;
 
-  "test to_binary_numbers"_test = [] {
-    using poac::core::resolver::resolve::to_binary_numbers;
+  "test multiple_versions_cnf"_test = [] {
+    using poac::core::resolver::resolve::multiple_versions_cnf;
 
-    expect(eq(to_binary_numbers(0, 5), "00000"s));
-    expect(eq(to_binary_numbers(1, 5), "00001"s));
-    expect(eq(to_binary_numbers(2, 5), "00010"s));
-    expect(eq(to_binary_numbers(3, 5), "00011"s));
-    expect(eq(to_binary_numbers(4, 5), "00100"s));
-    expect(eq(to_binary_numbers(5, 5), "00101"s));
-    expect(eq(to_binary_numbers(6, 5), "00110"s));
-    expect(eq(to_binary_numbers(7, 5), "00111"s));
-    expect(eq(to_binary_numbers(8, 5), "01000"s));
-    expect(eq(to_binary_numbers(9, 5), "01001"s));
-    expect(eq(to_binary_numbers(10, 5), "01010"s));
-    expect(eq(to_binary_numbers(11, 5), "01011"s));
-    expect(eq(to_binary_numbers(12, 5), "01100"s));
-    expect(eq(to_binary_numbers(13, 5), "01101"s));
-    expect(eq(to_binary_numbers(14, 5), "01110"s));
-    expect(eq(to_binary_numbers(15, 5), "01111"s));
-    expect(eq(to_binary_numbers(16, 5), "10000"s));
-    expect(eq(to_binary_numbers(0, 10), "0000000000"s));
-    expect(eq(to_binary_numbers(1, 10), "0000000001"s));
-    expect(eq(to_binary_numbers(2, 10), "0000000010"s));
-    expect(eq(to_binary_numbers(3, 10), "0000000011"s));
-    expect(eq(to_binary_numbers(4, 10), "0000000100"s));
-    expect(eq(to_binary_numbers(5, 10), "0000000101"s));
-    expect(eq(to_binary_numbers(6, 10), "0000000110"s));
-    expect(eq(to_binary_numbers(7, 10), "0000000111"s));
-    expect(eq(to_binary_numbers(8, 10), "0000001000"s));
-    expect(eq(to_binary_numbers(9, 10), "0000001001"s));
-    expect(eq(to_binary_numbers(10, 10), "0000001010"s));
-    expect(eq(to_binary_numbers(11, 10), "0000001011"s));
-    expect(eq(to_binary_numbers(12, 10), "0000001100"s));
-    expect(eq(to_binary_numbers(13, 10), "0000001101"s));
-    expect(eq(to_binary_numbers(14, 10), "0000001110"s));
-    expect(eq(to_binary_numbers(15, 10), "0000001111"s));
-    expect(eq(to_binary_numbers(16, 10), "0000010000"s));
+    // A few versions are encoded pairwise.
+    {
+      int next_var = 4;
+      const std::vector<std::vector<int>> clauses =
+          multiple_versions_cnf({ 1, 2, 3 }, next_var);
+      expect(eq(
+          clauses,
+          std::vector<std::vector<int>>{
+              { 1, 2, 3 }, { -1, -2 }, { -1, -3 }, { -2, -3 } }
+      ));
+      expect(eq(next_var, 4));
+    }
+
+    // More versions are encoded with a sequential counter.
+    {
+      int next_var = 7;
+      const std::vector<std::vector<int>> clauses =
+          multiple_versions_cnf({ 1, 2, 3, 4, 5, 6 }, next_var);
+      expect(eq(
+          clauses,
+          std::vector<std::vector<int>>{
+              { 1, 2, 3, 4, 5, 6 },
+              { -1, 7 },
+              { -2, 8 },
+              { -7, 8 },
+              { -2, -7 },
+              { -3, 9 },
+              { -8, 9 },
+              { -3, -8 },
+              { -4, 10 },
+              { -9, 10 },
+              { -4, -9 },
+              { -5, 11 },
+              { -10, 11 },
+              { -5, -10 },
+              { -6, -11 } }
+      ));
+      expect(eq(next_var, 12));
+    }
+  };
+
+  using poac::core::resolver::resolve::Deps;
+  using poac::core::resolver::resolve::DupDeps;
+  using poac::core::resolver::resolve::Package;
+  using poac::core::resolver::resolve::WithDeps;
+
+  const auto package = [](const std::string& name, const std::string& ver) {
+    return Package{ name, { ver, "poac", "poac" } };
+  };
+
+  "test create_cnf"_test = [&] {
+    using poac::core::resolver::resolve::create_cnf;
+
+    // A version implies one of the versions of its dependency.
+    {
+      const DupDeps<WithDeps> activated = {
+          { package("a", "1.0.0"),
+            Deps{ { package("b", "1.0.0"), package("b", "2.0.0") } } },
+          { package("b", "1.0.0"), std::nullopt },
+          { package("b", "2.0.0"), std::nullopt },
+      };
+      expect(eq(
+          create_cnf(activated),
+          std::vector<std::vector<int>>{
+              { -1, 2, 3 }, { 1 }, { 2, 3 }, { -2, -3 } }
+      ));
+    }
+
+    // Each dependency gets its own clause.
+    {
+      const DupDeps<WithDeps> activated = {
+          { package("a", "1.0.0"),
+            Deps{ { package("b", "1.0.0"), package("c", "1.0.0") } } },
+          { package("b", "1.0.0"), std::nullopt },
+          { package("c", "1.0.0"), std::nullopt },
+      };
+      expect(eq(
+          create_cnf(activated),
+          std::vector<std::vector<int>>{
+              { -1, 2 }, { -1, 3 }, { 1 }, { 2 }, { 3 } }
+      ));
+    }
+  };
+
+  "test backtrack_loop"_test = [&] {
+    using poac::core::resolver::resolve::backtrack_loop;
+
+    // b@1.0.0 needs c@2.0.0, so only a@2.0.0 agrees with it.
+    {
+      const DupDeps<WithDeps> activated = {
+          { package("a", "1.0.0"), Deps{ { package("c", "1.0.0") } } },
+          { package("a", "2.0.0"), Deps{ { package("c", "2.0.0") } } },
+          { package("b", "1.0.0"), Deps{ { package("c", "2.0.0") } } },
+          { package("c", "1.0.0"), std::nullopt },
+          { package("c", "2.0.0"), std::nullopt },
+      };
+      const auto resolved = backtrack_loop(activated);
+      expect(resolved.is_ok() >> fatal);
+      expect(eq(resolved.unwrap().size(), 3));
+      expect(resolved.unwrap().contains(package("a", "2.0.0")));
+      expect(resolved.unwrap().contains(package("b", "1.0.0")));
+      expect(resolved.unwrap().contains(package("c", "2.0.0")));
+    }
+
+    // a and b need different versions of c.
+    {
+      const DupDeps<WithDeps> activated = {
+          { package("a", "1.0.0"), Deps{ { package("c", "1.0.0") } } },
+          { package("b", "1.0.0"), Deps{ { package("c", "2.0.0") } } },
+          { package("c", "1.0.0"), std::nullopt },
+          { package("c", "2.0.0"), std::nullopt },
+      };
+      expect(backtrack_loop(activated).is_err());
+    }
   };
 }
 
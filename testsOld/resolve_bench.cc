@@ -0,0 +1,277 @@
+// Benchmarks dependency resolution on a synthetic registry:
+//
+//   resolve_bench [--packages N] [--versions N] [--fan-out N] [--roots N]
+//                 [--conflicts P] [--seed N] [--index FILE]
+//
+// Package i has `--versions` versions, each depending on `--fan-out` of the
+// packages after it, so the graph is acyclic.  A requirement usually accepts
+// most versions, but with probability `--conflicts` it accepts one version
+// only, so that dependents may disagree.  The first `--roots` packages are
+// the dependencies of the project.
+//
+// The registry is served from memory, or with `--index`, written to FILE as
+// a registry index and served from its mapping.  gather_all_deps,
+// create_cnf, and solve_sat are timed separately.  Peak memory is that of
+// the process, so run one configuration per process.
+//
+// Like the rest of testsOld, this is not part of any build target.
+
+#include <poac/core/resolver/index.hpp>
+#include <poac/core/resolver/resolve.hpp>
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace poac::core::resolver::resolve;
+namespace registry_index = poac::core::resolver::index;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+  std::size_t packages = 100;
+  std::size_t versions = 10;
+  std::size_t fan_out = 3;
+  std::size_t roots = 5;
+  double conflicts = 0.1;
+  unsigned seed = 1;
+  std::string index;
+};
+
+struct SyntheticRegistry {
+  std::unordered_map<std::string, std::vector<std::string>> versions;
+  std::map<std::pair<std::string, std::string>, UniqDeps<WithoutDeps>> deps;
+};
+
+auto
+package_name(const std::size_t i) -> std::string {
+  return "pkg-" + std::to_string(i);
+}
+
+auto
+version_of(const std::size_t minor) -> std::string {
+  return "1." + std::to_string(minor) + ".0";
+}
+
+auto
+dependency_on(const std::string& requirement) -> DependencyInfo {
+  return { .version_rq = requirement, .index = "poac", .type = "poac" };
+}
+
+auto
+generate(const Config& config, std::mt19937& rng) -> SyntheticRegistry {
+  SyntheticRegistry registry;
+  std::bernoulli_distribution conflicting(config.conflicts);
+  for (std::size_t i = 0; i < config.packages; ++i) {
+    const std::string name = package_name(i);
+    for (std::size_t v = 0; v < config.versions; ++v) {
+      registry.versions[name].push_back(version_of(v));
+
+      UniqDeps<WithoutDeps> deps;
+      const std::size_t rest = config.packages - i - 1;
+      for (std::size_t k = 0; k < config.fan_out && k < rest; ++k) {
+        const std::size_t dep = i + 1 + rng() % rest;
+        const std::size_t lo = rng() % config.versions;
+        // Only `lo` is accepted, or everything from `lo / 2`.
+        const std::string requirement =
+            conflicting(rng)
+                ? ">=" + version_of(lo) + " and <" + version_of(lo + 1)
+                : ">=" + version_of(lo / 2) + " and <2.0.0";
+        deps.emplace(package_name(dep), dependency_on(requirement));
+      }
+      registry.deps.emplace(std::make_pair(name, version_of(v)), deps);
+    }
+  }
+  return registry;
+}
+
+auto
+to_packages(const SyntheticRegistry& registry) -> registry_index::Packages {
+  registry_index::Packages packages;
+  for (const auto& [name_version, deps] : registry.deps) {
+    packages[name_version.first].push_back({ name_version.second, deps });
+  }
+  return packages;
+}
+
+// Counts the lookups made through `source`.
+auto
+counted(PackageSource source, std::size_t& lookups) -> PackageSource {
+  return {
+    .versions = [source, &lookups](const std::string& name) {
+      ++lookups;
+      return source.versions(name);
+    },
+    .deps = [source, &lookups](
+                const std::string& name, const std::string& version
+            ) {
+      ++lookups;
+      return source.deps(name, version);
+    },
+  };
+}
+
+auto
+to_source(const SyntheticRegistry& registry) -> PackageSource {
+  return {
+    .versions = [&registry](const std::string& name
+                ) -> Result<std::vector<std::string>, std::string> {
+      return Ok(registry.versions.at(name));
+    },
+    .deps = [&registry](const std::string& name, const std::string& version
+            ) -> Result<UniqDeps<WithoutDeps>, std::string> {
+      return Ok(registry.deps.at({ name, version }));
+    },
+  };
+}
+
+auto
+elapsed_ms(const Clock::time_point start) -> double {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+auto
+peak_memory_mib() -> double {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_maxrss) / 1024.0; // KiB on Linux
+}
+
+auto
+parse_args(const int argc, char* argv[], Config& config) -> bool {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string_view opt = argv[i];
+    const char* value = argv[i + 1];
+    if (opt == "--packages") {
+      config.packages = std::strtoul(value, nullptr, 10);
+    } else if (opt == "--versions") {
+      config.versions = std::strtoul(value, nullptr, 10);
+    } else if (opt == "--fan-out") {
+      config.fan_out = std::strtoul(value, nullptr, 10);
+    } else if (opt == "--roots") {
+      config.roots = std::strtoul(value, nullptr, 10);
+    } else if (opt == "--conflicts") {
+      config.conflicts = std::strtod(value, nullptr);
+    } else if (opt == "--seed") {
+      config.seed = std::strtoul(value, nullptr, 10);
+    } else if (opt == "--index") {
+      config.index = value;
+    } else {
+      return false;
+    }
+  }
+  return argc % 2 == 1 && config.packages > 0 && config.versions > 0
+         && config.conflicts >= 0.0 && config.conflicts <= 1.0;
+}
+
+// Resolves `roots` from `inner` and reports each step.
+auto
+resolve(const UniqDeps<WithoutDeps>& roots, const PackageSource& inner)
+    -> int {
+  std::size_t lookups = 0;
+  const PackageSource source = counted(inner, lookups);
+
+  auto start = Clock::now();
+  const auto gathered = gather_all_deps(roots, source);
+  if (gathered.is_err()) {
+    std::fprintf(stderr, "%s\n", gathered.unwrap_err().c_str());
+    return EXIT_FAILURE;
+  }
+  const DupDeps<WithDeps>& activated = gathered.unwrap();
+  std::printf(
+      "gather_all_deps: %.3f ms (%zu package versions, %zu lookups)\n",
+      elapsed_ms(start), activated.size(), lookups
+  );
+
+  start = Clock::now();
+  const std::vector<std::vector<int>> clauses = create_cnf(activated);
+  std::size_t literals = 0;
+  for (const std::vector<int>& clause : clauses) {
+    literals += clause.size();
+  }
+  std::printf(
+      "create_cnf: %.3f ms (%zu clauses, %zu literals)\n", elapsed_ms(start),
+      clauses.size(), literals
+  );
+
+  start = Clock::now();
+  const auto resolved = solve_sat(activated, clauses);
+  std::printf(
+      "solve_sat: %.3f ms (%s)\n", elapsed_ms(start),
+      resolved.is_ok() ? "SAT" : "UNSAT"
+  );
+
+  std::printf("peak memory: %.1f MiB\n", peak_memory_mib());
+  return EXIT_SUCCESS;
+}
+
+} // namespace
+
+auto
+main(int argc, char* argv[]) -> int {
+  Config config;
+  if (!parse_args(argc, argv, config)) {
+    std::fprintf(
+        stderr, "usage: %s [--packages N] [--versions N] [--fan-out N] "
+                "[--roots N] [--conflicts P] [--seed N] [--index FILE]\n",
+        argv[0]
+    );
+    return EXIT_FAILURE;
+  }
+
+  std::mt19937 rng(config.seed);
+  const SyntheticRegistry registry = generate(config, rng);
+
+  UniqDeps<WithoutDeps> roots;
+  for (std::size_t i = 0; i < config.roots && i < config.packages; ++i) {
+    roots.emplace(
+        package_name(i), dependency_on(">=" + version_of(0) + " and <2.0.0")
+    );
+  }
+
+  std::printf(
+      "packages: %zu, versions: %zu, fan-out: %zu, roots: %zu, "
+      "conflicts: %.2f, seed: %u\n",
+      config.packages, config.versions, config.fan_out, config.roots,
+      config.conflicts, config.seed
+  );
+
+  if (config.index.empty()) {
+    return resolve(roots, to_source(registry));
+  }
+
+  auto start = Clock::now();
+  const auto written =
+      registry_index::write(config.index, to_packages(registry));
+  if (written.is_err()) {
+    std::fprintf(stderr, "%s\n", written.unwrap_err().c_str());
+    return EXIT_FAILURE;
+  }
+  const double write_ms = elapsed_ms(start);
+  start = Clock::now();
+  const auto opened = registry_index::Index::open(config.index);
+  if (opened.is_err()) {
+    std::fprintf(stderr, "%s\n", opened.unwrap_err().c_str());
+    return EXIT_FAILURE;
+  }
+  std::printf(
+      "index: %.3f ms to write, %.3f ms to open (%zu bytes)\n", write_ms,
+      elapsed_ms(start),
+      static_cast<std::size_t>(std::filesystem::file_size(config.index))
+  );
+  return resolve(roots, index_source(opened.unwrap()));
+}
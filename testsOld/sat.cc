@@ -61,8 +61,7 @@ main() -> int {
       expect(eq(result.unwrap(), std::vector<int>({ 1, 2, 3, 4 })));
     };
 
-    // FIXME: Maybe the SAT solver has a bug
-    skip / it("test6") = [] {
+    it("test6") = [] {
       const std::vector<std::vector<int>> clauses{
         { 1 },         { -2, 6, 5, 4 }, { -3, 6, 4 },  { 2 },
         { 3 },         { 4, 5, 6 },     { -4, -5, 6 }, { -4, 5, -6 },
@@ -107,8 +106,7 @@ main() -> int {
       expect(result.is_err());
     };
 
-    // FIXME: Maybe the SAT solver has a bug
-    skip / it("test2") = [] {
+    it("test2") = [] {
       const std::vector<std::vector<int>> clauses{
         { -1, -2, -3 }, { -2, -3, -4 }, { -2, -2, 3 }, { 2, 2, 2 }, { 1, -2, 4 }
       };
@@ -117,7 +115,6 @@ main() -> int {
       expect(result.is_err());
     };
 
-    // FIXME: Maybe the SAT solver has a bug
     // c FILE: aim-100-1_6-no-1.cnf
     // c
     // c SOURCE: Kazuo Iwama, Eiji Miyano (miyano@cscu.kyushu-u.ac.jp),
@@ -128,7 +125,7 @@ main() -> int {
     // c
     // c NOTE: Not Satisfiable
     // c
-    skip / it("test3") = [] {
+    it("test3") = [] {
       const std::vector<std::vector<int>> clauses{
         { 16, 30, 95 },    { -16, 30, 95 },    { -30, 35, 78 },
         { -30, -78, 85 },  { -78, -85, 95 },   { 8, 55, 100 },